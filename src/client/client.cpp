@@ -39,8 +39,21 @@ int mdb_recv(char* buffer, int size, int &msg_id, int timeout) {
     return ret;
 }
 
-int mdb_send(const char* json_strdata, int size, int msg_id, int timeout) {
-	return client_ptr->send(reinterpret_cast<const uint8_t*>(json_strdata), size, msg_id, timeout);
+// data 可以是 JSON 文本，也可以是 MessagePack/CBOR 编码的请求，响应使用相同的编码
+int mdb_send(const char* data, int size, int msg_id, int timeout) {
+	return client_ptr->send(reinterpret_cast<const uint8_t*>(data), size, msg_id, timeout);
+}
+
+// 异步请求完成时调用: status 为 0 时 data/size 是响应，-1 超时，-2 连接断开
+typedef void (*mdb_callback)(int status, const char* data, int size, int msg_id, void* ctx);
+
+// 返回分配给请求的 msg_id，<0 失败；多个请求可以同时在途，响应按 msg_id 匹配，完成顺序不定
+// 回调在网络线程中执行，回调返回后 data 不再有效
+int mdb_send_async(const char* data, int size, mdb_callback callback, void* ctx, int timeout) {
+	return client_ptr->sendAsync(reinterpret_cast<const uint8_t*>(data), size,
+		[callback, ctx](int status, uint32_t msg_id, const uint8_t* resp, size_t len) {
+			callback(status, reinterpret_cast<const char*>(resp), len, msg_id, ctx);
+		}, timeout);
 }
 
 }
@@ -18,7 +18,9 @@ extern "C" {
     int mdb_start(const char* ip, int port);
     int mdb_reconnect(const char* ip, int port);
     int mdb_recv(char* buffer, int size, int &msg_id, int timeout);
-    int mdb_send(const char* json_strdata, int size, int msg_id, int timeout);
+    int mdb_send(const char* data, int size, int msg_id, int timeout);
+    int mdb_send_async(const char* data, int size,
+        void (*callback)(int status, const char* data, int size, int msg_id, void* ctx), void* ctx, int timeout);
 }
 
 
@@ -28,12 +30,27 @@ bool exiting = false;
 static int id = 0;
 static int offset = 0;
 int msgid = 1;
+// MDB_FORMAT=msgpack 或 cbor 时以二进制编码收发
+const std::string wire_format = get_env_var("MDB_FORMAT", std::string("json"));
+
+std::vector<uint8_t> encode_request(const std::string& jsonConfig) {
+    std::vector<uint8_t> request;
+    if (wire_format == "msgpack") {
+        request = json::to_msgpack(json::parse(jsonConfig));
+    } else if (wire_format == "cbor") {
+        request = json::to_cbor(json::parse(jsonConfig));
+    } else {
+        request.assign(jsonConfig.begin(), jsonConfig.end());
+    }
+    return request;
+}
 
 int test(const std::string jsonConfig) {
     // 写操作，支持超时
     int ret = 0;
     
-    ret = mdb_send(jsonConfig.c_str(), jsonConfig.size(),msgid, 1000);
+    std::vector<uint8_t> request = encode_request(jsonConfig);
+    ret = mdb_send(reinterpret_cast<const char*>(request.data()), request.size(),msgid, 1000);
     if (ret<0) {
         std::cerr << "Write operation failed:" << ret << std::endl;
         if (ret == -2) {
@@ -66,7 +83,10 @@ int test(const std::string jsonConfig) {
     if (ret>0) {
         //printf("APP RECV[%d]:\r\n",ret);
         //print_packet(reinterpret_cast<const uint8_t*>(buffer),ret);
-        json jsonData = json::parse(std::string(str_buff.begin(),str_buff.begin()+ret));
+        auto end = str_buff.begin() + ret;
+        json jsonData = wire_format == "msgpack" ? json::from_msgpack(str_buff.begin(), end) :
+                        wire_format == "cbor" ? json::from_cbor(str_buff.begin(), end) :
+                        json::parse(str_buff.begin(), end);
         std::cout << jsonData.dump(2) << std::endl;
     }
     msgid++;
@@ -582,6 +602,39 @@ void count(std::string& name) {
     test(jsonConfig);
 }
 
+// 同一连接上连续发出 total 个 count 请求，不等待响应，统计每秒完成的请求数
+// 在途请求数由 MDB_MAX_INFLIGHT 限制
+std::atomic<int> completed{0};
+std::atomic<int> failed{0};
+
+void pipeline(std::string& name, int total) {
+    json jsonData;
+    jsonData["action"] = "count";
+    jsonData["name"] = name;
+    std::vector<uint8_t> request = encode_request(jsonData.dump());
+
+    auto on_response = [](int status, const char*, int, int, void*) {
+        if (status != 0) {
+            failed++;
+        }
+        completed++;
+    };
+    auto start = std::chrono::steady_clock::now();
+    int sent = 0;
+    for (; sent < total && !exiting; ++sent) {
+        if (mdb_send_async(reinterpret_cast<const char*>(request.data()), request.size(), on_response, nullptr, 3000) < 0) {
+            failed++;
+            completed++;
+        }
+    }
+    while (completed < sent) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << sent << " requests, " << failed.load() << " failed, "
+              << std::fixed << std::setprecision(0) << sent / seconds << " req/s" << std::endl;
+}
+
 void signal_handler(int signal) {
     if (signal == SIGINT) {
         std::cout << "\nSIGINT received. Preparing to exit..." << std::endl;
@@ -630,6 +683,8 @@ int main(int argc, char* argv[]) {
         }
     } else if (command == "count") {
         count(param);
+    } else if (command == "pipeline") {
+        pipeline(param, argc > 3 ? std::atoi(argv[3]) : 100000);
     } else if (command == "create_idx") {
         createidx(param);
     } else if (command == "drop_idx") {
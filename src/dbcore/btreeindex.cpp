@@ -0,0 +1,309 @@
+#include <algorithm>
+#include "btreeindex.hpp"
+
+namespace {
+constexpr size_t kMaxKeys = 64;     // 每个节点最多的键数
+}
+
+struct BTreeIndex::Node {
+    bool leaf = true;
+    std::vector<Field> keys;
+    std::vector<std::unique_ptr<Node>> children;   // 内部节点
+    std::vector<Posting> postings;                  // 叶子节点，与 keys 一一对应
+    Node* next = nullptr;                           // 叶子链表
+
+    // 内部节点: children[i] 中的键都在 [keys[i-1], keys[i]) 内
+    size_t childFor(const Field& key) const {
+        return std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+    }
+
+    // 插入后节点溢出时分裂，返回新的右兄弟并通过 sep 返回分隔键
+    std::unique_ptr<Node> insert(const Field& key, RowId rowId, Field& sep, bool& newKey, bool& added) {
+        if (leaf) {
+            auto it = std::lower_bound(keys.begin(), keys.end(), key);
+            size_t pos = it - keys.begin();
+            if (it != keys.end() && !(key < *it)) {
+                added = postings[pos].add(rowId);
+                return nullptr;
+            }
+            keys.insert(it, key);
+            postings.insert(postings.begin() + pos, Posting());
+            postings[pos].add(rowId);
+            newKey = added = true;
+            if (keys.size() <= kMaxKeys) {
+                return nullptr;
+            }
+            auto right = std::make_unique<Node>();
+            size_t mid = keys.size() / 2;
+            right->keys.assign(std::make_move_iterator(keys.begin() + mid), std::make_move_iterator(keys.end()));
+            right->postings.assign(std::make_move_iterator(postings.begin() + mid), std::make_move_iterator(postings.end()));
+            keys.resize(mid);
+            postings.resize(mid);
+            right->next = next;
+            next = right.get();
+            sep = right->keys.front();
+            return right;
+        }
+
+        size_t idx = childFor(key);
+        Field childSep;
+        auto split = children[idx]->insert(key, rowId, childSep, newKey, added);
+        if (!split) {
+            return nullptr;
+        }
+        keys.insert(keys.begin() + idx, std::move(childSep));
+        children.insert(children.begin() + idx + 1, std::move(split));
+        if (keys.size() <= kMaxKeys) {
+            return nullptr;
+        }
+        auto right = std::make_unique<Node>();
+        right->leaf = false;
+        size_t mid = keys.size() / 2;
+        sep = std::move(keys[mid]);
+        right->keys.assign(std::make_move_iterator(keys.begin() + mid + 1), std::make_move_iterator(keys.end()));
+        right->children.assign(std::make_move_iterator(children.begin() + mid + 1), std::make_move_iterator(children.end()));
+        keys.resize(mid);
+        children.resize(mid + 1);
+        return right;
+    }
+};
+
+BTreeIndex::BTreeIndex() : root_(std::make_unique<Node>()) {
+    head_ = root_.get();
+}
+
+BTreeIndex::~BTreeIndex() = default;
+BTreeIndex::BTreeIndex(BTreeIndex&&) noexcept = default;
+BTreeIndex& BTreeIndex::operator=(BTreeIndex&&) noexcept = default;
+
+void BTreeIndex::clear() {
+    root_ = std::make_unique<Node>();
+    head_ = root_.get();
+    keyCount_ = 0;
+    entryCount_ = 0;
+}
+
+const BTreeIndex::Node* BTreeIndex::findLeaf(const Field& key) const {
+    const Node* node = root_.get();
+    while (!node->leaf) {
+        node = node->children[node->childFor(key)].get();
+    }
+    return node;
+}
+
+void BTreeIndex::insert(const Field& key, RowId rowId) {
+    Field sep;
+    bool newKey = false, added = false;
+    auto split = root_->insert(key, rowId, sep, newKey, added);
+    if (split) {
+        // 根节点分裂，树高加一
+        auto root = std::make_unique<Node>();
+        root->leaf = false;
+        root->keys.push_back(std::move(sep));
+        root->children.push_back(std::move(root_));
+        root->children.push_back(std::move(split));
+        root_ = std::move(root);
+    }
+    if (newKey) keyCount_++;
+    if (added) entryCount_++;
+}
+
+bool BTreeIndex::erase(const Field& key, RowId rowId) {
+    Node* leaf = const_cast<Node*>(findLeaf(key));
+    auto it = std::lower_bound(leaf->keys.begin(), leaf->keys.end(), key);
+    if (it == leaf->keys.end() || key < *it) {
+        return false;
+    }
+    size_t pos = it - leaf->keys.begin();
+    auto& posting = leaf->postings[pos];
+    if (!posting.remove(rowId)) {
+        return false;
+    }
+    entryCount_--;
+    if (posting.empty()) {
+        leaf->keys.erase(it);
+        leaf->postings.erase(leaf->postings.begin() + pos);
+        keyCount_--;
+    }
+    return true;
+}
+
+size_t BTreeIndex::erase(const Field& key, const std::vector<RowId>& rowIds) {
+    Node* leaf = const_cast<Node*>(findLeaf(key));
+    auto it = std::lower_bound(leaf->keys.begin(), leaf->keys.end(), key);
+    if (it == leaf->keys.end() || key < *it || rowIds.empty()) {
+        return 0;
+    }
+    size_t pos = it - leaf->keys.begin();
+    auto& posting = leaf->postings[pos];
+    size_t removed = 0;
+    for (RowId rowId : rowIds) {
+        removed += posting.remove(rowId);
+    }
+    entryCount_ -= removed;
+    if (posting.empty()) {
+        leaf->keys.erase(it);
+        leaf->postings.erase(leaf->postings.begin() + pos);
+        keyCount_--;
+    }
+    return removed;
+}
+
+void BTreeIndex::bulkLoad(std::vector<std::pair<Field, RowId>>& entries) {
+    clear();
+    std::sort(entries.begin(), entries.end());
+    if (entries.empty()) {
+        return;
+    }
+
+    // 构建叶子层
+    std::vector<std::unique_ptr<Node>> level;
+    std::vector<Field> mins;    // 每个节点子树中的最小键
+    Node* prev = nullptr;
+    Posting* last = nullptr;    // 正在填充的 posting
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i > 0 && !(entries[i - 1].first < entries[i].first)) {
+            // 同一键的行号按升序到达，直接追加到最后一个容器
+            if (last->add(entries[i].second)) {
+                entryCount_++;
+            }
+            continue;
+        }
+        if (last) last->shrinkToFit();
+        if (level.empty() || level.back()->keys.size() == kMaxKeys) {
+            level.push_back(std::make_unique<Node>());
+            if (prev) prev->next = level.back().get();
+            prev = level.back().get();
+            mins.push_back(entries[i].first);
+        }
+        level.back()->keys.push_back(entries[i].first);
+        level.back()->postings.emplace_back();
+        last = &level.back()->postings.back();
+        last->add(entries[i].second);
+        keyCount_++;
+        entryCount_++;
+    }
+    last->shrinkToFit();
+    head_ = level.front().get();
+
+    // 逐层向上构建内部节点
+    while (level.size() > 1) {
+        std::vector<std::unique_ptr<Node>> parents;
+        std::vector<Field> parentMins;
+        for (size_t i = 0; i < level.size(); ++i) {
+            if (parents.empty() || parents.back()->children.size() == kMaxKeys + 1) {
+                parents.push_back(std::make_unique<Node>());
+                parents.back()->leaf = false;
+                parentMins.push_back(mins[i]);
+            } else {
+                parents.back()->keys.push_back(mins[i]);
+            }
+            parents.back()->children.push_back(std::move(level[i]));
+        }
+        level.swap(parents);
+        mins.swap(parentMins);
+    }
+    root_ = std::move(level.front());
+}
+
+const BTreeIndex::Posting* BTreeIndex::find(const Field& key) const {
+    const Node* leaf = findLeaf(key);
+    auto it = std::lower_bound(leaf->keys.begin(), leaf->keys.end(), key);
+    if (it == leaf->keys.end() || key < *it) {
+        return nullptr;
+    }
+    return &leaf->postings[it - leaf->keys.begin()];
+}
+
+void BTreeIndex::forEach(const std::function<void(const Field&, const Posting&)>& fn) const {
+    for (const Node* leaf = head_; leaf; leaf = leaf->next) {
+        for (size_t i = 0; i < leaf->keys.size(); ++i) {
+            fn(leaf->keys[i], leaf->postings[i]);
+        }
+    }
+}
+
+template <typename Visit>
+void BTreeIndex::scan(const Node* leaf, size_t pos, std::vector<const Posting*>& out, Visit visit) const {
+    for (; leaf; leaf = leaf->next, pos = 0) {
+        for (; pos < leaf->keys.size(); ++pos) {
+            int action = visit(leaf->keys[pos]);
+            if (action == 2) return;
+            if (action == 0) {
+                out.push_back(&leaf->postings[pos]);
+            }
+        }
+    }
+}
+
+void BTreeIndex::search(const Predicate& pred, RoaringBitmap& result) const {
+    const FieldValue& value = pred.value();
+    const Field key(value);
+
+    // 定位第一个 >= key (或 > key) 的位置
+    auto seek = [&](const Field& k, bool upper) {
+        const Node* leaf = findLeaf(k);
+        auto it = upper ? std::upper_bound(leaf->keys.begin(), leaf->keys.end(), k)
+                        : std::lower_bound(leaf->keys.begin(), leaf->keys.end(), k);
+        return std::make_pair(leaf, size_t(it - leaf->keys.begin()));
+    };
+
+    // 先收集命中的 posting，最后一次合并
+    std::vector<const Posting*> out;
+    switch (pred.op()) {
+        case CmpOp::EQ:
+            if (auto posting = find(key)) {
+                out.push_back(posting);
+            }
+            break;
+        case CmpOp::NE:
+            scan(head_, 0, out, [&](const Field& k) { return (k < key || key < k) ? 0 : 1; });
+            break;
+        case CmpOp::LT:
+            scan(head_, 0, out, [&](const Field& k) { return k < key ? 0 : 2; });
+            break;
+        case CmpOp::LE:
+            scan(head_, 0, out, [&](const Field& k) { return key < k ? 2 : 0; });
+            break;
+        case CmpOp::GT:
+        case CmpOp::GE: {
+            auto [leaf, pos] = seek(key, pred.op() == CmpOp::GT);
+            scan(leaf, pos, out, [](const Field&) { return 0; });
+            break;
+        }
+        case CmpOp::LIKE: {
+            // 与 Query 一致: 非字符串的查询值或键不匹配
+            if (!std::holds_alternative<std::string>(value)) {
+                break;
+            }
+            const std::string& pattern = std::get<std::string>(value);
+            if (pattern.size() > 1 && pattern.back() == '%' && pattern.front() != '%') {
+                // 'prefix%': 所有以 prefix 开头的字符串在键序上连续，直接范围扫描
+                std::string_view prefix(pattern.data(), pattern.size() - 1);
+                auto [leaf, pos] = seek(Field(std::string(prefix)), false);
+                scan(leaf, pos, out, [&](const Field& k) {
+                    const auto& v = k.getValue();
+                    if (!std::holds_alternative<std::string>(v)) return 2;
+                    const auto& s = std::get<std::string>(v);
+                    return s.compare(0, prefix.size(), prefix) == 0 ? 0 : 2;
+                });
+            } else {
+                // 其他模式只扫描字符串键
+                auto [leaf, pos] = seek(Field(std::string()), false);
+                scan(leaf, pos, out, [&](const Field& k) {
+                    const auto& v = k.getValue();
+                    if (!std::holds_alternative<std::string>(v)) return 2;
+                    return pred(v) ? 0 : 1;
+                });
+            }
+            break;
+        }
+    }
+    if (out.empty()) {
+        return;
+    }
+    if (!result.empty()) {
+        out.push_back(&result);
+    }
+    result = RoaringBitmap::unionOf(out);
+}
@@ -0,0 +1,59 @@
+#ifndef BTREEINDEX_HPP
+#define BTREEINDEX_HPP
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "field.hpp"
+#include "predicate.hpp"
+#include "roaring.hpp"
+
+// 表的稳定行号，插入时分配，不随行在存储中的位置变化
+using RowId = uint64_t;
+
+// 有序 B+ 树二级索引: 键 -> 行号的压缩位图 (posting list)
+// 叶子节点按键序串成链表，范围查询定位起点后顺序扫描叶子，代价为 O(log n + k)
+// 删除时不做节点合并，空叶子保留在链表中，由下次 bulkLoad 重建时回收
+class BTreeIndex {
+public:
+    using Posting = RoaringBitmap;
+
+    BTreeIndex();
+    ~BTreeIndex();
+    BTreeIndex(BTreeIndex&&) noexcept;
+    BTreeIndex& operator=(BTreeIndex&&) noexcept;
+    BTreeIndex(const BTreeIndex&) = delete;
+    BTreeIndex& operator=(const BTreeIndex&) = delete;
+
+    void insert(const Field& key, RowId rowId);
+    bool erase(const Field& key, RowId rowId);
+    // 批量删除同一键下的多个行号，只定位一次键，返回删除的个数
+    size_t erase(const Field& key, const std::vector<RowId>& rowIds);
+    void clear();
+    // 批量构建: 排序后自底向上填满节点，比逐条插入快且节点更紧凑
+    void bulkLoad(std::vector<std::pair<Field, RowId>>& entries);
+
+    const Posting* find(const Field& key) const;
+    size_t keyCount() const { return keyCount_; }
+    size_t entryCount() const { return entryCount_; }
+
+    // 支持 ==, !=, <, <=, >, >=, LIKE；命中的各个键的 posting 合并后与 out 求并
+    void search(const Predicate& pred, RoaringBitmap& out) const;
+    // 按键序遍历所有键
+    void forEach(const std::function<void(const Field&, const Posting&)>& fn) const;
+
+private:
+    struct Node;
+    // 返回 0 收集该键，1 跳过，2 停止扫描
+    template <typename Visit>
+    void scan(const Node* leaf, size_t pos, std::vector<const Posting*>& out, Visit visit) const;
+    const Node* findLeaf(const Field& key) const;
+
+    std::unique_ptr<Node> root_;
+    Node* head_ = nullptr;      // 最左叶子
+    size_t keyCount_ = 0;
+    size_t entryCount_ = 0;
+};
+
+#endif
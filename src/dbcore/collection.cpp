@@ -3,123 +3,299 @@
 #include "util/util.hpp"
 #include "query.hpp"
 
-void Collection::createIndex(const std::string& path) {
+IndexType Collection::parseIndexType(const std::string& name) {
+    if (name == "ordered") {
+        return IndexType::ORDERED;
+    }
+    if (name == "hash") {
+        return IndexType::HASH;
+    }
+    throw std::invalid_argument("Unknown index type: " + name);
+}
+
+void Collection::createIndex(const std::string& path, IndexType type) {
+    createIndexes({path}, type);
+}
+
+void Collection::createIndexes(const std::vector<std::string>& paths, IndexType type) {
+    if (paths.empty()) {
+        return;
+    }
     std::unique_lock<std::shared_mutex> lock(mutex_);
-    //bool ret = false;
+    std::vector<FieldPath> fieldPaths(paths.begin(), paths.end());
+    // 先建空索引，集合为空时索引同样存在，之后插入的文档会加入；缺少字段的文档记为空值
+    std::vector<decltype(hashIndexes_)::mapped_type> hashBuilt(type == IndexType::HASH ? paths.size() : 0);
+    std::vector<decltype(indexedFields_)::mapped_type> orderedBuilt(type == IndexType::HASH ? 0 : paths.size());
     for (const auto& [docId, docPtr] : documents_) {
-        auto field = docPtr->getFieldByPath(path);
-        if (field) {
-            //std::cout << path << " -> value: " << *field << " -> docID: " << docId << std::endl;
-            indexedFields_[path][field->getValue()].insert(docId); // 存储字段值
-            //ret = true;
-        } else {
-            // 可以选择不插入空字段的索引，或者标记为空值
-            indexedFields_[path][std::monostate{}].insert(docId);
-        }
-    }
-    // 打印索引内容，查看空值排列情况
-    /*std::cout << "Index for path: " << path << std::endl;
-    for (const auto& [value, docIds] : indexedFields_[path]) {
-        std::cout << "Value: ";
-        std::visit([](const auto& v) {
-            if constexpr (std::is_same_v<std::decay_t<decltype(v)>, std::monostate>) {
-                std::cout << "null";
+        DocSlot slot = acquireSlot(docId);
+        for (size_t i = 0; i < fieldPaths.size(); ++i) {
+            auto field = docPtr->getFieldByPath(fieldPaths[i]);
+            if (type == IndexType::HASH) {
+                hashBuilt[i][field ? *field : Field()].add(slot);
             } else {
-                std::cout << v;
+                orderedBuilt[i][field ? field->getValue() : FieldValue(std::monostate{})].add(slot);
             }
-        }, value);
-        std::cout << " -> Doc IDs(" << docIds.size() << "): ";
-        for (const auto& docId : docIds) {
-            std::cout << docId << " ";
         }
-        std::cout << std::endl;
-    }*/
+    }
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (type == IndexType::HASH) {
+            hashIndexes_[paths[i]] = std::move(hashBuilt[i]);
+        } else {
+            indexedFields_[paths[i]] = std::move(orderedBuilt[i]);
+            invalidateStats(paths[i]);
+        }
+    }
 }
 
-void Collection::updateIndex(const std::string& path, const DocumentId& docId, const FieldValue& newValue) {
-    auto indexIt = indexedFields_.find(path);
-    if (indexIt == indexedFields_.end()) return; // 若索引不存在，直接返回
-
-    auto& fieldMap = indexIt->second;  // 获取当前字段的索引映射
+void Collection::updateIndex(const std::string& path, const DocumentId& docId, const FieldValue& oldValue, const FieldValue& newValue) {
+    deleteIndex(path, docId, oldValue);
+    insertIndex(path, docId, newValue);
+}
 
-    // 先找到旧值并删除
-    for (auto it = fieldMap.begin(); it != fieldMap.end(); ++it) {
-        auto& docSet = it->second;
-        if (docSet.erase(docId) > 0) {  
-            if (docSet.empty()) {  // 如果该值下没有文档了，移除该值
-                fieldMap.erase(it);
-            }
-            break; // 找到并删除后，退出循环
-        }
+void Collection::insertIndex(const std::string& path, const DocumentId& docId, const FieldValue& value) {
+    auto indexIt = indexedFields_.find(path);
+    auto hashIt = hashIndexes_.find(path);
+    if (indexIt == indexedFields_.end() && hashIt == hashIndexes_.end()) {
+        return;
+    }
+    DocSlot slot = acquireSlot(docId);
+    if (indexIt != indexedFields_.end()) {
+        modCount_++;
+        // 使用 try_emplace 避免重复查找
+        indexIt->second.try_emplace(value).first->second.add(slot);
+    }
+    if (hashIt != hashIndexes_.end()) {
+        hashIt->second[Field(value)].add(slot);
     }
-
-    // 插入新值
-    // 使用 try_emplace 避免重复查找
-    auto& docSet = fieldMap.try_emplace(newValue).first->second;
-    docSet.insert(docId);
 }
 
 // **更新索引删除字段**
 void Collection::deleteIndex(const std::string& path, const DocumentId& docId, const FieldValue& deleteValue) {
+    DocSlot slot;
+    if (!findSlot(docId, slot)) {
+        return; // 文档不在任何索引中
+    }
     // 查找索引中的条目
     auto indexIt = indexedFields_.find(path);
     if (indexIt != indexedFields_.end()) {
         auto& valueMap = indexIt->second;
+        modCount_++;
 
         // 查找该字段值是否存在于索引中
         auto valueIt = valueMap.find(deleteValue);
         if (valueIt != valueMap.end()) {
-            auto& docSet = valueIt->second;
-            //std::cout << "erase idx from: k[" << path << "]->v[" << valueToDelete << "]->doc[" << docId << "]\n";
-            // 从索引中删除该文档
-            docSet.erase(docId);
-            // 如果该字段值在索引中没有文档引用，删除该索引条目
-            if (docSet.empty()) {
-                //std::cout << "also erase set for key: " << valueToDelete << "\n";
+            // 从索引中删除该文档，该字段值没有文档引用时删除该索引条目
+            valueIt->second.remove(slot);
+            if (valueIt->second.empty()) {
                 valueMap.erase(valueIt);
             }
         }
-    } else {
-        std::cerr << "Path not found in indexedFields: " << path << std::endl;
     }
+    auto hashIt = hashIndexes_.find(path);
+    if (hashIt != hashIndexes_.end()) {
+        auto valueIt = hashIt->second.find(Field(deleteValue));
+        if (valueIt != hashIt->second.end()) {
+            valueIt->second.remove(slot);
+            if (valueIt->second.empty()) {
+                hashIt->second.erase(valueIt);
+            }
+        }
+    }
+}
+
+std::vector<FieldPath> Collection::indexedPaths() const {
+    std::vector<FieldPath> paths;
+    paths.reserve(indexedFields_.size() + hashIndexes_.size());
+    for (const auto& [path, _] : indexedFields_) {
+        paths.emplace_back(path);
+    }
+    for (const auto& [path, _] : hashIndexes_) {
+        if (!hasOrderedIndex(path)) {
+            paths.emplace_back(path);
+        }
+    }
+    return paths;
+}
+
+void Collection::indexDocument(const DocumentId& docId, const Document& doc, const std::vector<FieldPath>& paths) {
+    for (const auto& path : paths) {
+        // 与 createIndex 一致，缺少该字段的文档记为空值
+        auto field = doc.getFieldByPath(path);
+        insertIndex(path.str(), docId, field ? field->getValue() : FieldValue(std::monostate{}));
+    }
+}
+
+std::vector<FieldPath> Collection::affectedIndexPaths(const std::vector<std::string>& paths) const {
+    // 一端是另一端加 '.' 开头的前缀时，修改其中一个会改变另一个的取值
+    auto nested = [](const std::string& outer, const std::string& inner) {
+        return inner.size() > outer.size() && inner[outer.size()] == '.' && inner.compare(0, outer.size(), outer) == 0;
+    };
+    std::vector<FieldPath> affected;
+    for (auto& indexPath : indexedPaths()) {
+        const std::string& index = indexPath.str();
+        if (std::any_of(paths.begin(), paths.end(), [&](const std::string& path) {
+                return path == index || nested(path, index) || nested(index, path);
+            })) {
+            affected.push_back(std::move(indexPath));
+        }
+    }
+    return affected;
+}
+
+std::vector<FieldValue> Collection::indexValues(const Document& doc, const std::vector<FieldPath>& paths) {
+    std::vector<FieldValue> values;
+    values.reserve(paths.size());
+    for (const auto& path : paths) {
+        auto field = doc.getFieldByPath(path);
+        values.push_back(field ? field->getValue() : FieldValue(std::monostate{}));
+    }
+    return values;
 }
 
-void Collection::deleteIndex(const DocumentId& docId) {
+void Collection::reindex(const DocumentId& docId, const Document& doc, const std::vector<FieldPath>& paths,
+    const std::vector<FieldValue>& oldValues) {
+    for (size_t i = 0; i < paths.size(); ++i) {
+        auto field = doc.getFieldByPath(paths[i]);
+        FieldValue newValue = field ? field->getValue() : FieldValue(std::monostate{});
+        if (newValue != oldValues[i]) {
+            updateIndex(paths[i].str(), docId, oldValues[i], newValue);
+        }
+    }
+}
+
+void Collection::deleteIndex(const DocumentId& docId, const std::vector<FieldPath>& paths) {
     auto it = documents_.find(docId);
     if (it == documents_.end()) {
         std::cerr << "document not found in document_: " << docId << std::endl;
         return; // 文档不存在
     }
     auto doc = it->second; // 获取文档 
-    // 从索引中删除
-    for (const auto& [fieldPath, field] : doc->getFields()) {
-        auto fieldIt = indexedFields_.find(fieldPath);
-        if (fieldIt != indexedFields_.end()) {
-            auto valueIt = fieldIt->second.find(field.getValue());
-            if (valueIt != fieldIt->second.end()) {
-                valueIt->second.erase(docId);
-                if (valueIt->second.empty()) {
-                    fieldIt->second.erase(valueIt);
-                }
-            }
+    // 从索引中删除，缺少该字段的文档在索引中记为空值
+    for (const auto& path : paths) {
+        auto field = doc->getFieldByPath(path);
+        deleteIndex(path.str(), docId, field ? field->getValue() : FieldValue(std::monostate{}));
+    }
+    releaseSlot(docId);
+}
+
+DocSlot Collection::acquireSlot(const DocumentId& docId) {
+    auto [it, inserted] = slots_.try_emplace(docId, 0);
+    if (!inserted) {
+        return it->second;
+    }
+    if (!freeSlots_.empty()) {
+        it->second = freeSlots_.back();
+        freeSlots_.pop_back();
+        slotDocs_[it->second] = docId;
+    } else {
+        if (slotDocs_.size() >= UINT32_MAX) {
+            slots_.erase(it);
+            throw std::runtime_error("Too many indexed documents");
         }
+        it->second = static_cast<DocSlot>(slotDocs_.size());
+        slotDocs_.push_back(docId);
+    }
+    return it->second;
+}
+
+void Collection::releaseSlot(const DocumentId& docId) {
+    auto it = slots_.find(docId);
+    if (it == slots_.end()) {
+        return;
+    }
+    // slotDocs_ 保留原来的 ID，复用之前残留的 posting 仍指向已删除的文档，查询时被过滤掉
+    retiredSlots_.add(it->second);
+    slots_.erase(it);
+    // 攒够一批再清除，每次清除遍历所有 posting 的开销分摊到这一批删除上
+    if (retiredSlots_.size() >= std::max<size_t>(1024, slotDocs_.size() / 8)) {
+        recycleSlots();
     }
 }
 
+void Collection::recycleSlots() {
+    auto sweep = [this](auto& valueMap) {
+        for (auto valueIt = valueMap.begin(); valueIt != valueMap.end();) {
+            valueIt->second -= retiredSlots_;
+            valueIt = valueIt->second.empty() ? valueMap.erase(valueIt) : std::next(valueIt);
+        }
+    };
+    for (auto& [path, valueMap] : indexedFields_) {
+        sweep(valueMap);
+    }
+    for (auto& [path, valueMap] : hashIndexes_) {
+        sweep(valueMap);
+    }
+    freeSlots_.reserve(freeSlots_.size() + retiredSlots_.size());
+    retiredSlots_.forEach([this](RoaringBitmap::Value slot) { freeSlots_.push_back(static_cast<DocSlot>(slot)); });
+    retiredSlots_.clear();
+}
+
 void Collection::dropIndex(const std::string& path) {
     std::unique_lock<std::shared_mutex> lock(mutex_);
     auto it = indexedFields_.find(path);
     if (it != indexedFields_.end()) {
-        std::map<FieldValue, std::unordered_set<DocumentId>>().swap(it->second);  // 释放内存
+        std::map<FieldValue, RoaringBitmap>().swap(it->second);  // 释放内存
         indexedFields_.erase(it);
         //malloc_trim(0);
     }
+    hashIndexes_.erase(path);
+    invalidateStats(path);
+    if (indexedFields_.empty() && hashIndexes_.empty()) {
+        // 最后一个索引删除后不再需要文档编号
+        std::unordered_map<DocumentId, DocSlot>().swap(slots_);
+        std::vector<DocumentId>().swap(slotDocs_);
+        std::vector<DocSlot>().swap(freeSlots_);
+        retiredSlots_.clear();
+    }
+}
+
+const RoaringBitmap* Collection::findIndexed(const std::string& path, const FieldValue& value) const {
+    auto hashIt = hashIndexes_.find(path);
+    if (hashIt != hashIndexes_.end()) {
+        auto valueIt = hashIt->second.find(Field(value));
+        return valueIt == hashIt->second.end() ? nullptr : &valueIt->second;
+    }
+    auto indexIt = indexedFields_.find(path);
+    if (indexIt != indexedFields_.end()) {
+        auto valueIt = indexIt->second.find(value);
+        return valueIt == indexIt->second.end() ? nullptr : &valueIt->second;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const IndexStats> Collection::getIndexStats(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    auto& stats = stats_[path];
+    // 修改的条目数超过一定比例后重建
+    size_t threshold = std::max<size_t>(64, documents_.size() / 8);
+    if (!stats || modCount_ - stats->version > threshold) {
+        auto indexIt = indexedFields_.find(path);
+        if (indexIt == indexedFields_.end()) {
+            return std::make_shared<IndexStats>();
+        }
+        size_t entries = 0;
+        for (const auto& [_, docSet] : indexIt->second) {
+            entries += docSet.size();
+        }
+        auto newStats = std::make_shared<IndexStats>(entries);
+        for (const auto& [fieldValue, docSet] : indexIt->second) {
+            newStats->add(fieldValue, docSet.size());
+        }
+        newStats->version = modCount_;
+        stats = newStats;
+    }
+    return stats;
+}
+
+void Collection::invalidateStats(const std::string& path) {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    stats_.erase(path);
 }
 
 // 根据字段路径获取排序后的文档列表
-std::vector<std::pair<DocumentId, FieldValue>> Collection::getSortedDocuments(const std::string& path,
+std::vector<DocumentId> Collection::getSortedDocuments(const std::string& path,
     const std::vector<DocumentId>& candidateDocs) const {
-    std::vector<std::pair<DocumentId, FieldValue>> sortedDocs;
+    std::vector<DocumentId> sortedDocs;
     auto indexIt = indexedFields_.find(path);
     
     if (indexIt == indexedFields_.end()) {
@@ -127,39 +303,123 @@ std::vector<std::pair<DocumentId, FieldValue>> Collection::getSortedDocuments(co
     }
 
     const auto& valueMap = indexIt->second;  // 直接引用，减少查找
+    // 候选文档不超过索引文档数的 1/16 时直接排序候选文档，k log k 次比较少于遍历整个索引
+    constexpr size_t kSortScanRatio = 16;
     if (candidateDocs.empty()) {
         // **没有候选文档，直接返回所有索引中的文档**
-        size_t estimatedSize = 0;
-        
-        // 计算需要存储的文档数量，减少后续 push_back 的扩容
+        sortedDocs.reserve(documents_.size());
         for (const auto& [_, docSet] : valueMap) {
-            estimatedSize += docSet.size();
+            docSet.forEach([&](DocSlot slot) { sortedDocs.emplace_back(slotDocs_[slot]); });
         }
-        sortedDocs.reserve(estimatedSize);
-
-        // 遍历所有字段值对应的文档集
-        for (const auto& [fieldValue, docSet] : valueMap) {
-            for (const auto& docId : docSet) {
-                sortedDocs.emplace_back(docId, fieldValue);
-            }
+    } else if (candidateDocs.size() <= slots_.size() / kSortScanRatio) {
+        // **候选文档远少于索引中的文档时，不遍历索引，直接按各文档自己的字段值排序**
+        // 与遍历索引的结果一致: 键按索引的比较方式排序，键相同按编号排序，缺少字段的文档按空值参与排序
+        FieldPath fieldPath(path);
+        std::vector<std::pair<FieldValue, DocSlot>> keyed;
+        keyed.reserve(candidateDocs.size());
+        for (const auto& docId : candidateDocs) {
+            DocSlot slot;
+            auto doc = getDocumentNoLock(docId);
+            if (!doc || !findSlot(docId, slot)) continue;
+            auto field = doc->getFieldByPath(fieldPath);
+            keyed.emplace_back(field ? field->getValue() : FieldValue(std::monostate{}), slot);
+        }
+        auto less = valueMap.key_comp();
+        std::sort(keyed.begin(), keyed.end(), [&](const auto& a, const auto& b) {
+            if (less(a.first, b.first)) return true;
+            if (less(b.first, a.first)) return false;
+            return a.second < b.second;
+        });
+        // 候选集中重复的文档只保留一个
+        keyed.erase(std::unique(keyed.begin(), keyed.end(),
+            [](const auto& a, const auto& b) { return a.second == b.second; }), keyed.end());
+        sortedDocs.reserve(keyed.size());
+        for (const auto& [_, slot] : keyed) {
+            sortedDocs.emplace_back(slotDocs_[slot]);
         }
     } else {
-        // **有候选文档，只保留 candidateDocs 里存在于索引的文档**
-        std::unordered_set<DocumentId> candidateSet(candidateDocs.begin(), candidateDocs.end());
-        sortedDocs.reserve(candidateSet.size());
-
-        for (const auto& [fieldValue, docSet] : valueMap) {
-            for (const auto& docId : docSet) {
-                if (candidateSet.find(docId) != candidateSet.end()) {
-                    sortedDocs.emplace_back(docId, fieldValue);
-                }
+        // **有候选文档，只保留 candidateDocs 里存在于索引的文档，候选集转换为编号位图后逐个检查**
+        RoaringBitmap candidates;
+        for (const auto& docId : candidateDocs) {
+            DocSlot slot;
+            if (findSlot(docId, slot)) {
+                candidates.add(slot);
             }
         }
+        sortedDocs.reserve(candidates.size());
+        for (const auto& [_, docSet] : valueMap) {
+            docSet.forEach([&](DocSlot slot) {
+                if (candidates.contains(slot)) {
+                    sortedDocs.emplace_back(slotDocs_[slot]);
+                }
+            });
+        }
     }
-    //std::cout << "size of sortedDocs: " << sortedDocs.size() <<  std::endl;
     return sortedDocs;
 }
 
+void Collection::searchIndex(const std::string& path, const Predicate& pred, std::vector<const RoaringBitmap*>& out) const {
+    auto indexIt = indexedFields_.find(path);
+    if (indexIt == indexedFields_.end()) {
+        return;
+    }
+    const auto& valueMap = indexIt->second;
+    const FieldValue& value = pred.value();
+    // 收集 [first, last) 范围内各个键的 posting
+    auto collect = [&out](auto first, auto last) {
+        for (; first != last; ++first) {
+            out.push_back(&first->second);
+        }
+    };
+
+    // 键序与 Predicate 一致: 类型相同按值比较，类型不同按 variant 下标比较
+    switch (pred.op()) {
+        case CmpOp::EQ: {
+            auto range = valueMap.equal_range(value);
+            collect(range.first, range.second);
+            break;
+        }
+        case CmpOp::NE: {
+            auto range = valueMap.equal_range(value);
+            collect(valueMap.begin(), range.first);
+            collect(range.second, valueMap.end());
+            break;
+        }
+        case CmpOp::LT:
+            collect(valueMap.begin(), valueMap.lower_bound(value));
+            break;
+        case CmpOp::LE:
+            collect(valueMap.begin(), valueMap.upper_bound(value));
+            break;
+        case CmpOp::GT:
+            collect(valueMap.upper_bound(value), valueMap.end());
+            break;
+        case CmpOp::GE:
+            collect(valueMap.lower_bound(value), valueMap.end());
+            break;
+        case CmpOp::LIKE: {
+            // 与 Query 一致: 非字符串的查询值或键不匹配
+            if (!std::holds_alternative<std::string>(value)) {
+                return;
+            }
+            const std::string& pattern = std::get<std::string>(value);
+            bool prefix = pattern.size() > 1 && pattern.back() == '%' && pattern.front() != '%';
+            // 字符串键在键序上连续；'prefix%' 的命中键也连续，从 prefix 开始扫描
+            std::string start = prefix ? pattern.substr(0, pattern.size() - 1) : std::string();
+            for (auto it = valueMap.lower_bound(FieldValue(start)); it != valueMap.end(); ++it) {
+                auto key = std::get_if<std::string>(&it->first);
+                if (!key || (prefix && key->compare(0, start.size(), start) != 0)) {
+                    break;
+                }
+                if (prefix || pred(it->first)) {
+                    out.push_back(&it->second);
+                }
+            }
+            break;
+        }
+    }
+}
+
 std::vector<DocumentId> Collection::insertDocumentsFromJson(const json& j) {
     std::vector<DocumentId> insertedIds;
     if (!j.contains("documents")) {
@@ -168,7 +428,10 @@ std::vector<DocumentId> Collection::insertDocumentsFromJson(const json& j) {
 
     std::unique_lock<std::shared_mutex> lock(mutex_);
 
+    // 先解析并校验所有文档，有文档失败时整批都不插入，失败的请求不会留下插入了一半的数据
     std::vector<DocumentId> failedIds;  // 用于记录失败的文档 ID
+    std::vector<std::pair<DocumentId, std::shared_ptr<Document>>> newDocs;
+    std::unordered_set<DocumentId> batchIds;  // 本批中已出现的 ID
     for (const auto& jDoc : j["documents"]) {
         // 如果没有提供 ID，则生成唯一 ID
         DocumentId docId;
@@ -178,9 +441,8 @@ std::vector<DocumentId> Collection::insertDocumentsFromJson(const json& j) {
             docId = std::hash<std::string>{}(generateUniqueId());
         }
         
-        auto it = documents_.find(docId);
-        if (it != documents_.end()) {
-            // 如果文档已存在，记录失败并继续处理下一个文档
+        if (documents_.count(docId) || !batchIds.insert(docId).second) {
+            // 如果文档已存在，记录失败并继续检查下一个文档
             std::cerr << "Duplicate document ID: " << docId << std::endl;
             failedIds.push_back(docId);
             continue;
@@ -191,26 +453,15 @@ std::vector<DocumentId> Collection::insertDocumentsFromJson(const json& j) {
         try {
             doc->fromJson(jDoc);  // 加载 JSON 数据到文档
             schema_.validateDocument(doc);
-            
-            // 插入文档
-            documents_.emplace(docId, doc);
-            insertedIds.push_back(docId);
+            newDocs.emplace_back(docId, std::move(doc));
         } catch (const std::exception& e) {
             std::cerr << "Failed to insert document with ID " << docId << ": " << e.what() << std::endl;
             failedIds.push_back(docId);
         }
     }
-    //批量更新索引
-    for (const auto& docId: insertedIds ) {
-        auto doc = this->getDocumentNoLock(docId);
-        // **更新索引**
-        for (const auto& [path, field] : doc->getFields()) {  
-            updateIndex(path, docId, field.getValue());
-        }
-    }
 
     if (!failedIds.empty()) {
-        // 可以选择在插入完成后抛出一个包含所有失败文档 ID 的异常
+        // 抛出包含所有失败文档 ID 的异常，其他文档也不插入
         std::string failedMsg = "Failed to insert the following documents: ";
         for (const auto& failedId : failedIds) {
             failedMsg += std::to_string(failedId) + " ";
@@ -218,6 +469,16 @@ std::vector<DocumentId> Collection::insertDocumentsFromJson(const json& j) {
         throw std::invalid_argument(failedMsg);
     }
 
+    //批量更新索引，索引路径只解析一次
+    auto paths = indexedPaths();
+    insertedIds.reserve(newDocs.size());
+    for (auto& [docId, doc] : newDocs) {
+        const Document& inserted = *doc;
+        documents_.emplace(docId, std::move(doc));
+        indexDocument(docId, inserted, paths);
+        insertedIds.push_back(docId);
+    }
+
     return insertedIds;  // 返回插入文档的 ID 列表
 }
 
@@ -228,11 +489,13 @@ void Collection::insertDocument(const DocumentId& id, const Document& doc) {
     try {
         auto docPtr = std::make_shared<Document>(doc);
         schema_.validateDocument(docPtr);
-        documents_[id] = docPtr;
-        // **更新索引**
-        for (const auto& [path, field] : doc.getFields()) {  
-            updateIndex(path, id, field.getValue());
+        // **更新索引**，覆盖已有文档时先清除旧文档的索引
+        auto paths = indexedPaths();
+        if (documents_.count(id)) {
+            deleteIndex(id, paths);
         }
+        documents_[id] = docPtr;
+        indexDocument(id, *docPtr, paths);
     } catch (const std::exception& e) {
         std::cerr << "Failed to insert document with ID " << id << ": " << e.what() << std::endl;
     }
@@ -241,12 +504,18 @@ void Collection::insertDocument(const DocumentId& id, const Document& doc) {
 bool Collection::updateDocument(DocumentId id, const json& updateFields) {
     std::unique_lock<std::shared_mutex> lock(mutex_);
 
-    auto it = documents_.find(id);
-    if (it == documents_.end()) {
+    auto doc = mutableDocument(id); // 获取文档
+    if (!doc) {
         return false; // 文档不存在
     }
 
-    auto doc = it->second; // 获取文档
+    std::vector<std::string> paths;
+    for (auto it = updateFields.begin(); it != updateFields.end(); ++it) {
+        paths.push_back(it.key());
+    }
+    // 更新上层字段时其下子路径上的索引同样要维护
+    auto affected = affectedIndexPaths(paths);
+    auto oldValues = indexValues(*doc, affected);
     for (auto it = updateFields.begin(); it != updateFields.end(); ++it) {
         auto& path = it.key();
         auto newValue = valuefromJson(it.value());
@@ -257,8 +526,8 @@ bool Collection::updateDocument(DocumentId id, const json& updateFields) {
         } else {
             doc->setFieldByPath(path, Field(newValue));//添加新字段
         }
-        updateIndex(path, id, newValue);
     }
+    reindex(id, *doc, affected, oldValues);
 
     return true;
 }
@@ -273,26 +542,59 @@ int Collection::updateFromJson(const json& j) {
     query.fromJson(j);
 
     // **Step 1: 解析 "fields" 并校验合法性**
-    std::unordered_map<std::string, Field> parsedFields;
+    // 路径只解析一次，逐文档更新时复用
+    std::vector<std::pair<FieldPath, Field>> parsedFields;
     const json& fieldsToUpdate = j["fields"];
     for (auto it = fieldsToUpdate.begin(); it != fieldsToUpdate.end(); ++it) {
         std::string path = it.key();
         Field field = Field(valuefromJson(it.value()));
 
         schema_.validateField(path, field);
-        parsedFields.emplace(path, std::move(field));
+        // 一个路径是另一个的上层时，更新结果取决于执行顺序，不允许
+        for (const auto& [other, _] : parsedFields) {
+            const auto& shorter = other.str().size() < path.size() ? other.str() : path;
+            const auto& longer = other.str().size() < path.size() ? path : other.str();
+            if (longer.compare(0, shorter.size(), shorter) == 0 && longer[shorter.size()] == '.') {
+                throw std::invalid_argument("Conflicting update fields: " + other.str() + " and " + path);
+            }
+        }
+        // 先登记各段的字段名，修改文档时不会因为字段名字典已满而中途失败
+        FieldPath parsed(path);
+        for (size_t i = 0; i < parsed.size(); ++i) {
+            FieldNames::getInstance().intern(parsed.segment(i));
+        }
+        parsedFields.emplace_back(FieldPath(path), std::move(field));
     }
-    // **Step 3: 获取写锁，仅更新符合条件的文档**
+    // **Step 2: 获取写锁，先检查所有匹配的文档，有文档无法更新时整批都不修改**
     std::unique_lock<std::shared_mutex> lock(mutex_);
     std::vector<DocumentId> matchedDocs;
     query.match(matchedDocs);
+    for (const auto& id : matchedDocs) {
+        auto doc = getDocumentNoLock(id);
+        if (!doc) continue;
+        for (const auto& [path, _] : parsedFields) {
+            if (!doc->canSetFieldByPath(path)) {
+                throw std::invalid_argument("Cannot update " + path.str() + " in document " + std::to_string(id)
+                    + ": a parent field is not a document");
+            }
+        }
+    }
+
+    // **Step 3: 更新符合条件的文档**
     
     int updateCount = 0;
+    // 更新上层字段时其下子路径上的索引同样要维护
+    std::vector<std::string> paths;
+    for (const auto& [path, _] : parsedFields) {
+        paths.push_back(path.str());
+    }
+    auto affected = affectedIndexPaths(paths);
 
     for (auto& id : matchedDocs) {
         bool updated = false;
-        auto doc = this->getDocumentNoLock(id);
+        auto doc = mutableDocument(id);
         if (!doc) continue;
+        auto oldValues = indexValues(*doc, affected);
         for (const auto& [path, newValue] : parsedFields) {
             auto field = doc->getFieldByPath(path);
             if (field) {
@@ -301,8 +603,8 @@ int Collection::updateFromJson(const json& j) {
                 doc->setFieldByPath(path, newValue);
             }
             updated = true;
-            updateIndex(path, id, newValue.getValue());
         }
+        reindex(id, *doc, affected, oldValues);
 
         if (updated) {
             ++updateCount;
@@ -315,6 +617,10 @@ int Collection::updateFromJson(const json& j) {
 // 删除文档
 bool Collection::deleteDocument(const DocumentId& id) {
     std::unique_lock<std::shared_mutex> lock(mutex_);  // 使用写锁，确保线程安全
+    if (!documents_.count(id)) {
+        return false;
+    }
+    deleteIndex(id, indexedPaths());
     return documents_.erase(id) > 0;
 }
 
@@ -324,11 +630,14 @@ int Collection::deleteFromJson(const json& j) {
     query.fromJson(j);
 
     // Step 1: 解析 "fields" 字段为集合
-    std::unordered_set<std::string> deleteFields;
+    std::vector<FieldPath> deleteFields;
     if (j.contains("fields")) {
+        std::unordered_set<std::string> paths;
         const json& fields = j["fields"];
         for (const auto& path : fields) {
-            deleteFields.insert(path.get<std::string>());
+            if (paths.insert(path.get<std::string>()).second) {
+                deleteFields.emplace_back(path.get<std::string>());
+            }
         }
     }
 
@@ -336,31 +645,39 @@ int Collection::deleteFromJson(const json& j) {
     std::unique_lock<std::shared_mutex> lock(mutex_);
     std::vector<DocumentId> matchedDocs;
     query.match(matchedDocs);
+    auto paths = indexedPaths();
+    // 删除上层字段时其下子路径上的索引同样要维护
+    std::vector<std::string> deletePaths;
+    for (const auto& path : deleteFields) {
+        deletePaths.push_back(path.str());
+    }
+    auto affected = affectedIndexPaths(deletePaths);
 
     for (auto& id: matchedDocs) {
-        auto doc = this->getDocumentNoLock(id);
+        auto doc = mutableDocument(id);
         if (!doc) continue;
         bool hasDeletedField = false;
         // 如果有指定字段进行删除
         if (!deleteFields.empty()) {
+            auto oldValues = indexValues(*doc, affected);
             for (const auto& path : deleteFields) {
-                Field removedField = doc->removeFieldByPath(path);
+                doc->removeFieldByPath(path);
 
                 hasDeletedField = true;
-                updateIndex(path, id, std::monostate{});
                 ++deleteCount;
             }
+            reindex(id, *doc, affected, oldValues);
 
             // 如果删除字段后，文档为空，就删除该文档
             if (hasDeletedField && doc->getFields().empty()) {
                 // **删除文档时，也要从索引中清除该文档**
-                deleteIndex(id);
+                deleteIndex(id, paths);
                 // 如果删除字段后，文档为空，就删除该文档
                 documents_.erase(id);
             }
         } else {
             // **删除文档时，也要从索引中清除该文档**
-            deleteIndex(id);
+            deleteIndex(id, paths);
             // 没有指定 "fields"，删除整个文档
             documents_.erase(id);
             ++deleteCount;
@@ -379,12 +696,63 @@ std::shared_ptr<Document> Collection::getDocumentNoLock(const DocumentId& id) co
     return nullptr;
 }
 
+std::shared_ptr<Document> Collection::mutableDocument(const DocumentId& id) {
+    auto it = documents_.find(id);
+    if (it == documents_.end()) {
+        return nullptr;
+    }
+    if (it->second.use_count() > 1) {
+        // 嵌套文档也是共享指针，经二进制转换得到深拷贝
+        std::string binary = it->second->toBinary();
+        auto copy = std::make_shared<Document>();
+        copy->fromBinary(binary.data(), binary.size());
+        it->second = std::move(copy);
+    }
+    return it->second;
+}
+
 // 获取文档
 std::shared_ptr<Document> Collection::getDocument(const DocumentId& id) const {
     std::shared_lock<std::shared_mutex> lock(mutex_);  // 共享锁
     return getDocumentNoLock(id);
 }
 
+bool Collection::isPointQuery(const json& j, size_t maxDocs) const {
+    if (!j.contains("conditions") || j.at("conditions").empty()) {
+        return false;
+    }
+    std::shared_lock<std::shared_mutex> lock(mutex_); // 共享锁
+    bool allProbes = true;
+    for (const auto& cond : j.at("conditions")) {
+        std::string path = cond.at("path").get<std::string>();
+        if (cond.at("op").get<std::string>() != "==" || !hasIndex(path)) {
+            allProbes = false;
+            continue;
+        }
+        auto docs = findIndexed(path, valuefromJson(cond.at("value")));
+        if (docs == nullptr || docs->size() <= maxDocs) {
+            return true;
+        }
+    }
+    if (!allProbes || !j.contains("pagination")) {
+        return false;
+    }
+    const auto& pagination = j.at("pagination");
+    size_t offset = pagination.at("offset").get<size_t>();
+    return offset <= maxDocs && pagination.at("limit").get<size_t>() <= maxDocs - offset;
+}
+
+json Collection::explainFromJson(const json& j) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_); // 共享锁
+    Query query(*this);
+    query.fromJson(j);
+
+    json plan = query.explain();
+    plan["name"] = name_;
+    plan["type"] = type_;
+    return plan;
+}
+
 std::vector<std::pair<DocumentId, std::shared_ptr<Document>>> Collection::queryFromJson(const json& j) const {
     std::shared_lock<std::shared_mutex> lock(mutex_); // 共享锁
     Query query(*this);
@@ -407,9 +775,11 @@ std::vector<std::pair<DocumentId, std::shared_ptr<Document>>> Collection::queryF
 
     // 如果需要投影字段，进行投影处理
     if (j.contains("fields")) {
-        std::vector<std::string> fieldsToProject;
+        // 路径只解析一次；投影结果中的字段名就是完整路径，编号也提前登记
+        std::vector<std::pair<FieldPath, FieldId>> fieldsToProject;
         for (const auto& path : j["fields"]) {
-            fieldsToProject.push_back(path.get<std::string>());
+            std::string name = path.get<std::string>();
+            fieldsToProject.emplace_back(FieldPath(name), FieldNames::getInstance().intern(name));
         }
 
         std::vector<std::pair<DocumentId, std::shared_ptr<Document>>> projectedResults;
@@ -419,14 +789,14 @@ std::vector<std::pair<DocumentId, std::shared_ptr<Document>>> Collection::queryF
             auto docPtr = this->getDocumentNoLock(docId);
             if (!docPtr) continue;
             auto projectedDoc = std::make_shared<Document>();
-            for (const auto& path : fieldsToProject) {
+            for (const auto& [path, nameId] : fieldsToProject) {
                 auto field = docPtr->getFieldByPath(path);
                 if (field) {
                     //projectedDoc->setFieldByPath(path, *field);  // 设置投影字段
-                    projectedDoc->setField(path, *field); //不需要构造文档树
+                    projectedDoc->setField(nameId, Field(*field)); //不需要构造文档树
                 } else {
-                    std::cerr << "Error: Field " << path << " does not exist in document " << std::to_string(docId) << ".\n";
-                    throw std::invalid_argument("Invalid field: " + path + " not exist in " + std::to_string(docId));
+                    std::cerr << "Error: Field " << path.str() << " does not exist in document " << std::to_string(docId) << ".\n";
+                    throw std::invalid_argument("Invalid field: " + path.str() + " not exist in " + std::to_string(docId));
                 }
             }
             projectedResults.push_back({docId, projectedDoc});
@@ -497,26 +867,10 @@ void Collection::saveSchema(const std::string& filePath) {
     outputFile.close();
 }
 
-// 转换为二进制
-std::string Collection::toBinary() const {
-    std::shared_lock<std::shared_mutex> lock(mutex_); // 共享锁
-    std::string binary;
-    for (const auto& [id, doc] : documents_) {
-        // 直接使用 uint64_t 类型的 ID，转换为字节流
-        binary.append(reinterpret_cast<const char*>(&id), sizeof(id));
-
-        // 文档内容的二进制
-        std::string docBinary = doc->toBinary();
-        uint32_t docLen = docBinary.size();
-        binary.append(reinterpret_cast<const char*>(&docLen), sizeof(docLen));
-        binary.append(docBinary);
-    }
-    return binary;
-}
-
 // 从二进制加载
 void Collection::fromBinary(const char* data, size_t size) {
     std::unique_lock<std::shared_mutex> lock(mutex_);  // 使用写锁，确保线程安全
+    auto paths = indexedPaths();    // 已有索引时同步维护
     size_t offset = 0;
     while (offset < size) {
         // 读取文档 ID
@@ -536,26 +890,42 @@ void Collection::fromBinary(const char* data, size_t size) {
         // 创建并加载文档
         auto doc = std::make_shared<Document>();
         doc->fromBinary(docBinary.data(), docBinary.size());
+        if (!paths.empty() && documents_.count(id)) {
+            deleteIndex(id, paths);
+        }
         documents_[id] = doc;
+        indexDocument(id, *doc, paths);
     }
 }
 
 // 将集合导出到二进制文件
 void Collection::exportToBinaryFile(const std::string& filePath) {
-    // 获取集合的二进制表示
-    std::string binaryData = toBinary();
-
-    // 打开文件并写入数据
-    std::ofstream outputFile(filePath, std::ios::binary);
-    if (!outputFile.is_open()) {
-        throw std::runtime_error("Failed to open file for writing: " + filePath);
-    }
-
-    // 写入二进制数据到文件
-    outputFile.write(binaryData.data(), binaryData.size());
-    outputFile.close();
+    snapshot()(filePath);
+}
 
-    //std::cout << "Collection successfully exported to binary file: " << filePath << std::endl;
+DataContainer::Writer Collection::snapshot() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_); // 共享锁
+    // 锁内只复制文档指针，之后的修改由 mutableDocument 复制出新文档，快照中的文档保持不变
+    auto docs = std::make_shared<const std::vector<std::pair<DocumentId, std::shared_ptr<Document>>>>(
+        documents_.begin(), documents_.end());
+    return [docs](const std::string& filePath) {
+        std::ofstream outputFile(filePath, std::ios::binary);
+        if (!outputFile.is_open()) {
+            throw std::runtime_error("Failed to open file for writing: " + filePath);
+        }
+        // 逐个文档序列化后写入，不再在内存中拼出整个集合
+        for (const auto& [id, doc] : *docs) {
+            std::string docBinary = doc->toBinary();
+            uint32_t docLen = docBinary.size();
+            outputFile.write(reinterpret_cast<const char*>(&id), sizeof(id));
+            outputFile.write(reinterpret_cast<const char*>(&docLen), sizeof(docLen));
+            outputFile.write(docBinary.data(), docBinary.size());
+        }
+        outputFile.close();
+        if (!outputFile) {
+            throw std::runtime_error("Failed to write file: " + filePath);
+        }
+    };
 }
 
 // 从二进制文件中导入集合
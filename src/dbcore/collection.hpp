@@ -12,6 +12,16 @@
 #include "datacontainer.hpp"
 #include "document.hpp"
 #include "collection_schema.hpp"
+#include "indexstats.hpp"
+#include "predicate.hpp"
+#include "roaring.hpp"
+
+// 集合索引类型: ORDERED 有序，支持范围条件和按索引排序；HASH 只支持等值查找
+// 同一路径上两种索引可以同时存在
+enum class IndexType { ORDERED, HASH };
+
+// 文档编号: 集合有索引时给每个文档分配的紧凑编号，索引的 posting 位图保存编号
+using DocSlot = uint32_t;
 
 class Collection: public DataContainer {
     friend class Query;
@@ -35,6 +45,11 @@ public:
     
     // 查询文档集合，支持过滤
     std::vector<std::pair<DocumentId, std::shared_ptr<Document>>> queryFromJson(const json& j) const;
+    // 返回查询计划
+    json explainFromJson(const json& j) const;
+    // 查询只涉及少量文档时返回 true: 命中不超过 maxDocs 个文档的索引等值，
+    // 或分页的 offset + limit 不超过 maxDocs 且所有条件都是索引等值；供调度区分点操作和扫描
+    bool isPointQuery(const json& j, size_t maxDocs) const;
     std::vector<DocumentId> insertDocumentsFromJson(const json& j);
     int updateFromJson(const json& j);
     int deleteFromJson(const json& j);
@@ -49,13 +64,17 @@ public:
     bool deleteDocument(const DocumentId& id);
 
     // 创建索引：为指定字段创建索引
-    void createIndex(const std::string& path);
-    // 删除索引
+    void createIndex(const std::string& path, IndexType type = IndexType::ORDERED);
+    // 所有路径先在临时索引中构建，全部成功后才加入集合；中途失败时已有的索引不变
+    void createIndexes(const std::vector<std::string>& paths, IndexType type = IndexType::ORDERED);
+    // 删除索引，两种索引都删除
     void dropIndex(const std::string& path);
     // 检查是否有索引
     bool hasIndex(const std::string& path) const {
-        return indexedFields_.find(path) != indexedFields_.end();
+        return hasOrderedIndex(path) || hasHashIndex(path);
     }
+    // "ordered"、"hash"，其他值抛出 invalid_argument
+    static IndexType parseIndexType(const std::string& name);
     
     // 序列化和反序列化
     virtual json toJson() const override;
@@ -64,22 +83,80 @@ public:
     virtual void saveSchema(const std::string& filePath) override;
     virtual void exportToBinaryFile(const std::string& filePath) override;
     virtual void importFromBinaryFile(const std::string& filePath) override;
+    virtual Writer snapshot() const override;
 private:
-    std::string toBinary() const;
     void fromBinary(const char* data, size_t size);
+    // 返回可以原地修改的文档: 文档被快照或调用方持有时先复制一份替换，写时复制
+    std::shared_ptr<Document> mutableDocument(const DocumentId& id);
 
-    void updateIndex(const std::string& path, const DocumentId& docId, const FieldValue& newValue);
+    bool hasOrderedIndex(const std::string& path) const {
+        return indexedFields_.find(path) != indexedFields_.end();
+    }
+    bool hasHashIndex(const std::string& path) const {
+        return hashIndexes_.find(path) != hashIndexes_.end();
+    }
+    // 维护 path 上的两种索引，path 没有索引时什么也不做
+    // 文档在 path 上的值从 oldValue 变为 newValue，缺少字段的文档记为空值
+    void updateIndex(const std::string& path, const DocumentId& docId, const FieldValue& oldValue, const FieldValue& newValue);
+    void insertIndex(const std::string& path, const DocumentId& docId, const FieldValue& value);
     void deleteIndex(const std::string& path, const DocumentId& docId, const FieldValue& deleteValue);
-    void deleteIndex(const DocumentId& docId);
+    void deleteIndex(const DocumentId& docId, const std::vector<FieldPath>& paths);
+    // 已建索引的路径，批量维护索引时只解析一次
+    std::vector<FieldPath> indexedPaths() const;
+    // 修改 paths 中的字段会改变取值的索引路径: 路径本身、其下的子路径和包含它的上层路径
+    std::vector<FieldPath> affectedIndexPaths(const std::vector<std::string>& paths) const;
+    // 修改文档前取出各索引路径上的值，修改后用 reindex 把值有变化的路径移到新值下
+    static std::vector<FieldValue> indexValues(const Document& doc, const std::vector<FieldPath>& paths);
+    void reindex(const DocumentId& docId, const Document& doc, const std::vector<FieldPath>& paths,
+        const std::vector<FieldValue>& oldValues);
+    // 新文档加入各个索引
+    void indexDocument(const DocumentId& docId, const Document& doc, const std::vector<FieldPath>& paths);
+
+    // 文档编号在文档第一次进入索引时分配，从所有索引中删除时回收
+    // 回收的编号攒够一批后先从所有 posting 中清除再复用，残留的 posting 不会指向复用编号的其他文档
+    DocSlot acquireSlot(const DocumentId& docId);
+    void releaseSlot(const DocumentId& docId);
+    // 文档没有编号时返回 false
+    bool findSlot(const DocumentId& docId, DocSlot& slot) const {
+        auto it = slots_.find(docId);
+        if (it == slots_.end()) {
+            return false;
+        }
+        slot = it->second;
+        return true;
+    }
+    DocumentId slotDocument(DocSlot slot) const { return slotDocs_[slot]; }
 
     std::shared_ptr<Document> getDocumentNoLock(const DocumentId& id) const;
-    std::vector<std::pair<DocumentId, FieldValue>> getSortedDocuments(const std::string& path,
+    // 按有序索引的键序排列候选文档，候选集为空时返回索引中的所有文档
+    std::vector<DocumentId> getSortedDocuments(const std::string& path,
         const std::vector<DocumentId>& candidateDocs) const;
+    // 有序索引上满足条件的各个键的 posting，按键序输出；在 std::map 上定位键范围，只访问命中的键
+    void searchIndex(const std::string& path, const Predicate& pred, std::vector<const RoaringBitmap*>& out) const;
+    // 等值查找，优先使用哈希索引；没有文档取该值时返回 nullptr
+    const RoaringBitmap* findIndexed(const std::string& path, const FieldValue& value) const;
+    std::shared_ptr<const IndexStats> getIndexStats(const std::string& path) const;
+    void invalidateStats(const std::string& path);
 private:
     std::unordered_map<DocumentId, std::shared_ptr<Document>> documents_;
     CollectionSchema schema_;
-    // 索引映射：用于存储字段路径 -> 字段值 -> 文档ID
-    std::unordered_map<std::string, std::map<FieldValue, std::unordered_set<DocumentId>>> indexedFields_;
+    // 索引映射：用于存储字段路径 -> 字段值 -> 文档编号位图
+    std::unordered_map<std::string, std::map<FieldValue, RoaringBitmap>> indexedFields_;
+    // 哈希索引：字段路径 -> 字段值 -> 文档编号位图，等值查找不需要沿树比较
+    std::unordered_map<std::string, std::unordered_map<Field, RoaringBitmap, Field::Hash>> hashIndexes_;
+    // DocumentId 常是散列值，直接放进位图几乎不能压缩；编号从 0 连续分配，删除的编号优先复用
+    // 没有索引时不分配编号
+    std::unordered_map<DocumentId, DocSlot> slots_;
+    std::vector<DocumentId> slotDocs_;      // 编号 -> DocumentId
+    // 从所有 posting 中清除 retiredSlots_，之后这些编号可以复用
+    void recycleSlots();
+    std::vector<DocSlot> freeSlots_;        // 已从所有 posting 中清除，可以复用
+    RoaringBitmap retiredSlots_;            // 已回收，还没有从 posting 中清除
+
+    // 索引统计信息，查询时按需重建，读锁下也可能更新，单独加锁
+    mutable std::mutex statsMutex_;
+    mutable std::unordered_map<std::string, std::shared_ptr<const IndexStats>> stats_;
+    size_t modCount_ = 0;   // 索引修改计数，用于判断统计信息是否过期
 };
 
 #endif 
@@ -0,0 +1,528 @@
+#include <cstring>
+#include "columnstore.hpp"
+#include "simdfilter.hpp"
+
+namespace {
+
+// 返回该列类型在 FieldValue 中对应的样例值，用于类型不一致时按 variant 语义求常量结果
+FieldValue sampleOf(FieldType type) {
+    switch (type) {
+        case FieldType::INT: return int(0);
+        case FieldType::DOUBLE: return double(0);
+        case FieldType::BOOL: return false;
+        case FieldType::STRING: return std::string();
+        case FieldType::TIME: return std::time_t(0);
+        case FieldType::BINARY: return std::vector<uint8_t>();
+        case FieldType::DOCUMENT: return std::shared_ptr<Document>();
+        default: return std::monostate{};
+    }
+}
+
+std::string_view bytesView(const std::vector<uint8_t>& bytes) {
+    return std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+} // namespace
+
+void ColumnVector::setBit(std::vector<uint64_t>& bits, size_t idx, bool value) {
+    if (value) {
+        bits[idx >> 6] |= (1ULL << (idx & 63));
+    } else {
+        bits[idx >> 6] &= ~(1ULL << (idx & 63));
+    }
+}
+
+// 去掉 deleted 中标记的位，其余位依次前移，返回保留的位数
+size_t ColumnVector::compactBits(std::vector<uint64_t>& bits, const std::vector<uint64_t>& deleted, size_t size) {
+    size_t out = 0;
+    for (size_t i = 0; i < size; ++i) {
+        if (testBit(deleted, i)) continue;
+        setBit(bits, out++, (bits[i >> 6] >> (i & 63)) & 1);
+    }
+    bits.resize((out + 63) / 64);
+    if (out & 63) {
+        bits.back() &= (1ULL << (out & 63)) - 1;
+    }
+    return out;
+}
+
+void ColumnVector::reserve(size_t rows) {
+    nulls_.reserve((rows + 63) / 64);
+    switch (type_) {
+        case FieldType::INT: ints_.reserve(rows); break;
+        case FieldType::DOUBLE: doubles_.reserve(rows); break;
+        case FieldType::TIME: times_.reserve(rows); break;
+        case FieldType::BOOL: bools_.reserve((rows + 63) / 64); break;
+        case FieldType::STRING:
+        case FieldType::BINARY: refs_.reserve(rows); break;
+        default: values_.reserve(rows); break;
+    }
+}
+
+void ColumnVector::clear() {
+    size_ = 0;
+    garbage_ = 0;
+    std::vector<uint64_t>().swap(nulls_);
+    std::vector<int32_t>().swap(ints_);
+    std::vector<double>().swap(doubles_);
+    std::vector<std::time_t>().swap(times_);
+    std::vector<uint64_t>().swap(bools_);
+    std::vector<StrRef>().swap(refs_);
+    std::vector<char>().swap(heap_);
+    std::vector<FieldValue>().swap(values_);
+}
+
+void ColumnVector::storeBytes(size_t idx, const char* data, size_t len, bool append) {
+    if (!append && len <= refs_[idx].length) {
+        // 新值不超过旧值长度，原地覆盖
+        garbage_ += refs_[idx].length - len;
+        if (len > 0) {
+            std::memcpy(heap_.data() + refs_[idx].offset, data, len);
+        }
+        refs_[idx].length = static_cast<uint32_t>(len);
+        return;
+    }
+    if (!append) {
+        garbage_ += refs_[idx].length;
+    }
+    StrRef ref{heap_.size(), static_cast<uint32_t>(len)};
+    heap_.insert(heap_.end(), data, data + len);
+    if (append) {
+        refs_.push_back(ref);
+    } else {
+        refs_[idx] = ref;
+        compactHeap();
+    }
+}
+
+// 失效字节超过一半时重排字节堆
+void ColumnVector::compactHeap() {
+    if (garbage_ < 4096 || garbage_ * 2 < heap_.size()) {
+        return;
+    }
+    std::vector<char> heap;
+    heap.reserve(heap_.size() - garbage_);
+    for (auto& ref : refs_) {
+        uint64_t offset = heap.size();
+        heap.insert(heap.end(), heap_.begin() + ref.offset, heap_.begin() + ref.offset + ref.length);
+        ref.offset = offset;
+    }
+    heap_.swap(heap);
+    garbage_ = 0;
+}
+
+void ColumnVector::append(const FieldValue& value) {
+    size_t idx = size_;
+    if ((idx & 63) == 0) {
+        nulls_.push_back(0);
+        if (type_ == FieldType::BOOL) bools_.push_back(0);
+    }
+    bool isNull = std::holds_alternative<std::monostate>(value);
+    if (!isNull && getValueType(value) != type_) {
+        throw std::invalid_argument("Invalid type for column storage: " + typetoString(type_));
+    }
+    setBit(nulls_, idx, isNull);
+    switch (type_) {
+        case FieldType::INT: ints_.push_back(isNull ? 0 : std::get<int>(value)); break;
+        case FieldType::DOUBLE: doubles_.push_back(isNull ? 0 : std::get<double>(value)); break;
+        case FieldType::TIME: times_.push_back(isNull ? 0 : std::get<std::time_t>(value)); break;
+        case FieldType::BOOL: setBit(bools_, idx, !isNull && std::get<bool>(value)); break;
+        case FieldType::STRING: {
+            if (isNull) { refs_.push_back({heap_.size(), 0}); break; }
+            const auto& s = std::get<std::string>(value);
+            storeBytes(idx, s.data(), s.size(), true);
+            break;
+        }
+        case FieldType::BINARY: {
+            if (isNull) { refs_.push_back({heap_.size(), 0}); break; }
+            auto s = bytesView(std::get<std::vector<uint8_t>>(value));
+            storeBytes(idx, s.data(), s.size(), true);
+            break;
+        }
+        default: values_.push_back(value); break;
+    }
+    size_++;
+}
+
+FieldValue ColumnVector::get(size_t idx) const {
+    if (isNull(idx)) {
+        return std::monostate{};
+    }
+    switch (type_) {
+        case FieldType::INT: return int(ints_[idx]);
+        case FieldType::DOUBLE: return doubles_[idx];
+        case FieldType::TIME: return times_[idx];
+        case FieldType::BOOL: return bool((bools_[idx >> 6] >> (idx & 63)) & 1);
+        case FieldType::STRING: return std::string(bytesAt(idx));
+        case FieldType::BINARY: {
+            auto s = bytesAt(idx);
+            return std::vector<uint8_t>(s.begin(), s.end());
+        }
+        default: return values_[idx];
+    }
+}
+
+void ColumnVector::set(size_t idx, const FieldValue& value) {
+    bool isNull = std::holds_alternative<std::monostate>(value);
+    if (!isNull && getValueType(value) != type_) {
+        throw std::invalid_argument("Invalid type for column storage: " + typetoString(type_));
+    }
+    setBit(nulls_, idx, isNull);
+    switch (type_) {
+        case FieldType::INT: ints_[idx] = isNull ? 0 : std::get<int>(value); break;
+        case FieldType::DOUBLE: doubles_[idx] = isNull ? 0 : std::get<double>(value); break;
+        case FieldType::TIME: times_[idx] = isNull ? 0 : std::get<std::time_t>(value); break;
+        case FieldType::BOOL: setBit(bools_, idx, !isNull && std::get<bool>(value)); break;
+        case FieldType::STRING: {
+            if (isNull) { storeBytes(idx, nullptr, 0, false); break; }
+            const auto& s = std::get<std::string>(value);
+            storeBytes(idx, s.data(), s.size(), false);
+            break;
+        }
+        case FieldType::BINARY: {
+            if (isNull) { storeBytes(idx, nullptr, 0, false); break; }
+            auto s = bytesView(std::get<std::vector<uint8_t>>(value));
+            storeBytes(idx, s.data(), s.size(), false);
+            break;
+        }
+        default: values_[idx] = value; break;
+    }
+}
+
+void ColumnVector::compact(const std::vector<uint64_t>& deleted) {
+    // 保留的行依次前移
+    auto compactArray = [&](auto& values) {
+        size_t out = 0;
+        for (size_t i = 0; i < size_; ++i) {
+            if (testBit(deleted, i)) continue;
+            if (out != i) values[out] = std::move(values[i]);
+            out++;
+        }
+        values.resize(out);
+    };
+    switch (type_) {
+        case FieldType::INT: compactArray(ints_); break;
+        case FieldType::DOUBLE: compactArray(doubles_); break;
+        case FieldType::TIME: compactArray(times_); break;
+        case FieldType::BOOL: compactBits(bools_, deleted, size_); break;
+        case FieldType::STRING:
+        case FieldType::BINARY:
+            for (size_t i = 0; i < size_; ++i) {
+                if (testBit(deleted, i)) garbage_ += refs_[i].length;
+            }
+            compactArray(refs_);
+            break;
+        default: compactArray(values_); break;
+    }
+    size_ = compactBits(nulls_, deleted, size_);
+    compactHeap();
+}
+
+void ColumnVector::load(const tablefile::ColumnBlock& block, size_t rows) {
+    clear();
+    if (block.type != type_) {
+        throw std::runtime_error("Column type mismatch in table file: " + typetoString(type_));
+    }
+    size_ = rows;
+    size_t words = (rows + 63) / 64;
+    nulls_.assign(block.nulls, block.nulls + words);
+    switch (type_) {
+        case FieldType::INT: {
+            auto data = reinterpret_cast<const int32_t*>(block.values);
+            ints_.assign(data, data + rows);
+            break;
+        }
+        case FieldType::DOUBLE: {
+            auto data = reinterpret_cast<const double*>(block.values);
+            doubles_.assign(data, data + rows);
+            break;
+        }
+        case FieldType::TIME: {
+            auto data = reinterpret_cast<const std::time_t*>(block.values);
+            times_.assign(data, data + rows);
+            break;
+        }
+        case FieldType::BOOL: {
+            auto data = reinterpret_cast<const uint64_t*>(block.values);
+            bools_.assign(data, data + words);
+            break;
+        }
+        default: {
+            const uint64_t* offsets = block.offsets;
+            if (offsets[0] != 0 || offsets[rows] != block.valuesLength) {
+                throw std::runtime_error("Corrupted column offsets in table file.");
+            }
+            bool bytes = type_ == FieldType::STRING || type_ == FieldType::BINARY;
+            if (bytes) {
+                heap_.assign(block.values, block.values + block.valuesLength);
+                refs_.reserve(rows);
+            } else {
+                values_.reserve(rows);
+            }
+            for (size_t i = 0; i < rows; ++i) {
+                if (offsets[i + 1] < offsets[i] || offsets[i + 1] - offsets[i] > UINT32_MAX) {
+                    throw std::runtime_error("Corrupted column offsets in table file.");
+                }
+                size_t len = offsets[i + 1] - offsets[i];
+                if (bytes) {
+                    refs_.push_back({offsets[i], static_cast<uint32_t>(len)});
+                } else if (isNull(i)) {
+                    values_.emplace_back();
+                } else {
+                    Field field;
+                    field.fromBinary(block.values + offsets[i], len);
+                    values_.push_back(field.getValue());
+                }
+            }
+            break;
+        }
+    }
+}
+
+template <typename T, typename Rows, typename Get>
+void ColumnVector::filterTyped(const T& query, CmpOp op, bool nullResult,
+    const Rows& rows, std::vector<size_t>& out, Get get) const {
+    auto run = [&](auto cmp) {
+        for (size_t idx : rows) {
+            if (isNull(idx) ? nullResult : cmp(get(idx), query)) {
+                out.push_back(idx);
+            }
+        }
+    };
+    switch (op) {
+        case CmpOp::EQ: run([](const auto& a, const auto& b) { return cmpValues<CmpOp::EQ>(a, b); }); break;
+        case CmpOp::NE: run([](const auto& a, const auto& b) { return cmpValues<CmpOp::NE>(a, b); }); break;
+        case CmpOp::LT: run([](const auto& a, const auto& b) { return cmpValues<CmpOp::LT>(a, b); }); break;
+        case CmpOp::GT: run([](const auto& a, const auto& b) { return cmpValues<CmpOp::GT>(a, b); }); break;
+        case CmpOp::LE: run([](const auto& a, const auto& b) { return cmpValues<CmpOp::LE>(a, b); }); break;
+        case CmpOp::GE: run([](const auto& a, const auto& b) { return cmpValues<CmpOp::GE>(a, b); }); break;
+        case CmpOp::LIKE: break;
+    }
+}
+
+template <typename Rows>
+void ColumnVector::filter(const Predicate& pred, const Rows& rows, std::vector<size_t>& out) const {
+    const FieldValue& queryValue = pred.value();
+    CmpOp cmpOp = pred.op();
+    if (cmpOp == CmpOp::LIKE) {
+        // LIKE 只匹配字符串列和字符串查询值
+        if (type_ != FieldType::STRING || !std::holds_alternative<std::string>(queryValue)) {
+            return;
+        }
+        std::string_view pattern(std::get<std::string>(queryValue));
+        for (size_t idx : rows) {
+            if (!isNull(idx) && likeMatch(bytesAt(idx), pattern)) {
+                out.push_back(idx);
+            }
+        }
+        return;
+    }
+    bool nullResult = pred(std::monostate{});
+
+    // 查询值类型与列类型不同，按 variant 语义所有非空行结果相同
+    if (getValueType(queryValue) != type_ || type_ == FieldType::DOCUMENT || type_ == FieldType::NONE) {
+        if (type_ == FieldType::DOCUMENT || type_ == FieldType::NONE) {
+            filterTyped(true, CmpOp::EQ, nullResult, rows, out,
+                [this, &pred](size_t idx) { return pred(values_[idx]); });
+            return;
+        }
+        bool constResult = pred(sampleOf(type_));
+        filterTyped(true, CmpOp::EQ, nullResult, rows, out, [constResult](size_t) { return constResult; });
+        return;
+    }
+
+    switch (type_) {
+        case FieldType::INT:
+            filterTyped(std::get<int>(queryValue), cmpOp, nullResult, rows, out,
+                [this](size_t idx) { return int(ints_[idx]); });
+            break;
+        case FieldType::DOUBLE:
+            filterTyped(std::get<double>(queryValue), cmpOp, nullResult, rows, out,
+                [this](size_t idx) { return doubles_[idx]; });
+            break;
+        case FieldType::TIME:
+            filterTyped(std::get<std::time_t>(queryValue), cmpOp, nullResult, rows, out,
+                [this](size_t idx) { return times_[idx]; });
+            break;
+        case FieldType::BOOL:
+            filterTyped(std::get<bool>(queryValue), cmpOp, nullResult, rows, out,
+                [this](size_t idx) { return bool((bools_[idx >> 6] >> (idx & 63)) & 1); });
+            break;
+        case FieldType::STRING:
+            filterTyped(std::string_view(std::get<std::string>(queryValue)), cmpOp, nullResult, rows, out,
+                [this](size_t idx) { return bytesAt(idx); });
+            break;
+        case FieldType::BINARY:
+            filterTyped(bytesView(std::get<std::vector<uint8_t>>(queryValue)), cmpOp, nullResult, rows, out,
+                [this](size_t idx) { return bytesAt(idx); });
+            break;
+        default:
+            break;
+    }
+}
+
+bool ColumnVector::vectorized(const Predicate& pred) const {
+    if (pred.op() == CmpOp::LIKE || getValueType(pred.value()) != type_) {
+        return false;
+    }
+    return type_ == FieldType::INT || type_ == FieldType::DOUBLE || type_ == FieldType::TIME;
+}
+
+void ColumnVector::filterBitmap(const Predicate& pred, size_t begin, size_t end, uint64_t* bits) const {
+    const FieldValue& queryValue = pred.value();
+    size_t n = end - begin;
+    uint64_t* words = bits + begin / 64;
+    switch (type_) {
+        case FieldType::INT:
+            simd::filterInt32(ints_.data() + begin, n, pred.op(), std::get<int>(queryValue), words);
+            break;
+        case FieldType::DOUBLE:
+            simd::filterDouble(doubles_.data() + begin, n, pred.op(), std::get<double>(queryValue), words);
+            break;
+        case FieldType::TIME:
+            static_assert(sizeof(std::time_t) == sizeof(int64_t), "time_t must be 64-bit");
+            simd::filterInt64(reinterpret_cast<const int64_t*>(times_.data()) + begin, n, pred.op(),
+                std::get<std::time_t>(queryValue), words);
+            break;
+        default:
+            throw std::invalid_argument("Column type is not vectorized: " + typetoString(type_));
+    }
+    // 空值行在数组中存的是 0，按空值的比较结果修正
+    uint64_t nullFill = pred(std::monostate{}) ? ~0ULL : 0;
+    for (size_t w = begin / 64; w < (end + 63) / 64; ++w) {
+        bits[w] = (bits[w] & ~nulls_[w]) | (nulls_[w] & nullFill);
+    }
+}
+
+void ColumnStore::filter(size_t colIdx, const Predicate& pred,
+    const std::vector<size_t>* candidates, std::vector<size_t>& out) const {
+    if (candidates) {
+        column(colIdx).filter(pred, *candidates, out);
+    } else {
+        column(colIdx).filter(pred, RowRange{0, rows_}, out);
+    }
+}
+
+void ColumnStore::filterRange(size_t colIdx, const Predicate& pred,
+    size_t begin, size_t end, std::vector<size_t>& out) const {
+    column(colIdx).filter(pred, RowRange{begin, end}, out);
+}
+
+ColumnStore::ColumnStore(const std::vector<FieldType>& types) {
+    columns_.reserve(types.size());
+    for (auto type : types) {
+        columns_.push_back(std::make_shared<ColumnVector>(type));
+    }
+}
+
+ColumnStore::Pending::Pending(std::shared_ptr<const tablefile::MappedFile> file, std::vector<tablefile::ColumnBlock> blocks)
+    : file(std::move(file)), blocks(std::move(blocks)), loaded(std::make_unique<std::atomic<bool>[]>(this->blocks.size())) {}
+
+ColumnStore::ColumnStore(const std::vector<FieldType>& types, std::shared_ptr<const tablefile::MappedFile> file,
+    const tablefile::Layout& layout) : ColumnStore(types) {
+    if (layout.columns.size() != types.size()) {
+        throw std::runtime_error("Column count mismatch in table file.");
+    }
+    for (size_t i = 0; i < types.size(); ++i) {
+        if (layout.columns[i].type != types[i]) {
+            throw std::runtime_error("Column type mismatch in table file: " + typetoString(types[i]));
+        }
+    }
+    rows_ = layout.rows;
+    pending_ = std::make_unique<Pending>(std::move(file), layout.columns);
+}
+
+ColumnStore::ColumnStore(const ColumnStore& other) : TableStore(other), rows_(other.rows_) {
+    if (!other.pending_) {
+        columns_ = other.columns_;
+        return;
+    }
+    // 已解码的列共享，其余列共用映射的文件
+    std::lock_guard<std::mutex> lock(other.pending_->mutex);
+    columns_ = other.columns_;
+    pending_ = std::make_unique<Pending>(other.pending_->file, other.pending_->blocks);
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        pending_->loaded[i].store(other.pending_->loaded[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+ColumnVector& ColumnStore::mutableColumn(size_t colIdx) {
+    column(colIdx);
+    auto& column = columns_[colIdx];
+    if (column.use_count() > 1) {
+        column = std::make_shared<ColumnVector>(*column);
+    }
+    return *column;
+}
+
+void ColumnStore::load(size_t colIdx) const {
+    std::lock_guard<std::mutex> lock(pending_->mutex);
+    if (!pending_->loaded[colIdx].load(std::memory_order_relaxed)) {
+        // 未解码的空列可能被克隆共享，解码到新的列中
+        auto column = std::make_shared<ColumnVector>(columns_[colIdx]->type());
+        column->load(pending_->blocks[colIdx], rows_);
+        columns_[colIdx] = std::move(column);
+        pending_->loaded[colIdx].store(true, std::memory_order_release);
+    }
+}
+
+void ColumnStore::loadAll() {
+    if (!pending_) {
+        return;
+    }
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        column(i);
+    }
+    pending_.reset();
+}
+
+void ColumnStore::reserve(size_t rows) {
+    loadAll();
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        mutableColumn(i).reserve(rows);
+    }
+}
+
+void ColumnStore::clear() {
+    pending_.reset();
+    for (auto& column : columns_) {
+        column = std::make_shared<ColumnVector>(column->type());
+    }
+    rows_ = 0;
+}
+
+void ColumnStore::append(Row&& row) {
+    if (row.size() != columns_.size()) {
+        throw std::invalid_argument("Row size does not match column count.");
+    }
+    loadAll();
+    // 先整体校验，避免部分列已写入
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        if (!row[i].is_null() && !row[i].typeMatches(columns_[i]->type())) {
+            throw std::invalid_argument("Invalid type for column storage: " + typetoString(columns_[i]->type()));
+        }
+    }
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        mutableColumn(i).append(row[i].getValue());
+    }
+    rows_++;
+}
+
+Row ColumnStore::getRow(size_t rowIdx) const {
+    Row row;
+    row.reserve(columns_.size());
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        row.emplace_back(column(i).get(rowIdx));
+    }
+    return row;
+}
+
+void ColumnStore::compact(const std::vector<uint64_t>& deleted) {
+    loadAll();
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        mutableColumn(i).compact(deleted);
+    }
+    for (size_t i = 0, n = rows_; i < n; ++i) {
+        rows_ -= testBit(deleted, i);
+    }
+}
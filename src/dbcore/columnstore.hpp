@@ -0,0 +1,139 @@
+#ifndef COLUMNSTORE_HPP
+#define COLUMNSTORE_HPP
+
+#include <string_view>
+#include <atomic>
+#include <mutex>
+#include "tablestore.hpp"
+#include "tablefile.hpp"
+
+// 单列的类型化连续存储
+// INT/DOUBLE/TIME 使用定长数组，BOOL 使用位图，STRING/BINARY 使用偏移 + 字节堆，
+// 空值单独记录在空值位图中。DOCUMENT 等无法定长存储的类型回退为 FieldValue 数组。
+class ColumnVector {
+public:
+    explicit ColumnVector(FieldType type) : type_(type) {}
+
+    FieldType type() const { return type_; }
+    size_t size() const { return size_; }
+    void reserve(size_t rows);
+    void clear();
+
+    void append(const FieldValue& value);
+    FieldValue get(size_t idx) const;
+    void set(size_t idx, const FieldValue& value);
+    void compact(const std::vector<uint64_t>& deleted);
+    // 从映射文件中的列块解码
+    void load(const tablefile::ColumnBlock& block, size_t rows);
+
+    bool isNull(size_t idx) const {
+        return (nulls_[idx >> 6] >> (idx & 63)) & 1;
+    }
+
+    // 与 compare() 语义一致的列过滤，数值类型不构造 FieldValue
+    // rows 为候选行列表或者 RowRange
+    template <typename Rows>
+    void filter(const Predicate& pred, const Rows& rows, std::vector<size_t>& out) const;
+    // INT/DOUBLE/TIME 列且查询值类型相同时可以用向量化内核生成选择位图
+    bool vectorized(const Predicate& pred) const;
+    void filterBitmap(const Predicate& pred, size_t begin, size_t end, uint64_t* bits) const;
+
+private:
+    struct StrRef {
+        uint64_t offset;
+        uint32_t length;
+    };
+
+    static void setBit(std::vector<uint64_t>& bits, size_t idx, bool value);
+    static size_t compactBits(std::vector<uint64_t>& bits, const std::vector<uint64_t>& deleted, size_t size);
+
+    std::string_view bytesAt(size_t idx) const {
+        return std::string_view(heap_.data() + refs_[idx].offset, refs_[idx].length);
+    }
+    void storeBytes(size_t idx, const char* data, size_t len, bool append);
+    void compactHeap();
+
+    template <typename T, typename Rows, typename Get>
+    void filterTyped(const T& query, CmpOp op, bool nullResult,
+        const Rows& rows, std::vector<size_t>& out, Get get) const;
+
+    FieldType type_;
+    size_t size_ = 0;
+    std::vector<uint64_t> nulls_;       // 空值位图
+    std::vector<int32_t> ints_;         // INT
+    std::vector<double> doubles_;       // DOUBLE
+    std::vector<std::time_t> times_;    // TIME
+    std::vector<uint64_t> bools_;       // BOOL 位图
+    std::vector<StrRef> refs_;          // STRING/BINARY 偏移
+    std::vector<char> heap_;            // STRING/BINARY 字节堆
+    size_t garbage_ = 0;                // 字节堆中已失效的字节数
+    std::vector<FieldValue> values_;    // 其他类型
+};
+
+// 列存实现
+class ColumnStore : public TableStore {
+public:
+    explicit ColumnStore(const std::vector<FieldType>& types);
+    // 使用映射的数据文件，各列在第一次访问时才解码
+    ColumnStore(const std::vector<FieldType>& types, std::shared_ptr<const tablefile::MappedFile> file,
+        const tablefile::Layout& layout);
+    ColumnStore(const ColumnStore& other);
+
+    StorageMode mode() const override { return StorageMode::COLUMN; }
+    size_t size() const override { return rows_; }
+    void reserve(size_t rows) override;
+    void clear() override;
+
+    void append(Row&& row) override;
+    Row getRow(size_t rowIdx) const override;
+    FieldValue getValue(size_t rowIdx, size_t colIdx) const override {
+        return column(colIdx).get(rowIdx);
+    }
+    void setValue(size_t rowIdx, size_t colIdx, const FieldValue& value) override {
+        mutableColumn(colIdx).set(rowIdx, value);
+    }
+    void compact(const std::vector<uint64_t>& deleted) override;
+    // 只复制列指针
+    ptr clone() const override { return std::make_unique<ColumnStore>(*this); }
+
+    void filter(size_t colIdx, const Predicate& pred,
+        const std::vector<size_t>* candidates, std::vector<size_t>& out) const override;
+    void filterRange(size_t colIdx, const Predicate& pred,
+        size_t begin, size_t end, std::vector<size_t>& out) const override;
+    bool vectorized(size_t colIdx, const Predicate& pred) const override {
+        return column(colIdx).vectorized(pred);
+    }
+    void filterBitmap(size_t colIdx, const Predicate& pred, size_t begin, size_t end, uint64_t* bits) const override {
+        column(colIdx).filterBitmap(pred, begin, end, bits);
+    }
+
+private:
+    // 尚未解码的列，读锁下可能有多个线程同时访问，解码时加锁
+    struct Pending {
+        Pending(std::shared_ptr<const tablefile::MappedFile> file, std::vector<tablefile::ColumnBlock> blocks);
+        std::shared_ptr<const tablefile::MappedFile> file;
+        std::vector<tablefile::ColumnBlock> blocks;
+        std::unique_ptr<std::atomic<bool>[]> loaded;
+        std::mutex mutex;
+    };
+
+    const ColumnVector& column(size_t colIdx) const {
+        if (pending_ && !pending_->loaded[colIdx].load(std::memory_order_acquire)) {
+            load(colIdx);
+        }
+        return *columns_[colIdx];
+    }
+    // 列同时被快照持有时先复制一份
+    // 只在写锁下调用，此时不会有新的快照共享该列
+    ColumnVector& mutableColumn(size_t colIdx);
+    void load(size_t colIdx) const;
+    // 修改前解码所有列并释放映射
+    void loadAll();
+
+    // 各列由快照共享，修改前复制被共享的列；延迟解码时替换指针而不是原地写入
+    mutable std::vector<std::shared_ptr<ColumnVector>> columns_;
+    size_t rows_ = 0;
+    std::unique_ptr<Pending> pending_;
+};
+
+#endif
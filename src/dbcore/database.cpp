@@ -1,7 +1,53 @@
 #include <iostream>
 #include <filesystem>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 #include "database.hpp"
 
+namespace {
+
+const size_t persist_threads_ = get_env_var("DB_PERSIST_THREADS",
+    size_t(std::max(1u, std::thread::hardware_concurrency())));
+
+long long elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 按数据文件大小降序排列，大容器先开始，减少最后只剩一个线程在工作的时间
+std::vector<std::pair<std::string, DataContainer::ptr>> largestFirst(
+    const std::unordered_map<std::string, DataContainer::ptr>& containers, const std::filesystem::path& dataPath) {
+    std::vector<std::pair<uintmax_t, std::pair<std::string, DataContainer::ptr>>> sized;
+    for (const auto& container : containers) {
+        std::error_code ec;
+        uintmax_t size = std::filesystem::file_size(dataPath / container.first, ec);
+        sized.push_back({ec ? 0 : size, container});
+    }
+    std::stable_sort(sized.begin(), sized.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::vector<std::pair<std::string, DataContainer::ptr>> jobs;
+    for (auto& job : sized) {
+        jobs.push_back(std::move(job.second));
+    }
+    return jobs;
+}
+
+} // namespace
+
+size_t Database::persistThreads() {
+    return persist_threads_;
+}
+
+void Database::report(LogLevel level, const std::string& message) const {
+    if (logSink_) {
+        logSink_(level, message);
+    } else if (level == LogLevel::ERROR) {
+        std::cerr << get_timestamp() << " " << message << '\n';
+    } else {
+        std::cout << get_timestamp() << " " << message << '\n';
+    }
+}
+
 DataContainer::ptr Database::addContainer(const std::string& name, const std::string& type) {
     std::lock_guard<std::mutex> lock(mutex_);
     auto it = containers_.find(name);
@@ -63,6 +109,7 @@ void Database::addContainerFromSchema(const std::string& filePath) {
 
 // Get all container instances in the Database
 std::vector<DataContainer::ptr> Database::listContainers() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     std::vector<DataContainer::ptr> tableInstances;
     for (const auto& container : containers_) {
         tableInstances.push_back(container.second);
@@ -70,51 +117,49 @@ std::vector<DataContainer::ptr> Database::listContainers() const {
     return tableInstances;
 }
 
+void Database::compact() {
+    for (const auto& container : listContainers()) {
+        if (auto table = std::dynamic_pointer_cast<Table>(container)) {
+            table->compact();
+        }
+    }
+}
 
-void Database::save(const std::string& filePath) {
+bool Database::save(const std::string& filePath) {
     if (containers_.empty()) {
-        std::cerr << "Warning: No container to save.\n";
-        return;
+        report(LogLevel::INFO, "No container to save.");
+        return true;
     }
-
+    std::filesystem::path configPath = std::filesystem::path(filePath) / "config";
+    std::filesystem::path dataPath = std::filesystem::path(filePath) / "data";
     try {
-        // 保存配置文件
-        std::string subDir = "config";
-        std::filesystem::path configPath = std::filesystem::path(filePath) / subDir;
         std::filesystem::create_directories(configPath);
-        for (const auto& container : containers_) {
-            std::filesystem::path tableConfigPath = configPath / container.first;
-            try {
-                container.second->saveSchema(tableConfigPath.string());
-                //std::cout << get_timestamp() << " Saved config for container: " << container.first << '\n';
-            } catch (const std::exception& e) {
-                std::cerr << get_timestamp() << " Failed to save config for container: " << container.first 
-                          << ": " << e.what() << '\n';
-            }
-        }
+        std::filesystem::create_directories(dataPath);
     } catch (const std::filesystem::filesystem_error& e) {
-        std::cerr << "Error creating config directory: " << e.what() << '\n';
+        report(LogLevel::ERROR, std::string("Error creating data directory: ") + e.what());
+        return false;
     }
 
-    try {
-        // 保存数据文件
-        std::string subDir = "data";
-        std::filesystem::path dataPath = std::filesystem::path(filePath) / subDir;
-        std::filesystem::create_directories(dataPath);
-        for (const auto& container : containers_) {
-            std::filesystem::path tableDataPath = dataPath / container.first;
-            try {
-                std::cout << get_timestamp() << " Start saving container data: " << container.first << '\n';
-                container.second->exportToBinaryFile(tableDataPath.string());
-                std::cout << get_timestamp() << " Successfully saved container data: " << container.first << '\n';
-            } catch (const std::exception& e) {
-                std::cerr << get_timestamp() << " Failed to save data for container " << container.first 
-                          << ": " << e.what() << '\n';
-            }
+    auto start = std::chrono::steady_clock::now();
+    auto jobs = largestFirst(containers_, dataPath);
+    std::atomic<bool> ok{true};
+    std::atomic<size_t> done{0};
+    parallelFor(jobs.size(), persist_threads_, [&](size_t i) {
+        const auto& [name, container] = jobs[i];
+        auto containerStart = std::chrono::steady_clock::now();
+        try {
+            container->saveSchema((configPath / name).string());
+            container->exportToBinaryFile((dataPath / name).string());
+            report(LogLevel::INFO, "Saved container " + name + " [" + std::to_string(++done) + "/"
+                + std::to_string(jobs.size()) + "] in " + std::to_string(elapsedMs(containerStart)) + " ms");
+        } catch (const std::exception& e) {
+            report(LogLevel::ERROR, "Failed to save container " + name + ": " + e.what());
+            ok = false;
         }
-    } catch (const std::filesystem::filesystem_error& e) {
-        std::cerr << "Error creating data directory: " << e.what() << '\n';
-    }
+    });
+    report(LogLevel::INFO, "Saved " + std::to_string(jobs.size()) + " containers in "
+        + std::to_string(elapsedMs(start)) + " ms with " + std::to_string(std::min(persist_threads_, jobs.size())) + " threads");
+    return ok;
 }
 
 void Database::upload(const std::string& filePath) {
@@ -123,7 +168,7 @@ void Database::upload(const std::string& filePath) {
         std::string subDir = "config";
         std::filesystem::path fullPath = std::filesystem::path(filePath) / subDir;
         if (!std::filesystem::exists(fullPath)) {
-            std::cerr << "Warning: Config directory " << fullPath << " does not exist.\n";
+            report(LogLevel::ERROR, "Warning: Config directory " + fullPath.string() + " does not exist.");
         } else if (!std::filesystem::is_empty(fullPath)) {
             for (const auto& entry : std::filesystem::directory_iterator(fullPath)) {
                 if (entry.is_regular_file()) {
@@ -132,32 +177,38 @@ void Database::upload(const std::string& filePath) {
             }
         }
 
-        // 处理 data 目录
+        // 处理 data 目录，各容器的读取和解码并行进行
         subDir = "data";
         fullPath = std::filesystem::path(filePath) / subDir;
         if (!std::filesystem::exists(fullPath)) {
-            std::cerr << "Warning: Data directory " << fullPath << " does not exist.\n";
+            report(LogLevel::ERROR, "Warning: Data directory " + fullPath.string() + " does not exist.");
         } else if (!containers_.empty()) {
-            for (const auto& container : containers_) {
-                std::filesystem::path dataPath = std::filesystem::path(fullPath) / container.first;
+            auto start = std::chrono::steady_clock::now();
+            auto jobs = largestFirst(containers_, fullPath);
+            std::atomic<size_t> done{0};
+            parallelFor(jobs.size(), persist_threads_, [&](size_t i) {
+                const auto& [name, container] = jobs[i];
+                std::filesystem::path dataPath = fullPath / name;
+                auto containerStart = std::chrono::steady_clock::now();
                 try {
-                    std::cout << get_timestamp() << " Loading container: " << container.first << '\n';
-                    container.second->importFromBinaryFile(dataPath.string());
-                    std::cout << get_timestamp() << " container loaded successfully.\n";
+                    container->importFromBinaryFile(dataPath.string());
+                    report(LogLevel::INFO, "Loaded container " + name + " [" + std::to_string(++done) + "/"
+                        + std::to_string(jobs.size()) + "] in " + std::to_string(elapsedMs(containerStart)) + " ms");
                 } catch (const std::exception& e) {
-                    std::cerr << get_timestamp() << " Failed to load container " << container.first 
-                              << " from " << dataPath << ": " << e.what() << '\n';
+                    report(LogLevel::ERROR, "Failed to load container " + name + " from " + dataPath.string() + ": " + e.what());
                 }
-            }
+            });
+            report(LogLevel::INFO, "Loaded " + std::to_string(jobs.size()) + " containers in "
+                + std::to_string(elapsedMs(start)) + " ms with " + std::to_string(std::min(persist_threads_, jobs.size())) + " threads");
         } else {
-            std::cerr << "Warning: No containers available for data import.\n";
+            report(LogLevel::ERROR, "Warning: No containers available for data import.");
         }
     } catch (const std::filesystem::filesystem_error& e) {
-        std::cerr << "Filesystem error: " << e.what() << '\n';
+        report(LogLevel::ERROR, std::string("Filesystem error: ") + e.what());
     } catch (const std::exception& e) {
-        std::cerr << "Standard exception: " << e.what() << '\n';
+        report(LogLevel::ERROR, std::string("Standard exception: ") + e.what());
     } catch (...) {
-        std::cerr << "Unknown error occurred while uploading files.\n";
+        report(LogLevel::ERROR, "Unknown error occurred while uploading files.");
     }
 }
 
@@ -6,9 +6,15 @@
 #include "collection.hpp"
 #include "util/version.hpp"
 class Database {
+public:
+    // 加载和保存的进度日志。dbcore 不依赖日志模块，由服务端设置为 logger，未设置时输出到标准输出和标准错误
+    enum class LogLevel { INFO, ERROR };
+    using LogSink = std::function<void(LogLevel level, const std::string& message)>;
+
 private:
     std::unordered_map<std::string, DataContainer::ptr> containers_;
     mutable std::mutex mutex_;
+    LogSink logSink_;
 
 private:
     Database() {
@@ -57,9 +63,22 @@ public:
 
     std::vector<DataContainer::ptr> listContainers() const;
 
-    void save(const std::string& filePath);
+    // 压缩已删除行较多的表，由后台定时器调用
+    void compact();
+
+    // 在 DB_PERSIST_THREADS 个线程中并行保存/加载各个容器，大文件先处理
+    // 所有容器都保存成功时返回 true
+    bool save(const std::string& filePath);
     void upload(const std::string& filePath);
+    // 保存和加载容器使用的线程数
+    static size_t persistThreads();
+    void setLogSink(LogSink sink) {
+        logSink_ = std::move(sink);
+    }
     void remove(const std::string& filePath, const std::string& name);
+
+private:
+    void report(LogLevel level, const std::string& message) const;
 };
 
 
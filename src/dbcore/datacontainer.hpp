@@ -2,6 +2,7 @@
 #define DATACONTAINER_HPP
 
 #include <memory>
+#include <functional>
 #include <mutex>
 #include <unordered_map>
 #include <shared_mutex>
@@ -26,6 +27,9 @@ public:
     //virtual size_t getRowCount() const = 0;
 	virtual void saveSchema(const std::string& filePath)= 0;
 	virtual void exportToBinaryFile(const std::string& filePath) = 0;
+    // 一致性快照: 只在锁内复制数据，返回的函数在锁外把快照写成与 exportToBinaryFile 相同格式的文件
+    using Writer = std::function<void(const std::string& filePath)>;
+    virtual Writer snapshot() const = 0;
     virtual void importFromBinaryFile(const std::string& filePath) = 0;
 protected:
 	explicit DataContainer(const std::string& name, const std::string& type) : name_(name),type_(type) {}
@@ -1,4 +1,64 @@
+#include <algorithm>
+#include <mutex>
 #include "document.hpp"
+#include "util/util.hpp"
+
+FieldNames::FieldNames()
+	: limit_(std::min(get_env_var("DB_MAX_FIELD_NAMES", size_t(1) << 20), kChunkSize * kMaxChunks)) {}
+
+FieldNames& FieldNames::getInstance() {
+	static FieldNames instance;
+	return instance;
+}
+
+FieldId FieldNames::find(std::string_view name) const {
+	std::shared_lock<std::shared_mutex> lock(mutex_);
+	auto it = ids_.find(name);
+	return it == ids_.end() ? kNone : it->second;
+}
+
+FieldId FieldNames::intern(std::string_view name) {
+	FieldId id = find(name);
+	if (id != kNone) {
+		return id;
+	}
+	std::unique_lock<std::shared_mutex> lock(mutex_);
+	auto it = ids_.find(name);
+	if (it != ids_.end()) {
+		return it->second;
+	}
+	if (count_ >= limit_) {
+		// 通常是把用户数据 (例如 ID) 当作字段名，这类键应当作为值保存
+		throw std::runtime_error("Too many distinct field names (DB_MAX_FIELD_NAMES=" + std::to_string(limit_)
+			+ "), cannot add field: " + std::string(name.substr(0, 64)));
+	}
+	if (count_ == limit_ / 10 * 9) {
+		std::cerr << "Field name dictionary is 90% full: " << count_ << " of " << limit_ << " names" << std::endl;
+	}
+	auto& chunk = chunks_[count_ >> kChunkBits];
+	if (!chunk) {
+		chunk.reset(new std::string[kChunkSize]);
+	}
+	std::string& slot = chunk[count_ & (kChunkSize - 1)];
+	slot.assign(name);
+	ids_.emplace(std::string_view(slot), count_);
+	return count_++;
+}
+
+FieldPath::FieldPath(const std::string& path) : path_(path) {
+	auto& names = FieldNames::getInstance();
+	size_t begin = 0;
+	while (true) {
+		size_t pos = path_.find('.', begin);
+		size_t end = pos == std::string::npos ? path_.size() : pos;
+		spans_.emplace_back(begin, end - begin);
+		ids_.push_back(names.find(segment(spans_.size() - 1)));
+		if (pos == std::string::npos) {
+			break;
+		}
+		begin = pos + 1;
+	}
+}
 
 std::ostream& operator<<(std::ostream& os, const Document& doc) {
 	for (const auto& [name, field] : doc.getFields()) {
@@ -9,174 +69,298 @@ std::ostream& operator<<(std::ostream& os, const Document& doc) {
 
 json Document::toJson() const {
 	json jsonFields;
-	for (const auto& [key,field] : fields_) {
-		//std::cout << "key: " << key << " v: " << *field << std::endl;
-		jsonFields[key] = field.toJson();
+	auto& names = FieldNames::getInstance();
+	for (const auto& [id, field] : fields_.entries_) {
+		jsonFields[names.name(id)] = field.toJson();
 	}
 	return jsonFields;
 }
 
 std::string Document::toBinary() const {
-	std::ostringstream outStream(std::ios::binary);
-	for (const auto& [name, field] : fields_) {
+	std::string out;
+	auto& names = FieldNames::getInstance();
+	// 按名字顺序写出，与字段按名字排序保存时的格式相同；编号顺序通常已经是名字顺序，不必排序
+	std::vector<const DocumentFields::Entry*> ordered;
+	ordered.reserve(fields_.entries_.size());
+	for (const auto& entry : fields_.entries_) {
+		ordered.push_back(&entry);
+	}
+	auto byName = [&names](const DocumentFields::Entry* a, const DocumentFields::Entry* b) {
+		return names.name(a->first) < names.name(b->first);
+	};
+	if (!std::is_sorted(ordered.begin(), ordered.end(), byName)) {
+		std::sort(ordered.begin(), ordered.end(), byName);
+	}
+	for (const auto* entry : ordered) {
+		const auto& [id, field] = *entry;
+		const std::string& name = names.name(id);
 		size_t nameLength = name.size();
-		outStream.write(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
-		outStream.write(name.data(), nameLength); // 写入字段名称
+		out.append(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
+		out.append(name); // 写入字段名称
 
 		std::string fieldBinaryData = field.toBinary();
 		size_t fieldSize = fieldBinaryData.size();
-		outStream.write(reinterpret_cast<const char*>(&fieldSize), sizeof(fieldSize));
-		outStream.write(fieldBinaryData.data(), fieldSize);
+		out.append(reinterpret_cast<const char*>(&fieldSize), sizeof(fieldSize));
+		out.append(fieldBinaryData);
 	}
-	return outStream.str();
+	return out;
 }
 
 void Document::fromBinary(const char* data, size_t size) {
-    std::istringstream inStream(std::string(data, size), std::ios::binary);
-
-    // 缓冲区用于存储字段名称和数据
-    size_t nameLength, fieldSize;
-    std::string name, fieldData;
+	auto& names = FieldNames::getInstance();
+	auto& entries = fields_.entries_;
+	size_t offset = 0;
+	auto readSize = [&]() {
+		size_t value;
+		if (size - offset < sizeof(value)) {
+			throw std::runtime_error("Truncated document data");
+		}
+		std::memcpy(&value, data + offset, sizeof(value));
+		offset += sizeof(value);
+		if (size - offset < value) {
+			throw std::runtime_error("Truncated document data");
+		}
+		return value;
+	};
+	while (offset < size) {
+		size_t nameLength = readSize();
+		FieldId id = names.intern(std::string_view(data + offset, nameLength));
+		offset += nameLength;
 
-    while (inStream.peek() != EOF) {
-        // 读取字段名称的长度并直接在缓冲区中分配空间
-        inStream.read(reinterpret_cast<char*>(&nameLength), sizeof(nameLength));
-        name.resize(nameLength);
-        inStream.read(&name[0], nameLength); // 读取字段名称
+		// 通过二进制数据恢复字段内容
+		size_t fieldSize = readSize();
+		Field field;
+		field.fromBinary(data + offset, fieldSize);
+		offset += fieldSize;
+		entries.emplace_back(id, std::move(field));
+	}
+	// 按编号排序，同名字段保留后出现的
+	std::stable_sort(entries.begin(), entries.end(),
+		[](const auto& a, const auto& b) { return a.first < b.first; });
+	auto last = entries.end();
+	for (auto it = entries.begin(); it != last;) {
+		auto next = it + 1;
+		if (next != last && next->first == it->first) {
+			it = entries.erase(it);
+			last = entries.end();
+		} else {
+			it = next;
+		}
+	}
+	entries.shrink_to_fit();
+}
 
-        // 读取字段数据的长度并在缓冲区中分配空间
-        inStream.read(reinterpret_cast<char*>(&fieldSize), sizeof(fieldSize));
-        fieldData.resize(fieldSize);
-        inStream.read(&fieldData[0], fieldSize); // 读取字段数据
+void Document::fromJson(const json& j) {
+	auto& names = FieldNames::getInstance();
+	auto& entries = fields_.entries_;
+	entries.reserve(entries.size() + j.size());
+	for (const auto& [key, val] : j.items()) {
+		entries.emplace_back(names.intern(key), Field{});
+		try {
+			entries.back().second.fromJson(val);
+		} catch (const std::exception& e) {
+			std::cerr << "Error processing key: " << key << " with value: " << val
+					  << ". Error: " << e.what() << std::endl;
+			throw;
+		}
+	}
+	std::sort(entries.begin(), entries.end(),
+		[](const auto& a, const auto& b) { return a.first < b.first; });
+	auto dup = std::adjacent_find(entries.begin(), entries.end(),
+		[](const auto& a, const auto& b) { return a.first == b.first; });
+	if (dup != entries.end()) {
+		const std::string& key = names.name(dup->first);
+		std::cerr << "Error processing key: " << key << ". Error: Duplicate field key." << std::endl;
+		throw std::invalid_argument("Duplicate field key: " + key);
+	}
+}
 
-        // 通过二进制数据恢复字段内容
-        Field field;
-        field.fromBinary(fieldData.c_str(), fieldSize);
+std::vector<DocumentFields::Entry>::iterator Document::lowerBound(FieldId id) {
+	auto& entries = fields_.entries_;
+	return std::lower_bound(entries.begin(), entries.end(), id,
+		[](const DocumentFields::Entry& entry, FieldId key) { return entry.first < key; });
+}
 
-        // 将字段添加到文档的 fields_ 中
-        fields_[name] = std::move(field); // 使用 move 避免不必要的拷贝
-    }
+const Field* Document::getField(FieldId id) const {
+	if (id == FieldNames::kNone) {
+		return nullptr;
+	}
+	auto it = const_cast<Document*>(this)->lowerBound(id);
+	if (it != fields_.entries_.end() && it->first == id) {
+		return &it->second;
+	}
+	return nullptr;
 }
 
-void Document::fromJson(const json& j) {
-    for (const auto& [key, val] : j.items()) {
-        // 如果字段已存在，跳过插入
-        auto insert_result = fields_.insert({key, Field{}});
-        if (!insert_result.second) {
-            std::cerr << "Error processing key: " << key << " with value: " << val
-                      << ". Error: Duplicate field key." << std::endl;
-            throw std::invalid_argument("Duplicate field key: " + key);
-        }
-
-        // 对新插入的字段进行处理
-        try {
-            insert_result.first->second.fromJson(val);
-        } catch (const std::exception& e) {
-            std::cerr << "Error processing key: " << key << " with value: " << val
-                      << ". Error: " << e.what() << std::endl;
-            throw;
-        }
-    }
-}
-
-const Field* Document::getField(const std::string& fieldName) const {
-	auto it = fields_.find(fieldName);
-	if (it != fields_.end()) {
-		return &(it->second);
+void Document::setField(FieldId id, Field&& field) {
+	auto it = lowerBound(id);
+	if (it != fields_.entries_.end() && it->first == id) {
+		it->second = std::move(field);
 	} else {
+		fields_.entries_.emplace(it, id, std::move(field));
+	}
+}
+
+namespace {
+
+// 字段是嵌套文档时返回该文档，否则返回 nullptr
+Document* nestedDocument(Field* field) {
+	if (!field || field->getType() != FieldType::DOCUMENT) {
 		return nullptr;
 	}
+	return std::get<std::shared_ptr<Document>>(field->getValue()).get();
+}
+
 }
 
-Field* Document::getField(const std::string& fieldName) {
-    auto it = fields_.find(fieldName);
-    if (it != fields_.end()) {
-        return &(it->second);
-    }
-    return nullptr;
+Document* Document::nestedForWrite(FieldId id, std::string_view name) {
+	auto it = lowerBound(id);
+	if (it == fields_.entries_.end() || it->first != id) {
+		// 如果嵌套文档不存在，创建一个新的嵌套文档
+		auto nestedDoc = std::make_shared<Document>();
+		fields_.entries_.emplace(it, id, Field(nestedDoc));
+		return nestedDoc.get();
+	}
+	// 如果字段已存在且是一个嵌套文档，获取该嵌套文档
+	if (it->second.getType() != FieldType::DOCUMENT) {
+		// 如果存在同名字段但不是文档，抛出异常
+		throw std::runtime_error("Field '" + std::string(name) + "' is not a document");
+	}
+	auto nestedDoc = std::get<std::shared_ptr<Document>>(it->second.getValue());
+	if (!nestedDoc) {
+		nestedDoc = std::make_shared<Document>();
+		it->second = Field(nestedDoc);
+	}
+	return nestedDoc.get();
+}
+
+void Document::addField(FieldId id, const Field& field) {
+	auto it = lowerBound(id);
+	if (it == fields_.entries_.end() || it->first != id) {
+		fields_.entries_.emplace(it, id, field);
+	}
+}
+
+Field Document::takeField(FieldId id) {
+	auto it = lowerBound(id);
+	if (id == FieldNames::kNone || it == fields_.entries_.end() || it->first != id) {
+		return Field(std::monostate{}); // 字段不存在
+	}
+	Field ret = std::move(it->second);
+	fields_.entries_.erase(it);
+	return ret;
 }
 
 void Document::setFieldByPath(const std::string& path, const Field& field) {
-    size_t pos = path.find('.');
-
-    if (pos == std::string::npos) {
-        // 如果路径没有嵌套，直接在顶层设置字段
-		fields_.emplace(path,field);
-        //fields_[path] = std::make_shared<Field>(field);
-    } else {
-        // 如果路径有嵌套，解析嵌套字段
-        std::string currentField = path.substr(0, pos);
-        std::string remainingPath = path.substr(pos + 1);
-//std::cout << "currentField: " << currentField << " remainingPath: " << remainingPath << std::endl;
-        auto it = fields_.find(currentField);
-        std::shared_ptr<Document> nestedDoc;
-
-        if (it != fields_.end()) {
-            // 如果字段已存在且是一个嵌套文档，获取该嵌套文档
-            if (it->second.getType() == FieldType::DOCUMENT) {
-                nestedDoc = std::get<std::shared_ptr<Document>>(it->second.getValue());
-            } else {
-                // 如果存在同名字段但不是文档，抛出异常或覆盖为文档
-                throw std::runtime_error("Field '" + currentField + "' is not a document");
-            }
-        }
-
-        if (!nestedDoc) {
-            // 如果嵌套文档不存在，创建一个新的嵌套文档
-            nestedDoc = std::make_shared<Document>();
-            fields_[currentField] = Field(nestedDoc);
-        }
-
-        // 在嵌套文档中递归设置字段
-        nestedDoc->setFieldByPath(remainingPath, field);
-    }
+	auto& names = FieldNames::getInstance();
+	Document* doc = this;
+	std::string_view rest(path);
+	size_t pos;
+	// 逐层找到或创建嵌套文档
+	while ((pos = rest.find('.')) != std::string_view::npos) {
+		std::string_view currentField = rest.substr(0, pos);
+		doc = doc->nestedForWrite(names.intern(currentField), currentField);
+		rest.remove_prefix(pos + 1);
+	}
+	// 最后一层只添加，已有的字段不覆盖
+	doc->addField(names.intern(rest), field);
 }
 
+void Document::setFieldByPath(const FieldPath& path, const Field& field) {
+	if (path.size() == 0) {
+		return;
+	}
+	auto& names = FieldNames::getInstance();
+	auto idOf = [&](size_t i) {
+		FieldId id = path.id(i);
+		return id != FieldNames::kNone ? id : names.intern(path.segment(i));
+	};
+	Document* doc = this;
+	size_t last = path.size() - 1;
+	for (size_t i = 0; i < last; ++i) {
+		doc = doc->nestedForWrite(idOf(i), path.segment(i));
+	}
+	doc->addField(idOf(last), field);
+}
+
+bool Document::canSetFieldByPath(const FieldPath& path) const {
+	const Document* doc = this;
+	for (size_t i = 0; i + 1 < path.size(); ++i) {
+		const Field* field = doc->getField(path.id(i));
+		if (!field) {
+			return true;	// 之后的各层都会新建
+		}
+		if (field->getType() != FieldType::DOCUMENT) {
+			return false;
+		}
+		doc = std::get<std::shared_ptr<Document>>(field->getValue()).get();
+		if (!doc) {
+			return true;
+		}
+	}
+	return true;
+}
 
 Field* Document::getFieldByPath(const std::string& path) {
-    size_t pos = path.find('.');
-	//std::cout << "searching for path: " << path << "\n";
-    if (pos == std::string::npos) {
-        // 没有嵌套，直接返回顶层字段
-        return getField(path);
-    } else {
-        // 解析嵌套字段
-        std::string currentField = path.substr(0, pos);
-		//std::cout << "finding " << currentField << "\n";
-        auto it = fields_.find(currentField);
-        if (it != fields_.end() && it->second.getType() == FieldType::DOCUMENT) {
-            const auto& nestedDoc = std::get<std::shared_ptr<Document>>(it->second.getValue());
-            if (nestedDoc) {
-                return nestedDoc->getFieldByPath(path.substr(pos + 1));
-            }
-        }
-    }
-    return nullptr;
+	auto& names = FieldNames::getInstance();
+	Document* doc = this;
+	std::string_view rest(path);
+	while (true) {
+		size_t pos = rest.find('.');
+		Field* field = doc->getField(names.find(rest.substr(0, pos)));
+		if (pos == std::string_view::npos || !field) {
+			return field;
+		}
+		// 解析嵌套字段
+		doc = nestedDocument(field);
+		if (!doc) {
+			return nullptr;
+		}
+		rest.remove_prefix(pos + 1);
+	}
+}
+
+Field* Document::getFieldByPath(const FieldPath& path) {
+	Document* doc = this;
+	for (size_t i = 0; i < path.size(); ++i) {
+		Field* field = doc->getField(path.id(i));
+		if (i + 1 == path.size() || !field) {
+			return field;
+		}
+		doc = nestedDocument(field);
+		if (!doc) {
+			return nullptr;
+		}
+	}
+	return nullptr;
 }
 
 Field Document::removeFieldByPath(const std::string& path) {
-    Field ret = Field(std::monostate{});
-    size_t pos = path.find('.');
-    if (pos == std::string::npos) {
-        // 删除顶层字段
-        auto it = fields_.find(path);
-        if (it != fields_.end()) {
-            ret = it->second;
-            //std::cout << "delete path:" << path << " value: " << it->second << " ok\n";
-            fields_.erase(it);
-            return ret; // 删除成功
-        }
-        return ret; // 字段不存在
-    } else {
-        // 解析嵌套字段
-        std::string currentField = path.substr(0, pos);
-        auto it = fields_.find(currentField);
-        if (it != fields_.end() && it->second.getType() == FieldType::DOCUMENT) {
-            auto nestedDoc = std::get<std::shared_ptr<Document>>(it->second.getValue());
-            if (nestedDoc) {
-                return nestedDoc->removeFieldByPath(path.substr(pos + 1));
-            }
-        }
-        return ret; // 嵌套字段不存在
-    }
+	auto& names = FieldNames::getInstance();
+	Document* doc = this;
+	std::string_view rest(path);
+	size_t pos;
+	while ((pos = rest.find('.')) != std::string_view::npos) {
+		doc = nestedDocument(doc->getField(names.find(rest.substr(0, pos))));
+		if (!doc) {
+			return Field(std::monostate{}); // 嵌套字段不存在
+		}
+		rest.remove_prefix(pos + 1);
+	}
+	return doc->takeField(names.find(rest));
+}
+
+Field Document::removeFieldByPath(const FieldPath& path) {
+	if (path.size() == 0) {
+		return Field(std::monostate{});
+	}
+	Document* doc = this;
+	size_t last = path.size() - 1;
+	for (size_t i = 0; i < last; ++i) {
+		doc = nestedDocument(doc->getField(path.id(i)));
+		if (!doc) {
+			return Field(std::monostate{}); // 嵌套字段不存在
+		}
+	}
+	return doc->takeField(path.id(last));
 }
@@ -1,50 +1,168 @@
 #ifndef DOCUMENT_HPP
 #define DOCUMENT_HPP
 #include <unordered_set>
+#include <shared_mutex>
+#include <string_view>
+#include <climits>
 #include "field.hpp"
 
 using DocumentId = uint64_t;//std::string;
-using DocumentFields = std::map<std::string, Field>;
+using FieldId = uint32_t;
+
+// 字段名字典: 所有文档共用，文档中只保存 4 字节的编号，同一个名字只存一份
+// 编号只增不减，登记过的名字在进程内不会释放，重启加载数据时只登记仍在使用的名字；按编号取名字不加锁
+// 名字个数上限由 DB_MAX_FIELD_NAMES 设置，达到上限后引入新名字的写入失败，已有名字不受影响
+class FieldNames {
+public:
+    static constexpr FieldId kNone = UINT32_MAX;
+
+    static FieldNames& getInstance();
+
+    // 名字不存在时登记一个新编号
+    FieldId intern(std::string_view name);
+    // 名字没有登记过时返回 kNone，这时任何文档都不会有这个字段
+    FieldId find(std::string_view name) const;
+    const std::string& name(FieldId id) const {
+        return chunks_[id >> kChunkBits][id & (kChunkSize - 1)];
+    }
+
+private:
+    FieldNames();
+    FieldNames(const FieldNames&) = delete;
+    FieldNames& operator=(const FieldNames&) = delete;
+
+    // 名字分块存放，块只分配不移动，已登记名字的地址不变
+    static constexpr size_t kChunkBits = 12;
+    static constexpr size_t kChunkSize = size_t(1) << kChunkBits;
+    static constexpr size_t kMaxChunks = 4096;
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string_view, FieldId> ids_;
+    std::unique_ptr<std::string[]> chunks_[kMaxChunks];
+    FieldId count_ = 0;
+    const size_t limit_;    // 最多登记的名字个数，不超过 kChunkSize * kMaxChunks
+};
+
+// 文档的字段: 按字段编号排序的平铺数组，没有树节点和名字字符串的开销
+// 遍历时得到 (名字, 字段)，顺序是编号顺序
+class DocumentFields {
+public:
+    using Entry = std::pair<FieldId, Field>;
+
+    class const_iterator {
+    public:
+        using value_type = std::pair<const std::string&, const Field&>;
+        explicit const_iterator(std::vector<Entry>::const_iterator it) : it_(it) {}
+        value_type operator*() const {
+            return {FieldNames::getInstance().name(it_->first), it_->second};
+        }
+        const_iterator& operator++() {
+            ++it_;
+            return *this;
+        }
+        bool operator!=(const const_iterator& other) const { return it_ != other.it_; }
+        bool operator==(const const_iterator& other) const { return it_ == other.it_; }
+
+    private:
+        std::vector<Entry>::const_iterator it_;
+    };
+
+    const_iterator begin() const { return const_iterator(entries_.begin()); }
+    const_iterator end() const { return const_iterator(entries_.end()); }
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    const std::vector<Entry>& entries() const { return entries_; }
+
+private:
+    friend class Document;
+    std::vector<Entry> entries_;
+};
+
+// 预先解析的字段路径: 构造时按 '.' 切分并查好每段的编号，逐文档取值时不再切分和查找字符串
+// 构造时还没有登记的名字，取值时再查一次，之后插入的文档同样能匹配
+class FieldPath {
+public:
+    FieldPath() = default;
+    explicit FieldPath(const std::string& path);
+
+    const std::string& str() const { return path_; }
+    bool empty() const { return path_.empty(); }
+    size_t size() const { return ids_.size(); }
+    std::string_view segment(size_t i) const {
+        return std::string_view(path_).substr(spans_[i].first, spans_[i].second);
+    }
+    FieldId id(size_t i) const {
+        return ids_[i] != FieldNames::kNone ? ids_[i] : FieldNames::getInstance().find(segment(i));
+    }
+
+private:
+    std::string path_;
+    std::vector<std::pair<uint32_t, uint32_t>> spans_;  // 每段在 path_ 中的 (起点, 长度)
+    std::vector<FieldId> ids_;
+};
 
 class Document {
 public:
     // 添加或更新字段
     void setField(const std::string& fieldName, const Field& field) {
-        fields_[fieldName] = field;
+        setField(FieldNames::getInstance().intern(fieldName), Field(field));
     }
 
     void setField(const std::string& fieldName, Field&& field) {
-        fields_[fieldName] = std::move(field); // 直接移动 Field
+        setField(FieldNames::getInstance().intern(fieldName), std::move(field)); // 直接移动 Field
     }
 
+    void setField(FieldId id, Field&& field);
+
 	const DocumentFields& getFields() const{
 		return fields_;
 	}
 
 	// 检查字段是否存在
     bool hasField(const std::string& fieldName) const {
-        return fields_.find(fieldName) != fields_.end();
+        return getField(fieldName) != nullptr;
     }
 
     // 获取字段
-    const Field* getField(const std::string& fieldName) const ;
-	
+    const Field* getField(const std::string& fieldName) const {
+        return getField(FieldNames::getInstance().find(fieldName));
+    }
+    const Field* getField(FieldId id) const;
+    Field* getField(FieldId id) {
+        return const_cast<Field*>(static_cast<const Document*>(this)->getField(id));
+    }
+
 	Field* getFieldByPath(const std::string& path) ;
+	Field* getFieldByPath(const FieldPath& path);
+	const Field* getFieldByPath(const FieldPath& path) const {
+		return const_cast<Document*>(this)->getFieldByPath(path);
+	}
 	// 添加新字段!!!不能更新
 	void setFieldByPath(const std::string& path, const Field& field);
+	void setFieldByPath(const FieldPath& path, const Field& field);
+	// 路径上已有的上层字段都是文档时返回 true，此时 setFieldByPath 不会因为路径冲突失败
+	bool canSetFieldByPath(const FieldPath& path) const;
 
 	Field removeFieldByPath(const std::string& path);
-    
+	Field removeFieldByPath(const FieldPath& path);
+
 	virtual json toJson() const;
 	std::string toBinary() const;
     void fromBinary(const char* data, size_t size);
     void fromJson(const json& j);
 
 private:
-	Field* getField(const std::string& fieldName);
+	// 第一个不小于 id 的位置
+	std::vector<DocumentFields::Entry>::iterator lowerBound(FieldId id);
+	// 找到或创建名为 name 的嵌套文档，同名字段不是文档时抛出异常
+	Document* nestedForWrite(FieldId id, std::string_view name);
+	// 字段不存在时添加，已有的不覆盖
+	void addField(FieldId id, const Field& field);
+	// 移出并删除字段，不存在时返回空字段
+	Field takeField(FieldId id);
 	DocumentFields fields_;
 };
 
 std::ostream& operator<<(std::ostream& os, const Document& doc);
 
-#endif
\ No newline at end of file
+#endif
@@ -121,10 +121,15 @@ FieldValue valuefromJson(const json& value) {
     } else if (value.is_number_float()) {
         return value.get<double>();
     } else if (value.is_string()) {
-		if (isDate(value.get<std::string>())) {
-			return stringToTimeT(value.get<std::string>());
+        const auto& str = value.get_ref<const std::string&>();
+		if (isDate(str)) {
+			return stringToTimeT(str);
 		}
-        return value.get<std::string>();
+        return str;
+    } else if (value.is_binary()) {
+        // MessagePack bin / CBOR byte string
+        const auto& bytes = value.get_binary();
+        return std::vector<uint8_t>(bytes.begin(), bytes.end());
     } else if (value.is_array()) {
         // 验证是否是字节数组
         if (!value.is_array() || !std::all_of(value.begin(), value.end(), 
@@ -354,7 +359,7 @@ struct MatchResult {
     size_t length; // 查询字符串长度
 };
 
-MatchResult determineMatchType(const std::string& query) {
+MatchResult determineMatchType(std::string_view query) {
     size_t len = query.size();
     if (len == 0) return {MatchType::Invalid, 0, 0};
 
@@ -376,9 +381,10 @@ bool likeMatch(const FieldValue& fieldValue, const FieldValue& queryValue, const
     }
 
     // 避免字符串拷贝
-    const std::string& fieldStr = std::get<std::string>(fieldValue);
-    const std::string& query = std::get<std::string>(queryValue);
+    return likeMatch(std::string_view(std::get<std::string>(fieldValue)), std::string_view(std::get<std::string>(queryValue)));
+}
 
+bool likeMatch(std::string_view fieldStr, std::string_view query) {
     // 获取匹配模式及查询字符串范围
     auto [matchType, start, length] = determineMatchType(query);
 
@@ -388,7 +394,7 @@ bool likeMatch(const FieldValue& fieldValue, const FieldValue& queryValue, const
     // 执行匹配
     switch (matchType) {
         case MatchType::Contains:
-            return fieldStr.find(query.substr(start, length)) != std::string::npos;
+            return fieldStr.find(query.substr(start, length)) != std::string_view::npos;
         
         case MatchType::Prefix:
             return std::memcmp(fieldStr.data(), query.data() + start, length) == 0;
@@ -2,6 +2,7 @@
 #define FieldValue_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <variant>
@@ -69,5 +70,6 @@ enum class MatchType {
 };
 
 bool likeMatch(const FieldValue& fieldValue, const FieldValue& queryValue, const std::string& op);
+bool likeMatch(std::string_view fieldStr, std::string_view query);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <limits>
+#include "indexstats.hpp"
+
+IndexStats::IndexStats(size_t entries, size_t buckets) {
+    depth_ = std::max<size_t>(1, (entries + buckets - 1) / std::max<size_t>(1, buckets));
+}
+
+void IndexStats::add(const FieldValue& key, size_t count) {
+    if (count == 0) return;
+    if (std::holds_alternative<std::monostate>(key)) {
+        nulls_ += count;
+    }
+    entries_ += count;
+    distinct_++;
+    if (buckets_.empty() || buckets_.back().count >= depth_) {
+        buckets_.emplace_back();
+    }
+    auto& bucket = buckets_.back();
+    bucket.upper = key;
+    bucket.count += count;
+    bucket.distinct++;
+    bucket.upperCount = count;
+}
+
+// 小于 value 的条目数，桶内假设均匀分布
+double IndexStats::lessThan(const FieldValue& value) const {
+    double acc = 0;
+    for (const auto& bucket : buckets_) {
+        if (bucket.upper < value) {
+            acc += bucket.count;
+            continue;
+        }
+        if (value == bucket.upper) {
+            return acc + (bucket.count - bucket.upperCount);
+        }
+        if (bucket.distinct > 1) {
+            acc += (bucket.count - bucket.upperCount) / 2.0;
+        }
+        return acc;
+    }
+    return acc;
+}
+
+double IndexStats::equalTo(const FieldValue& value) const {
+    for (const auto& bucket : buckets_) {
+        if (bucket.upper < value) {
+            continue;
+        }
+        if (value == bucket.upper) {
+            return bucket.upperCount;
+        }
+        if (bucket.distinct <= 1) {
+            return 0;
+        }
+        return double(bucket.count - bucket.upperCount) / (bucket.distinct - 1);
+    }
+    return 0;
+}
+
+double IndexStats::estimate(const FieldValue& value, const std::string& op) const {
+    double rows = 0;
+    if (op == "==") {
+        rows = equalTo(value);
+    } else if (op == "!=") {
+        rows = entries_ - equalTo(value);
+    } else if (op == "<") {
+        rows = lessThan(value);
+    } else if (op == "<=") {
+        rows = lessThan(value) + equalTo(value);
+    } else if (op == ">") {
+        rows = entries_ - lessThan(value) - equalTo(value);
+    } else if (op == ">=") {
+        rows = entries_ - lessThan(value);
+    } else if (op == "LIKE") {
+        if (!std::holds_alternative<std::string>(value)) {
+            return 0;
+        }
+        const std::string& pattern = std::get<std::string>(value);
+        // 字符串键在 FieldValue 排序中位于 time 之前
+        FieldValue stringEnd = std::numeric_limits<std::time_t>::min();
+        if (pattern.find('%') == std::string::npos) {
+            rows = equalTo(value);
+        } else if (pattern.size() > 1 && pattern.back() == '%' && pattern.front() != '%') {
+            // 'prefix%' 估算为 [prefix, prefix 的后继) 的范围
+            std::string lo = pattern.substr(0, pattern.size() - 1);
+            std::string hi = lo;
+            while (!hi.empty() && static_cast<unsigned char>(hi.back()) == 0xff) {
+                hi.pop_back();
+            }
+            double upper = hi.empty() ? lessThan(stringEnd) : (hi.back()++, lessThan(hi));
+            rows = upper - lessThan(lo);
+        } else {
+            rows = (lessThan(stringEnd) - lessThan(std::string())) * defaultSelectivity(op);
+        }
+    } else {
+        throw std::invalid_argument("Unsupported comparison operator: " + op);
+    }
+    return std::clamp(rows, 0.0, double(entries_));
+}
+
+double IndexStats::defaultSelectivity(const std::string& op) {
+    if (op == "==") return 0.05;
+    if (op == "!=") return 0.95;
+    if (op == "LIKE") return 0.25;
+    return 0.33;
+}
+
+json IndexStats::toJson() const {
+    json j;
+    j["entries"] = entries_;
+    j["distinct"] = distinct_;
+    j["nulls"] = nulls_;
+    json histogram = json::array();
+    for (const auto& bucket : buckets_) {
+        histogram.push_back({
+            {"upper", valuetoJson(bucket.upper)},
+            {"count", bucket.count},
+            {"distinct", bucket.distinct}
+        });
+    }
+    j["histogram"] = histogram;
+    return j;
+}
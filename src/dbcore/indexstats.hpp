@@ -0,0 +1,48 @@
+#ifndef INDEXSTATS_HPP
+#define INDEXSTATS_HPP
+
+#include <vector>
+#include "fieldvalue.hpp"
+
+// 索引统计信息: 条目数、不同键数、空值数以及等深直方图，用于估算条件命中的行数
+class IndexStats {
+public:
+    struct Bucket {
+        FieldValue upper;       // 桶内最大键
+        size_t count = 0;       // 桶内条目数
+        size_t distinct = 0;    // 桶内不同键数
+        size_t upperCount = 0;  // 最大键自身的条目数
+    };
+
+    // entries 为预计的总条目数，用来确定每个桶的深度
+    explicit IndexStats(size_t entries = 0, size_t buckets = 32);
+
+    // 必须按键序调用
+    void add(const FieldValue& key, size_t count);
+
+    size_t entries() const { return entries_; }
+    size_t distinct() const { return distinct_; }
+    size_t nulls() const { return nulls_; }
+
+    // 估算满足 key op value 的条目数
+    double estimate(const FieldValue& value, const std::string& op) const;
+    json toJson() const;
+
+    // 构建时容器的修改计数，用于判断是否需要重建
+    size_t version = 0;
+
+    // 没有统计信息时按操作符给出的默认选择率
+    static double defaultSelectivity(const std::string& op);
+
+private:
+    double lessThan(const FieldValue& value) const;
+    double equalTo(const FieldValue& value) const;
+
+    size_t depth_;
+    size_t entries_ = 0;
+    size_t distinct_ = 0;
+    size_t nulls_ = 0;
+    std::vector<Bucket> buckets_;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include "parallelscan.hpp"
+
+namespace {
+
+struct ScanJob {
+    const ParallelScan::MorselFn* fn;
+    size_t n;
+    size_t morselSize;
+    size_t morsels;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::exception_ptr error;
+};
+
+// 领取 morsel 直到取完；晚启动的线程领不到 morsel 时不会访问 fn
+void work(ScanJob& job) {
+    size_t morsel;
+    while ((morsel = job.next.fetch_add(1)) < job.morsels) {
+        size_t begin = morsel * job.morselSize;
+        size_t end = std::min(job.n, begin + job.morselSize);
+        try {
+            (*job.fn)(morsel, begin, end);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (!job.error) {
+                job.error = std::current_exception();
+            }
+        }
+        if (job.done.fetch_add(1) + 1 == job.morsels) {
+            { std::lock_guard<std::mutex> lock(job.mutex); }
+            job.cv.notify_all();
+        }
+    }
+}
+
+} // namespace
+
+void ParallelScan::setExecutor(Post post, size_t workers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    post_ = std::move(post);
+    workers_ = workers;
+}
+
+void ParallelScan::resetExecutor() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    post_ = nullptr;
+    workers_ = 0;
+}
+
+void ParallelScan::run(size_t n, size_t morselSize, const MorselFn& fn) {
+    size_t morsels = morselCount(n, morselSize);
+    Post post;
+    size_t helpers = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (post_ && workers_ > 1 && morsels > 1) {
+            post = post_;
+            helpers = std::min(workers_ - 1, morsels - 1);
+        }
+    }
+    if (helpers == 0) {
+        for (size_t morsel = 0; morsel < morsels; ++morsel) {
+            size_t begin = morsel * morselSize;
+            fn(morsel, begin, std::min(n, begin + morselSize));
+        }
+        return;
+    }
+
+    auto job = std::make_shared<ScanJob>();
+    job->fn = &fn;
+    job->n = n;
+    job->morselSize = morselSize;
+    job->morsels = morsels;
+    for (size_t i = 0; i < helpers; ++i) {
+        post([job]() { work(*job); });
+    }
+    // 调用线程也领取 morsel，执行器线程都在忙时由调用线程完成全部工作
+    work(*job);
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->cv.wait(lock, [&job]() { return job->done.load() == job->morsels; });
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef PARALLELSCAN_HPP
+#define PARALLELSCAN_HPP
+
+#include <functional>
+#include <mutex>
+
+// morsel 并行扫描: 把 [0, n) 切成固定大小的 morsel，由调用线程和执行器线程共同领取
+// dbcore 不自己创建线程，由服务层注册执行器（DBService 的线程池），没有注册时串行执行
+class ParallelScan {
+public:
+    using Post = std::function<void(std::function<void()>)>;
+    using MorselFn = std::function<void(size_t morsel, size_t begin, size_t end)>;
+
+    static constexpr size_t kMorselRows = 16384;    // 表扫描每个 morsel 的行数，是 64 的倍数
+
+    static ParallelScan& getInstance() {
+        static ParallelScan instance;
+        return instance;
+    }
+
+    // workers 为执行器的线程数，调用线程本身也参与执行
+    void setExecutor(Post post, size_t workers);
+    void resetExecutor();
+
+    static size_t morselCount(size_t n, size_t morselSize) {
+        return (n + morselSize - 1) / morselSize;
+    }
+
+    // 依次对每个 morsel 调用 fn，全部完成后返回；fn 抛出的第一个异常在调用线程重新抛出
+    // 不同 morsel 可能在不同线程上并发执行，fn 只能写各自 morsel 的输出
+    void run(size_t n, size_t morselSize, const MorselFn& fn);
+
+private:
+    ParallelScan() = default;
+    ParallelScan(const ParallelScan&) = delete;
+    ParallelScan& operator=(const ParallelScan&) = delete;
+
+    std::mutex mutex_;
+    Post post_;
+    size_t workers_ = 0;
+};
+
+#endif
@@ -0,0 +1,19 @@
+#include "predicate.hpp"
+
+CmpOp parseCmpOp(const std::string& op) {
+    if (op == "==") return CmpOp::EQ;
+    if (op == "!=") return CmpOp::NE;
+    if (op == "<") return CmpOp::LT;
+    if (op == ">") return CmpOp::GT;
+    if (op == "<=") return CmpOp::LE;
+    if (op == ">=") return CmpOp::GE;
+    if (op == "LIKE") return CmpOp::LIKE;
+    throw std::invalid_argument("Unsupported comparison operator: " + op);
+}
+
+Predicate::Predicate(const FieldValue& value, const std::string& op)
+    : value_(value), op_(parseCmpOp(op)) {
+    visit([this](const auto& typed) {
+        match_ = &invoke<std::decay_t<decltype(typed)>>;
+    });
+}
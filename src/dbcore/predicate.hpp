@@ -0,0 +1,123 @@
+#ifndef PREDICATE_HPP
+#define PREDICATE_HPP
+
+#include <string>
+#include <string_view>
+#include "fieldvalue.hpp"
+
+enum class CmpOp { EQ, NE, LT, GT, LE, GE, LIKE };
+
+CmpOp parseCmpOp(const std::string& op);
+
+template <CmpOp Op, typename A, typename B>
+inline bool cmpValues(const A& a, const B& b) {
+    if constexpr (Op == CmpOp::EQ) return a == b;
+    else if constexpr (Op == CmpOp::NE) return a != b;
+    else if constexpr (Op == CmpOp::LT) return a < b;
+    else if constexpr (Op == CmpOp::GT) return a > b;
+    else if constexpr (Op == CmpOp::LE) return a <= b;
+    else return a >= b;
+}
+
+// 编译后的单值条件: 查询值类型和操作符在构造时确定，匹配时不再按字符串查找操作符，也不做 std::visit
+// 语义与 compare() 一致: 类型相同按值比较，类型不同按 variant 下标比较；LIKE 只匹配字符串
+class Predicate {
+public:
+    Predicate(const FieldValue& value, const std::string& op);
+
+    bool operator()(const FieldValue& v) const { return match_(*this, v); }
+
+    CmpOp op() const { return op_; }
+    const FieldValue& value() const { return value_; }
+
+    // 以 (T, Op) 特化的比较函数对象调用 fn，批量过滤时把类型和操作符分派提到循环外
+    template <typename Fn>
+    void visit(Fn&& fn) const;
+
+private:
+    // 查询值类型为 T、操作符为 Op 的比较
+    template <typename T, CmpOp Op>
+    struct Typed {
+        const T& query;
+        explicit Typed(const Predicate& p) : query(std::get<T>(p.value_)) {}
+        bool operator()(const FieldValue& v) const {
+            if (auto p = std::get_if<T>(&v)) {
+                return cmpValues<Op>(*p, query);
+            }
+            // 类型不同时按 variant 下标比较
+            constexpr size_t index = variantIndex<T>();
+            if constexpr (Op == CmpOp::EQ) return false;
+            else if constexpr (Op == CmpOp::NE) return true;
+            else if constexpr (Op == CmpOp::LT || Op == CmpOp::LE) return v.index() < index;
+            else return v.index() > index;
+        }
+    };
+
+    struct Like {
+        std::string_view pattern;
+        explicit Like(const Predicate& p) : pattern(std::get<std::string>(p.value_)) {}
+        bool operator()(const FieldValue& v) const {
+            auto s = std::get_if<std::string>(&v);
+            return s && likeMatch(std::string_view(*s), pattern);
+        }
+    };
+
+    // 非字符串查询值的 LIKE 不匹配任何值
+    struct Never {
+        explicit Never(const Predicate&) {}
+        bool operator()(const FieldValue&) const { return false; }
+    };
+
+    template <typename T, size_t I = 0>
+    static constexpr size_t variantIndex() {
+        if constexpr (std::is_same_v<std::variant_alternative_t<I, FieldValue>, T>) return I;
+        else return variantIndex<T, I + 1>();
+    }
+
+    template <typename T, typename Fn>
+    void visitOp(Fn&& fn) const;
+
+    template <typename K>
+    static bool invoke(const Predicate& p, const FieldValue& v) { return K(p)(v); }
+
+    FieldValue value_;
+    CmpOp op_;
+    bool (*match_)(const Predicate&, const FieldValue&) = nullptr;
+};
+
+template <typename T, typename Fn>
+void Predicate::visitOp(Fn&& fn) const {
+    switch (op_) {
+        case CmpOp::EQ: fn(Typed<T, CmpOp::EQ>(*this)); break;
+        case CmpOp::NE: fn(Typed<T, CmpOp::NE>(*this)); break;
+        case CmpOp::LT: fn(Typed<T, CmpOp::LT>(*this)); break;
+        case CmpOp::GT: fn(Typed<T, CmpOp::GT>(*this)); break;
+        case CmpOp::LE: fn(Typed<T, CmpOp::LE>(*this)); break;
+        case CmpOp::GE: fn(Typed<T, CmpOp::GE>(*this)); break;
+        case CmpOp::LIKE: break;
+    }
+}
+
+template <typename Fn>
+void Predicate::visit(Fn&& fn) const {
+    if (op_ == CmpOp::LIKE) {
+        if (std::holds_alternative<std::string>(value_)) {
+            fn(Like(*this));
+        } else {
+            fn(Never(*this));
+        }
+        return;
+    }
+    switch (value_.index()) {
+        case 0: visitOp<std::monostate>(fn); break;
+        case 1: visitOp<int>(fn); break;
+        case 2: visitOp<double>(fn); break;
+        case 3: visitOp<bool>(fn); break;
+        case 4: visitOp<std::string>(fn); break;
+        case 5: visitOp<std::time_t>(fn); break;
+        case 6: visitOp<std::vector<uint8_t>>(fn); break;
+        case 7: visitOp<std::shared_ptr<Document>>(fn); break;
+    }
+}
+
+#endif
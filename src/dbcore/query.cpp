@@ -1,12 +1,14 @@
 #include "query.hpp"
+#include "parallelscan.hpp"
 
 Query& Query::condition(const std::string& path, const FieldValue& value, const std::string& op) {
-	conditions.push_back({op, path, value, getValueType(value)});
+	FieldType type = getValueType(value);
+	conditions.push_back({op, FieldPath(path), value, type, Predicate(value, op), getDefault(type)});
     return *this;
 }
 // 排序方法
 Query& Query::orderBy(const std::string& path, bool ascending) {
-    sorting = {path, ascending};
+    sorting = {FieldPath(path), ascending};
     return *this;
 }
 
@@ -23,149 +25,250 @@ Query& Query::offset(size_t startIndex) {
 }
 
 bool Query::matchCondition(const std::shared_ptr<Document>& doc, const Condition& condition) const {
-    auto defaultV = Field(getDefault(condition.type));
-    auto field = doc->getFieldByPath(condition.path);
-    if (!field) {
-        field = &defaultV;
-    }
-    // 针对 LIKE 操作符的特殊处理
-    if (condition.op == "LIKE" ) {
-        if (field->getType() == FieldType::STRING && condition.type == FieldType::STRING)
-            return likeMatch(field->getValue(), condition.value, condition.op);
-        else
-            return false;
-    }
-    return compare(field->getValue(), condition.value, condition.op);
+    const Field* field = doc->getFieldByPath(condition.path);
+    // LIKE 只匹配字符串字段和字符串查询值，由编译后的条件处理
+    return condition.pred(field ? field->getValue() : condition.missing);
 }
 
-std::vector<DocumentId> Query::binarySearchDocuments(
-    const std::vector<std::pair<DocumentId, FieldValue>>& docs,
-    const Condition& condition
-) const {
-    std::vector<DocumentId> result;
-
-    auto compareWithQuery = [&](const std::pair<DocumentId, FieldValue>& lhs, const std::pair<DocumentId, FieldValue>& rhs) {
-        //std::cout << "l: " << lhs.second << " r: " << rhs.second << "\n";
-        return lhs.second < rhs.second;  // 正常比较
-    };
+void Query::intersect(std::vector<DocumentId>& candidateDocs, const RoaringBitmap& matched) const {
+    candidateDocs.erase(std::remove_if(candidateDocs.begin(), candidateDocs.end(), [&](DocumentId docId) {
+        DocSlot slot;
+        return !collection_.findSlot(docId, slot) || !matched.contains(slot);
+    }), candidateDocs.end());
+}
 
-    auto cond = std::make_pair(0, condition.value);
+std::vector<Query::PlanStep> Query::plan() const {
+    // 代价单位: 读取索引中的一个条目为 1，逐文档按路径取值并比较为 3
+    constexpr double kIndexEntryCost = 1.0;
+    constexpr double kDocCost = 3.0;
 
-    // 执行比较和查找操作
-    if (condition.op == "==") {
-        auto range = std::equal_range(docs.begin(), docs.end(), cond, compareWithQuery);
-        for (auto it = range.first; it != range.second; ++it) {
-            result.push_back(it->first);  // 将符合条件的文档加入结果
-        }
-    } else if (condition.op == "<") {
-        auto it = std::lower_bound(docs.begin(), docs.end(), cond, compareWithQuery);
-        for (auto i = docs.begin(); i != it; ++i) {
-            result.push_back(i->first);
-        }
-    } else if (condition.op == "<=") {
-        auto it = std::upper_bound(docs.begin(), docs.end(), cond, compareWithQuery);
-        for (auto i = docs.begin(); i != it; ++i) {
-            result.push_back(i->first);
-        }
-    } else if (condition.op == ">") {
-        auto it = std::upper_bound(docs.begin(), docs.end(), cond, compareWithQuery);
-        for (auto i = it; i != docs.end(); ++i) {
-            result.push_back(i->first);
-        }
-    } else if (condition.op == ">=") {
-        auto it = std::lower_bound(docs.begin(), docs.end(), cond, compareWithQuery);
-        for (auto i = it; i != docs.end(); ++i) {
-            result.push_back(i->first);
-        }
-    } else if (condition.op == "!=") {
-        result.reserve(docs.size());
-        auto range = std::equal_range(docs.begin(), docs.end(), cond, compareWithQuery);
-        for (auto& doc : docs) {
-            if (doc < *range.first || doc >= *range.second) {
-                result.push_back(doc.first);
-            }
+    double totalDocs = static_cast<double>(collection_.documents_.size());
+    std::vector<PlanStep> estimates;
+    estimates.reserve(conditions.size());
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        const auto& condition = conditions[i];
+        PlanStep step{i, false, false, totalDocs * IndexStats::defaultSelectivity(condition.op), 0};
+        if (condition.op == "==" && collection_.hasIndex(condition.path.str())) {
+            // 等值条件直接按值查找索引，只读取命中的条目，行数是准确的
+            auto docs = collection_.findIndexed(condition.path.str(), condition.value);
+            step.useIndex = true;
+            step.probe = true;
+            step.estRows = docs ? docs->size() : 0;
+        } else if (collection_.hasOrderedIndex(condition.path.str())) {
+            auto stats = collection_.getIndexStats(condition.path.str());
+            step.useIndex = true;
+            step.estRows = stats->estimate(condition.value, condition.op);
+            // 范围条件只读取命中的键范围；!= 和 LIKE 要读取大部分条目
+            bool seek = condition.op != "!=" && condition.op != "LIKE";
+            step.cost = (seek ? step.estRows : stats->entries()) * kIndexEntryCost;
         }
-    } else if (condition.op == "LIKE" && condition.type == FieldType::STRING) {
-        // 对于 LIKE 的处理，这里假设字段是字符串类型
-        for (const auto& doc : docs) {
-            auto fieldValue = doc.second;  // 获取字段值
-            if (getValueType(fieldValue) == FieldType::STRING && 
-                likeMatch(fieldValue, condition.value, condition.op)) {
-                result.push_back(doc.first);
+        estimates.push_back(step);
+    }
+
+    // 选择率高的条件先执行，尽早缩小候选集
+    std::stable_sort(estimates.begin(), estimates.end(), [](const PlanStep& a, const PlanStep& b) {
+        return a.estRows < b.estRows;
+    });
+
+    std::vector<PlanStep> steps;
+    double rows = totalDocs;
+    bool bitmap = true;     // 之前的步骤都走索引，结果还是编号位图，求交按容器进行，不必逐个检查候选文档
+    for (auto step : estimates) {
+        double selectivity = totalDocs > 0 ? step.estRows / totalDocs : 0;
+        // 候选集较小时逐文档匹配比遍历索引更便宜
+        double docCost = rows * kDocCost;
+        if (step.probe) {
+            // 等值查找: 第一步只读取命中的条目，之后每个候选文档查一次，总是比逐文档匹配便宜
+            step.cost = (steps.empty() ? step.estRows : rows) * kIndexEntryCost;
+        } else {
+            double intersectCost = bitmap ? 0 : rows;
+            if (step.useIndex && step.cost + intersectCost >= docCost) {
+                step.useIndex = false;
             }
+            step.cost = step.useIndex ? step.cost + intersectCost : docCost;
         }
+        bitmap = bitmap && step.useIndex;
+        rows *= selectivity;
+        step.estRows = rows;
+        steps.push_back(step);
     }
+    return steps;
+}
 
-    return result;
+json Query::explain() const {
+    json j;
+    j["documents"] = collection_.documents_.size();
+    j["steps"] = json::array();
+    double totalCost = 0;
+    for (const auto& step : plan()) {
+        const auto& condition = conditions[step.cond];
+        json s;
+        s["path"] = condition.path.str();
+        s["op"] = condition.op;
+        s["value"] = valuetoJson(condition.value);
+        s["access"] = step.useIndex ? "index" : (totalCost == 0 ? "scan" : "filter");
+        if (step.useIndex) {
+            s["index"] = step.probe && collection_.hasHashIndex(condition.path.str()) ? "hash" : "ordered";
+        }
+        s["estRows"] = step.estRows;
+        s["cost"] = step.cost;
+        if (collection_.hasOrderedIndex(condition.path.str())) {
+            s["stats"] = collection_.getIndexStats(condition.path.str())->toJson();
+        }
+        totalCost += step.cost;
+        j["steps"].push_back(s);
+    }
+    j["cost"] = totalCost;
+    if (!sorting.path.empty()) {
+        j["sorting"] = {{"path", sorting.path.str()}, {"ascending", sorting.ascending}};
+    }
+    return j;
 }
 
 void Query::match(std::vector<DocumentId>& candidateDocs) const {
-    bool hasIdx = false;  // 有索引意味着正序
-    bool sameIdx_sortPath = false; // 索引和排序重叠
-    std::vector<size_t> indexedConditions;
-    std::vector<size_t> nonIndexedConditions;
-
-    // **1. 先遍历 conditions，分类索引和非索引条件**
-    for (size_t i = 0; i < conditions.size(); ++i) {
-        if (collection_.hasIndex(conditions[i].path)) {
-            // **如果当前索引字段与排序字段相同，插入 indexedConditions 头部**
-            if (!sorting.path.empty() && sorting.path == conditions[i].path) {
-                indexedConditions.insert(indexedConditions.begin(), i);
-                sameIdx_sortPath = true;
-            } else {
-                indexedConditions.push_back(i);
+    bool scanned = false;           // 是否已经产生了候选集
+    std::string orderedPath;        // 当前候选集按哪个索引字段有序
+
+    // 开头连续的索引步骤在文档编号位图上求交，遇到逐文档匹配的步骤或者结束时再转换为文档 ID
+    RoaringBitmap slots;
+    bool bitmapPhase = false;
+    bool narrowed = false;              // 第一步之后是否又与其他索引求交
+    std::vector<DocSlot> orderedSlots;  // 第一步是排序字段上的范围条件时，命中的编号按键序排列
+    auto flushSlots = [&]() {
+        candidateDocs.clear();
+        if (!orderedSlots.empty()) {
+            candidateDocs.reserve(slots.size());
+            for (DocSlot slot : orderedSlots) {
+                if (!narrowed || slots.contains(slot)) {
+                    candidateDocs.emplace_back(collection_.slotDocument(slot));
+                }
             }
         } else {
-            nonIndexedConditions.push_back(i);
+            candidateDocs.reserve(slots.size());
+            slots.forEach([&](RoaringBitmap::Value slot) {
+                candidateDocs.emplace_back(collection_.slotDocument(static_cast<DocSlot>(slot)));
+            });
         }
-    }
-
-    // **2. 先处理带索引的 conditions**
-    for (size_t i = 0; i < indexedConditions.size(); ++i) {
-        const auto& condition = conditions[indexedConditions[i]];
-        hasIdx = true;
-
-        // **首次使用索引，获取初始候选集**
-        auto docs = collection_.getSortedDocuments(condition.path, candidateDocs);
-        // **使用二分查找加速匹配**
-        candidateDocs = binarySearchDocuments(docs, condition);
-
-        if (candidateDocs.empty()) {
-            return;  // 任何阶段筛选后为空，则提前返回
-        }
-    }
+        bitmapPhase = false;
+    };
 
-    // **3. 处理剩余的非索引 conditions**
-    for (size_t idx : nonIndexedConditions) {
-        const auto& condition = conditions[idx];
-        std::vector<DocumentId> filteredDocs;
+    for (const auto& step : plan()) {
+        const auto& condition = conditions[step.cond];
 
-        if (candidateDocs.empty()) {
-            // **如果之前没有索引查询，则从 documents_ 遍历所有文档**
-            for (const auto& [docId, doc] : collection_.documents_) {
-                if (matchCondition(doc, condition)) {
-                    filteredDocs.emplace_back(docId);
+        if (step.useIndex) {
+            // **等值条件按值查找索引；范围条件在有序索引上定位键范围，合并命中键的 posting**
+            RoaringBitmap ids;
+            std::vector<const RoaringBitmap*> postings;
+            if (step.probe) {
+                if (const auto* docs = collection_.findIndexed(condition.path.str(), condition.value)) {
+                    postings.push_back(docs);
+                }
+            } else {
+                collection_.searchIndex(condition.path.str(), condition.pred, postings);
+            }
+            if (!scanned) {
+                if (step.probe) {
+                    orderedPath = condition.path.str();     // 结果在该字段上取值相同
+                } else if (condition.path.str() == sorting.path.str()) {
+                    // 按键序记下编号，转换时按键序输出，省去排序
+                    for (const auto* posting : postings) {
+                        posting->forEach([&](RoaringBitmap::Value slot) {
+                            orderedSlots.push_back(static_cast<DocSlot>(slot));
+                        });
+                    }
+                    orderedPath = condition.path.str();
+                }
+            }
+            // 只有一个 posting 时直接使用，不复制
+            const RoaringBitmap* matched = &ids;
+            if (postings.size() == 1) {
+                matched = postings.front();
+            } else if (!orderedSlots.empty() && !scanned) {
+                // 范围内的键很多时 posting 大多很小，排序后按升序加入比逐个容器合并快
+                std::vector<DocSlot> sorted(orderedSlots);
+                std::sort(sorted.begin(), sorted.end());
+                for (DocSlot slot : sorted) {
+                    ids.add(slot);
+                }
+            } else if (!postings.empty()) {
+                ids = RoaringBitmap::unionOf(postings);
+            }
+            if (!scanned || bitmapPhase) {
+                // 与之前的索引结果按位图求交
+                if (bitmapPhase) {
+                    slots &= *matched;
+                    narrowed = true;
+                } else {
+                    slots = matched == &ids ? std::move(ids) : *matched;
+                }
+                bitmapPhase = true;
+                scanned = true;
+                if (slots.empty()) {
+                    candidateDocs.clear();
+                    return;
                 }
+                continue;
             }
+            // 基于已有候选集筛选，保持原有顺序
+            intersect(candidateDocs, *matched);
         } else {
-            // **基于已有候选集进一步筛选**
-            for (const auto& docId : candidateDocs) {
-                auto doc = collection_.getDocumentNoLock(docId);
-                if (matchCondition(doc, condition)) {
-                    filteredDocs.emplace_back(docId);
+            if (bitmapPhase) {
+                flushSlots();
+            }
+            std::vector<DocumentId> filteredDocs;
+            if (!scanned && collection_.documents_.size() >= 2 * kMorselDocs) {
+                // **第一步，文档较多时按哈希桶切分成 morsel 并行遍历，各 morsel 的结果按顺序拼接**
+                const auto& documents = collection_.documents_;
+                size_t buckets = documents.bucket_count();
+                size_t morselBuckets = std::max<size_t>(1, buckets * kMorselDocs / documents.size());
+                std::vector<std::vector<DocumentId>> parts(ParallelScan::morselCount(buckets, morselBuckets));
+                ParallelScan::getInstance().run(buckets, morselBuckets, [&](size_t morsel, size_t begin, size_t end) {
+                    for (size_t bucket = begin; bucket < end; ++bucket) {
+                        for (auto it = documents.begin(bucket); it != documents.end(bucket); ++it) {
+                            if (matchCondition(it->second, condition)) {
+                                parts[morsel].emplace_back(it->first);
+                            }
+                        }
+                    }
+                });
+                for (const auto& part : parts) {
+                    filteredDocs.insert(filteredDocs.end(), part.begin(), part.end());
+                }
+            } else if (!scanned) {
+                // **第一步，从 documents_ 遍历所有文档**
+                for (const auto& [docId, doc] : collection_.documents_) {
+                    if (matchCondition(doc, condition)) {
+                        filteredDocs.emplace_back(docId);
+                    }
+                }
+            } else {
+                // **基于已有候选集进一步筛选，保持原有顺序**
+                for (const auto& docId : candidateDocs) {
+                    auto doc = collection_.getDocumentNoLock(docId);
+                    if (!doc) continue;
+                    if (matchCondition(doc, condition)) {
+                        filteredDocs.emplace_back(docId);
+                    }
                 }
             }
+            candidateDocs = std::move(filteredDocs);
         }
-
-        candidateDocs = std::move(filteredDocs);
+        scanned = true;
 
         if (candidateDocs.empty()) {
-            return;  // 任何阶段筛选后为空，则返回空
+            return;  // 任何阶段筛选后为空，则提前返回
         }
     }
 
-    // **4. 排序候选集**
-    if (!hasIdx || !sameIdx_sortPath) {
+    if (bitmapPhase) {
+        flushSlots();
+    }
+
+    // **排序候选集: 第一步索引筛选的字段就是排序字段时，候选集已经有序**
+    if (sorting.path.empty()) {
+        return;
+    }
+    if (orderedPath != sorting.path.str()) {
         sort(candidateDocs);
     } else if (!sorting.ascending) {
         std::reverse(candidateDocs.begin(), candidateDocs.end());
@@ -191,18 +294,11 @@ void Query::page(std::vector<DocumentId>& documents) {
 void Query::sort(std::vector<DocumentId>& documents) const{
     if (sorting.path.empty()) return;
 
-    bool useIndex = collection_.hasIndex(sorting.path);  // 是否有索引
+    bool useIndex = collection_.hasOrderedIndex(sorting.path.str());  // 是否有有序索引
 
     if (useIndex) {
-        std::vector<DocumentId> sortedDocs;
-
         // 获取已排序的文档
-        auto sortedDocuments = collection_.getSortedDocuments(sorting.path, documents);
-        sortedDocs.reserve(documents.size());  // 预留合理的空间
-
-        for (const auto& [docId, _ ] : sortedDocuments) {
-            sortedDocs.emplace_back(docId);
-        }
+        auto sortedDocs = collection_.getSortedDocuments(sorting.path.str(), documents);
 
         // 逆序排序
         if (!sorting.ascending) {
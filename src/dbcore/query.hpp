@@ -14,6 +14,7 @@
 #include <ctime>
 #include <memory>
 #include "fieldvalue.hpp"
+#include "predicate.hpp"
 #include "document.hpp"
 #include "collection.hpp"
 
@@ -21,16 +22,29 @@ class Query {
 private:
     struct Condition {
         std::string op;
-        std::string path;
+        FieldPath path;     // 构造条件时解析，整个查询过程中复用
         FieldValue value;
         FieldType type;
+        Predicate pred;     // 构造条件时编译，逐文档匹配时直接调用
+        FieldValue missing; // 文档没有该字段时参与比较的默认值
     };
 
     struct Sorting {
-        std::string path;
+        FieldPath path;
         bool ascending;
     };
 
+    // 查询计划中的一步
+    struct PlanStep {
+        size_t cond;        // 条件下标
+        bool useIndex;      // 通过索引筛选还是逐文档匹配
+        bool probe;         // 等值条件按值查找索引，不展开整个索引
+        double estRows;     // 估算的输出文档数
+        double cost;        // 估算代价
+    };
+
+    static constexpr size_t kMorselDocs = 4096;    // 并行扫描时每个 morsel 大约包含的文档数
+
     std::vector<Condition> conditions;
     Sorting sorting;
     size_t maxResults = 0;
@@ -44,10 +58,11 @@ public:
     Query& limit(size_t maxResults);
     Query& offset(size_t startIndex);
     bool matchCondition(const std::shared_ptr<Document>& doc, const Condition& condition) const;
-    std::vector<DocumentId> binarySearchDocuments(
-        const std::vector<std::pair<DocumentId, FieldValue>>& docs,
-        const Condition& condition
-    ) const;
+    // 只保留在索引结果 (文档编号位图) 中的候选文档，候选集保持原有顺序
+    void intersect(std::vector<DocumentId>& candidateDocs, const RoaringBitmap& matched) const;
+    // 按统计信息估算每个条件的选择率，决定条件顺序以及每一步是否使用索引
+    std::vector<PlanStep> plan() const;
+    json explain() const;
     void match(std::vector<DocumentId>& candidateDocs) const;
 	void sort(std::vector<DocumentId>& documents) const;
 	void page(std::vector<DocumentId>& documents);
@@ -0,0 +1,465 @@
+#include <algorithm>
+#include "roaring.hpp"
+
+namespace {
+constexpr size_t kArrayMax = 4096;  // 数组容器最多的值个数，超过后位图更省空间
+constexpr size_t kWords = 1024;     // 位图容器的字数，65536 位
+
+inline bool testBit(const std::vector<uint64_t>& bits, uint16_t low) {
+    return (bits[low >> 6] >> (low & 63)) & 1;
+}
+
+inline uint32_t popcount(const std::vector<uint64_t>& bits) {
+    uint32_t count = 0;
+    for (uint64_t word : bits) {
+        count += __builtin_popcountll(word);
+    }
+    return count;
+}
+}
+
+bool RoaringBitmap::Container::add(uint16_t low) {
+    if (dense()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (bits[low >> 6] & mask) {
+            return false;
+        }
+        bits[low >> 6] |= mask;
+        count++;
+        return true;
+    }
+    if (array.empty() || low > array.back()) {
+        // 按升序插入时直接追加
+        array.push_back(low);
+    } else {
+        auto it = std::lower_bound(array.begin(), array.end(), low);
+        if (*it == low) {
+            return false;
+        }
+        array.insert(it, low);
+    }
+    count++;
+    normalize();
+    return true;
+}
+
+bool RoaringBitmap::Container::remove(uint16_t low) {
+    if (dense()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (!(bits[low >> 6] & mask)) {
+            return false;
+        }
+        bits[low >> 6] &= ~mask;
+        count--;
+        normalize();
+        return true;
+    }
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it == array.end() || *it != low) {
+        return false;
+    }
+    array.erase(it);
+    count--;
+    return true;
+}
+
+bool RoaringBitmap::Container::contains(uint16_t low) const {
+    if (dense()) {
+        return testBit(bits, low);
+    }
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void RoaringBitmap::Container::normalize() {
+    if (dense() && count <= kArrayMax) {
+        array.clear();
+        array.reserve(count);
+        for (size_t w = 0; w < kWords; ++w) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                array.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+            }
+        }
+        std::vector<uint64_t>().swap(bits);
+    } else if (!dense() && count > kArrayMax) {
+        bits.assign(kWords, 0);
+        for (uint16_t low : array) {
+            bits[low >> 6] |= uint64_t(1) << (low & 63);
+        }
+        std::vector<uint16_t>().swap(array);
+    }
+}
+
+RoaringBitmap::Container RoaringBitmap::andContainer(const Container& a, const Container& b) {
+    Container c;
+    if (a.dense() && b.dense()) {
+        c.bits.resize(kWords);
+        for (size_t w = 0; w < kWords; ++w) {
+            c.bits[w] = a.bits[w] & b.bits[w];
+        }
+        c.count = popcount(c.bits);
+        c.normalize();
+    } else if (a.dense() || b.dense()) {
+        const Container& sparse = a.dense() ? b : a;
+        const Container& dense = a.dense() ? a : b;
+        c.array.reserve(sparse.array.size());
+        for (uint16_t low : sparse.array) {
+            if (testBit(dense.bits, low)) {
+                c.array.push_back(low);
+            }
+        }
+        c.count = c.array.size();
+    } else {
+        const auto& small = a.array.size() <= b.array.size() ? a.array : b.array;
+        const auto& large = a.array.size() <= b.array.size() ? b.array : a.array;
+        c.array.reserve(small.size());
+        if (small.size() * 64 < large.size()) {
+            // 大小悬殊时逐个二分查找，起点随之前移
+            auto from = large.begin();
+            for (uint16_t low : small) {
+                from = std::lower_bound(from, large.end(), low);
+                if (from == large.end()) {
+                    break;
+                }
+                if (*from == low) {
+                    c.array.push_back(low);
+                }
+            }
+        } else {
+            std::set_intersection(small.begin(), small.end(), large.begin(), large.end(),
+                                  std::back_inserter(c.array));
+        }
+        c.count = c.array.size();
+    }
+    return c;
+}
+
+RoaringBitmap::Container RoaringBitmap::orContainer(const Container& a, const Container& b) {
+    Container c;
+    if (!a.dense() && !b.dense() && a.count + b.count <= kArrayMax) {
+        c.array.reserve(a.count + b.count);
+        std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                       std::back_inserter(c.array));
+        c.count = c.array.size();
+        return c;
+    }
+    c.bits.assign(kWords, 0);
+    for (const Container* part : {&a, &b}) {
+        if (part->dense()) {
+            for (size_t w = 0; w < kWords; ++w) {
+                c.bits[w] |= part->bits[w];
+            }
+        } else {
+            for (uint16_t low : part->array) {
+                c.bits[low >> 6] |= uint64_t(1) << (low & 63);
+            }
+        }
+    }
+    c.count = popcount(c.bits);
+    c.normalize();
+    return c;
+}
+
+RoaringBitmap::Container RoaringBitmap::andNotContainer(const Container& a, const Container& b) {
+    Container c;
+    if (!a.dense()) {
+        c.array.reserve(a.array.size());
+        if (b.dense()) {
+            for (uint16_t low : a.array) {
+                if (!testBit(b.bits, low)) {
+                    c.array.push_back(low);
+                }
+            }
+        } else {
+            std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                                std::back_inserter(c.array));
+        }
+        c.count = c.array.size();
+        return c;
+    }
+    c.bits = a.bits;
+    if (b.dense()) {
+        for (size_t w = 0; w < kWords; ++w) {
+            c.bits[w] &= ~b.bits[w];
+        }
+    } else {
+        for (uint16_t low : b.array) {
+            c.bits[low >> 6] &= ~(uint64_t(1) << (low & 63));
+        }
+    }
+    c.count = popcount(c.bits);
+    c.normalize();
+    return c;
+}
+
+size_t RoaringBitmap::lowerBound(uint64_t key) const {
+    // 大多数访问落在最后一个容器上 (按升序插入)
+    if (!keys_.empty() && keys_.back() <= key) {
+        return keys_.back() == key ? keys_.size() - 1 : keys_.size();
+    }
+    return std::lower_bound(keys_.begin(), keys_.end(), key) - keys_.begin();
+}
+
+void RoaringBitmap::push(uint64_t key, Container&& container) {
+    size_ += container.count;
+    keys_.push_back(key);
+    containers_.push_back(std::move(container));
+}
+
+bool RoaringBitmap::add(Value value) {
+    uint64_t key = value >> 16;
+    size_t i = lowerBound(key);
+    if (i == keys_.size() || keys_[i] != key) {
+        keys_.insert(keys_.begin() + i, key);
+        containers_.insert(containers_.begin() + i, Container());
+    }
+    if (!containers_[i].add(static_cast<uint16_t>(value))) {
+        return false;
+    }
+    size_++;
+    return true;
+}
+
+bool RoaringBitmap::remove(Value value) {
+    uint64_t key = value >> 16;
+    size_t i = lowerBound(key);
+    if (i == keys_.size() || keys_[i] != key || !containers_[i].remove(static_cast<uint16_t>(value))) {
+        return false;
+    }
+    size_--;
+    if (containers_[i].count == 0) {
+        keys_.erase(keys_.begin() + i);
+        containers_.erase(containers_.begin() + i);
+    }
+    return true;
+}
+
+bool RoaringBitmap::contains(Value value) const {
+    uint64_t key = value >> 16;
+    size_t i = lowerBound(key);
+    return i < keys_.size() && keys_[i] == key && containers_[i].contains(static_cast<uint16_t>(value));
+}
+
+void RoaringBitmap::clear() {
+    keys_.clear();
+    containers_.clear();
+    size_ = 0;
+}
+
+size_t RoaringBitmap::memoryUsage() const {
+    size_t bytes = sizeof(*this) + keys_.capacity() * sizeof(uint64_t)
+                 + containers_.capacity() * sizeof(Container);
+    for (const auto& c : containers_) {
+        bytes += c.array.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+void RoaringBitmap::shrinkToFit() {
+    keys_.shrink_to_fit();
+    containers_.shrink_to_fit();
+    for (auto& c : containers_) {
+        c.array.shrink_to_fit();
+    }
+}
+
+void RoaringBitmap::appendTo(std::vector<Value>& out) const {
+    out.reserve(out.size() + size_);
+    forEach([&out](Value value) { out.push_back(value); });
+}
+
+RoaringBitmap operator&(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap result;
+    size_t i = 0, j = 0;
+    while (i < a.keys_.size() && j < b.keys_.size()) {
+        if (a.keys_[i] < b.keys_[j]) {
+            // 跳过对方没有的容器
+            i = std::lower_bound(a.keys_.begin() + i, a.keys_.end(), b.keys_[j]) - a.keys_.begin();
+        } else if (b.keys_[j] < a.keys_[i]) {
+            j = std::lower_bound(b.keys_.begin() + j, b.keys_.end(), a.keys_[i]) - b.keys_.begin();
+        } else {
+            auto c = RoaringBitmap::andContainer(a.containers_[i], b.containers_[j]);
+            if (c.count > 0) {
+                result.push(a.keys_[i], std::move(c));
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap operator|(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap result;
+    result.keys_.reserve(a.keys_.size() + b.keys_.size());
+    result.containers_.reserve(a.keys_.size() + b.keys_.size());
+    size_t i = 0, j = 0;
+    while (i < a.keys_.size() || j < b.keys_.size()) {
+        if (j == b.keys_.size() || (i < a.keys_.size() && a.keys_[i] < b.keys_[j])) {
+            result.push(a.keys_[i], RoaringBitmap::Container(a.containers_[i]));
+            ++i;
+        } else if (i == a.keys_.size() || b.keys_[j] < a.keys_[i]) {
+            result.push(b.keys_[j], RoaringBitmap::Container(b.containers_[j]));
+            ++j;
+        } else {
+            result.push(a.keys_[i], RoaringBitmap::orContainer(a.containers_[i], b.containers_[j]));
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap operator-(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap result;
+    size_t j = 0;
+    for (size_t i = 0; i < a.keys_.size(); ++i) {
+        while (j < b.keys_.size() && b.keys_[j] < a.keys_[i]) {
+            ++j;
+        }
+        if (j < b.keys_.size() && b.keys_[j] == a.keys_[i]) {
+            auto c = RoaringBitmap::andNotContainer(a.containers_[i], b.containers_[j]);
+            if (c.count > 0) {
+                result.push(a.keys_[i], std::move(c));
+            }
+        } else {
+            result.push(a.keys_[i], RoaringBitmap::Container(a.containers_[i]));
+        }
+    }
+    return result;
+}
+
+RoaringBitmap& RoaringBitmap::operator&=(const RoaringBitmap& other) {
+    *this = *this & other;
+    return *this;
+}
+
+RoaringBitmap& RoaringBitmap::operator|=(const RoaringBitmap& other) {
+    if (empty()) {
+        *this = other;
+    } else if (!other.empty()) {
+        *this = *this | other;
+    }
+    return *this;
+}
+
+RoaringBitmap& RoaringBitmap::operator-=(const RoaringBitmap& other) {
+    if (!empty() && !other.empty()) {
+        *this = *this - other;
+    }
+    return *this;
+}
+
+bool RoaringBitmap::operator==(const RoaringBitmap& other) const {
+    if (size_ != other.size_ || keys_ != other.keys_) {
+        return false;
+    }
+    // 容器按个数决定表示方式，内容相同时表示也相同
+    for (size_t i = 0; i < containers_.size(); ++i) {
+        const auto& a = containers_[i];
+        const auto& b = other.containers_[i];
+        if (a.count != b.count || a.array != b.array || a.bits != b.bits) {
+            return false;
+        }
+    }
+    return true;
+}
+
+RoaringBitmap RoaringBitmap::unionOf(const std::vector<const RoaringBitmap*>& bitmaps) {
+    if (bitmaps.size() == 1) {
+        return *bitmaps.front();
+    }
+    std::vector<std::pair<uint64_t, const Container*>> parts;
+    for (const auto* bitmap : bitmaps) {
+        for (size_t i = 0; i < bitmap->keys_.size(); ++i) {
+            parts.emplace_back(bitmap->keys_[i], &bitmap->containers_[i]);
+        }
+    }
+    std::sort(parts.begin(), parts.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    RoaringBitmap result;
+    for (size_t begin = 0, end; begin < parts.size(); begin = end) {
+        size_t total = 0;
+        bool sparse = true;
+        for (end = begin; end < parts.size() && parts[end].first == parts[begin].first; ++end) {
+            total += parts[end].second->count;
+            sparse = sparse && !parts[end].second->dense();
+        }
+        if (end - begin == 1) {
+            result.push(parts[begin].first, Container(*parts[begin].second));
+            continue;
+        }
+        Container c;
+        if (sparse && total <= kArrayMax) {
+            c.array.reserve(total);
+            for (size_t k = begin; k < end; ++k) {
+                const auto& array = parts[k].second->array;
+                c.array.insert(c.array.end(), array.begin(), array.end());
+            }
+            std::sort(c.array.begin(), c.array.end());
+            c.array.erase(std::unique(c.array.begin(), c.array.end()), c.array.end());
+            c.count = c.array.size();
+        } else {
+            // 同一容器的输入都合并到一个位图上
+            c.bits.assign(kWords, 0);
+            for (size_t k = begin; k < end; ++k) {
+                const Container& part = *parts[k].second;
+                if (part.dense()) {
+                    for (size_t w = 0; w < kWords; ++w) {
+                        c.bits[w] |= part.bits[w];
+                    }
+                } else {
+                    for (uint16_t low : part.array) {
+                        c.bits[low >> 6] |= uint64_t(1) << (low & 63);
+                    }
+                }
+            }
+            c.count = popcount(c.bits);
+            c.normalize();
+        }
+        result.push(parts[begin].first, std::move(c));
+    }
+    return result;
+}
+
+RoaringBitmap::const_iterator::const_iterator(const RoaringBitmap* bitmap, size_t container)
+    : bitmap_(bitmap), container_(container) {
+    if (container_ < bitmap_->containers_.size() && bitmap_->containers_[container_].dense()) {
+        word_ = bitmap_->containers_[container_].bits[0];
+    }
+    settle();
+}
+
+void RoaringBitmap::const_iterator::settle() {
+    const auto& containers = bitmap_->containers_;
+    while (container_ < containers.size()) {
+        const Container& c = containers[container_];
+        Value high = bitmap_->keys_[container_] << 16;
+        if (c.dense()) {
+            while (word_ == 0 && ++pos_ < kWords) {
+                word_ = c.bits[pos_];
+            }
+            if (word_ != 0) {
+                value_ = high | (pos_ * 64 + __builtin_ctzll(word_));
+                return;
+            }
+        } else if (pos_ < c.array.size()) {
+            value_ = high | c.array[pos_];
+            return;
+        }
+        // 进入下一个容器
+        ++container_;
+        pos_ = 0;
+        word_ = container_ < containers.size() && containers[container_].dense()
+              ? containers[container_].bits[0] : 0;
+    }
+}
+
+RoaringBitmap::const_iterator& RoaringBitmap::const_iterator::operator++() {
+    if (bitmap_->containers_[container_].dense()) {
+        word_ &= word_ - 1;
+    } else {
+        ++pos_;
+    }
+    settle();
+    return *this;
+}
@@ -0,0 +1,123 @@
+#ifndef ROARING_HPP
+#define ROARING_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+// 压缩位图 (Roaring): 用作索引的 posting list，保存 64 位的行号或文档 ID
+// 按值的高 48 位分成容器，每个容器保存 65536 个值中出现的低 16 位:
+//   不超过 4096 个时用有序 uint16 数组，超过时用 1024 个字的位图 (8KB)
+// 连续分配的编号落在少数几个容器里，取值少的列 (状态、枚举) 每行只占 1 位左右
+// 求交、求并、求差按容器逐个进行，位图容器之间按字计算
+class RoaringBitmap {
+public:
+    using Value = uint64_t;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Value;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Value*;
+        using reference = Value;
+
+        Value operator*() const { return value_; }
+        const_iterator& operator++();
+        bool operator==(const const_iterator& other) const {
+            return container_ == other.container_ && pos_ == other.pos_ && word_ == other.word_;
+        }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class RoaringBitmap;
+        const_iterator(const RoaringBitmap* bitmap, size_t container);
+        // 从当前位置找到下一个存在的值
+        void settle();
+
+        const RoaringBitmap* bitmap_;
+        size_t container_;
+        size_t pos_ = 0;        // 数组下标或位图的字下标
+        uint64_t word_ = 0;     // 位图容器当前字中还没有访问的位
+        Value value_ = 0;
+    };
+
+    // 返回值是否新加入或确实删除
+    bool add(Value value);
+    bool remove(Value value);
+    bool contains(Value value) const;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    void clear();
+    // 占用的内存字节数，包括对象本身
+    size_t memoryUsage() const;
+    // 释放数组容器多余的容量，批量构建后调用
+    void shrinkToFit();
+
+    // 按升序遍历
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, containers_.size()); }
+    // 按升序追加到 out
+    void appendTo(std::vector<Value>& out) const;
+    // 按升序对每个值调用 f，比迭代器少了逐个值的状态判断
+    template <typename F>
+    void forEach(F&& f) const {
+        for (size_t i = 0; i < keys_.size(); ++i) {
+            Value high = keys_[i] << 16;
+            const Container& c = containers_[i];
+            if (c.dense()) {
+                for (size_t w = 0; w < c.bits.size(); ++w) {
+                    for (uint64_t word = c.bits[w]; word; word &= word - 1) {
+                        f(high | (w * 64 + __builtin_ctzll(word)));
+                    }
+                }
+            } else {
+                for (uint16_t low : c.array) {
+                    f(high | low);
+                }
+            }
+        }
+    }
+
+    RoaringBitmap& operator&=(const RoaringBitmap& other);
+    RoaringBitmap& operator|=(const RoaringBitmap& other);
+    // 求差 (AND NOT)
+    RoaringBitmap& operator-=(const RoaringBitmap& other);
+    friend RoaringBitmap operator&(const RoaringBitmap& a, const RoaringBitmap& b);
+    friend RoaringBitmap operator|(const RoaringBitmap& a, const RoaringBitmap& b);
+    friend RoaringBitmap operator-(const RoaringBitmap& a, const RoaringBitmap& b);
+    bool operator==(const RoaringBitmap& other) const;
+    bool operator!=(const RoaringBitmap& other) const { return !(*this == other); }
+
+    // 多个位图的并集: 同一容器的所有输入一次合并，比逐个 |= 少复制中间结果
+    static RoaringBitmap unionOf(const std::vector<const RoaringBitmap*>& bitmaps);
+
+private:
+    struct Container {
+        std::vector<uint16_t> array;    // 稀疏容器: 有序的低 16 位
+        std::vector<uint64_t> bits;     // 稠密容器: 1024 个字，非空时使用
+        uint32_t count = 0;
+
+        bool dense() const { return !bits.empty(); }
+        bool add(uint16_t low);
+        bool remove(uint16_t low);
+        bool contains(uint16_t low) const;
+        // 按个数在两种表示之间转换
+        void normalize();
+    };
+
+    static Container andContainer(const Container& a, const Container& b);
+    static Container orContainer(const Container& a, const Container& b);
+    static Container andNotContainer(const Container& a, const Container& b);
+    // 第一个键不小于 key 的容器下标
+    size_t lowerBound(uint64_t key) const;
+    void push(uint64_t key, Container&& container);
+
+    std::vector<uint64_t> keys_;        // 容器对应的高 48 位，升序
+    std::vector<Container> containers_;
+    size_t size_ = 0;
+};
+
+#endif
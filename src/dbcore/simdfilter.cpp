@@ -0,0 +1,247 @@
+#include <algorithm>
+#include "simdfilter.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+
+namespace simd {
+
+namespace {
+
+using Int32Kernel = void (*)(const int32_t*, size_t, CmpOp, int32_t, uint64_t*);
+using Int64Kernel = void (*)(const int64_t*, size_t, CmpOp, int64_t, uint64_t*);
+using DoubleKernel = void (*)(const double*, size_t, CmpOp, double, uint64_t*);
+
+// 从 from（64 的倍数）开始逐行比较，写满对应的位图字
+template <CmpOp Op, typename T>
+void scalarRange(const T* data, size_t from, size_t n, T query, uint64_t* bits) {
+    for (size_t i = from; i < n; i += 64) {
+        size_t end = std::min(n, i + 64);
+        uint64_t word = 0;
+        for (size_t j = i; j < end; ++j) {
+            word |= uint64_t(cmpValues<Op>(data[j], query)) << (j - i);
+        }
+        bits[i >> 6] = word;
+    }
+}
+
+// 按运行时的 op 调用 Kernel<Op>::run
+template <template <CmpOp> class Kernel, typename T>
+void dispatch(const T* data, size_t n, CmpOp op, T query, uint64_t* bits) {
+    switch (op) {
+        case CmpOp::EQ: Kernel<CmpOp::EQ>::run(data, n, query, bits); break;
+        case CmpOp::NE: Kernel<CmpOp::NE>::run(data, n, query, bits); break;
+        case CmpOp::LT: Kernel<CmpOp::LT>::run(data, n, query, bits); break;
+        case CmpOp::GT: Kernel<CmpOp::GT>::run(data, n, query, bits); break;
+        case CmpOp::LE: Kernel<CmpOp::LE>::run(data, n, query, bits); break;
+        case CmpOp::GE: Kernel<CmpOp::GE>::run(data, n, query, bits); break;
+        case CmpOp::LIKE: throw std::invalid_argument("LIKE is not supported for numeric columns");
+    }
+}
+
+template <CmpOp Op>
+struct Scalar {
+    template <typename T>
+    static void run(const T* data, size_t n, T query, uint64_t* bits) {
+        scalarRange<Op>(data, 0, n, query, bits);
+    }
+};
+
+// 整数只有相等和大于比较: != 、<= 、>= 分别由 == 、> 、< 取反得到
+constexpr bool negated(CmpOp op) {
+    return op == CmpOp::NE || op == CmpOp::LE || op == CmpOp::GE;
+}
+
+#ifdef SIMD_X86
+
+template <CmpOp Op>
+struct Avx2 {
+    TARGET_AVX2 static void run(const int32_t* data, size_t n, int32_t query, uint64_t* bits) {
+        const __m256i q = _mm256_set1_epi32(query);
+        size_t words = n >> 6;
+        for (size_t w = 0; w < words; ++w) {
+            const int32_t* p = data + (w << 6);
+            uint64_t word = 0;
+            for (int k = 0; k < 8; ++k) {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + k * 8));
+                __m256i m;
+                if constexpr (Op == CmpOp::EQ || Op == CmpOp::NE) m = _mm256_cmpeq_epi32(a, q);
+                else if constexpr (Op == CmpOp::GT || Op == CmpOp::LE) m = _mm256_cmpgt_epi32(a, q);
+                else m = _mm256_cmpgt_epi32(q, a);
+                word |= uint64_t(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(m)))) << (k * 8);
+            }
+            bits[w] = negated(Op) ? ~word : word;
+        }
+        scalarRange<Op>(data, words << 6, n, query, bits);
+    }
+
+    TARGET_AVX2 static void run(const int64_t* data, size_t n, int64_t query, uint64_t* bits) {
+        const __m256i q = _mm256_set1_epi64x(query);
+        size_t words = n >> 6;
+        for (size_t w = 0; w < words; ++w) {
+            const int64_t* p = data + (w << 6);
+            uint64_t word = 0;
+            for (int k = 0; k < 16; ++k) {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + k * 4));
+                __m256i m;
+                if constexpr (Op == CmpOp::EQ || Op == CmpOp::NE) m = _mm256_cmpeq_epi64(a, q);
+                else if constexpr (Op == CmpOp::GT || Op == CmpOp::LE) m = _mm256_cmpgt_epi64(a, q);
+                else m = _mm256_cmpgt_epi64(q, a);
+                word |= uint64_t(uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(m)))) << (k * 4);
+            }
+            bits[w] = negated(Op) ? ~word : word;
+        }
+        scalarRange<Op>(data, words << 6, n, query, bits);
+    }
+
+    TARGET_AVX2 static void run(const double* data, size_t n, double query, uint64_t* bits) {
+        // 与 C++ 比较运算一致: NaN 只满足 !=
+        constexpr int pred = Op == CmpOp::EQ ? _CMP_EQ_OQ : Op == CmpOp::NE ? _CMP_NEQ_UQ
+            : Op == CmpOp::LT ? _CMP_LT_OQ : Op == CmpOp::GT ? _CMP_GT_OQ
+            : Op == CmpOp::LE ? _CMP_LE_OQ : _CMP_GE_OQ;
+        const __m256d q = _mm256_set1_pd(query);
+        size_t words = n >> 6;
+        for (size_t w = 0; w < words; ++w) {
+            const double* p = data + (w << 6);
+            uint64_t word = 0;
+            for (int k = 0; k < 16; ++k) {
+                __m256d m = _mm256_cmp_pd(_mm256_loadu_pd(p + k * 4), q, pred);
+                word |= uint64_t(uint32_t(_mm256_movemask_pd(m))) << (k * 4);
+            }
+            bits[w] = word;
+        }
+        scalarRange<Op>(data, words << 6, n, query, bits);
+    }
+};
+
+template <CmpOp Op>
+struct Sse42 {
+    TARGET_SSE42 static void run(const int32_t* data, size_t n, int32_t query, uint64_t* bits) {
+        const __m128i q = _mm_set1_epi32(query);
+        size_t words = n >> 6;
+        for (size_t w = 0; w < words; ++w) {
+            const int32_t* p = data + (w << 6);
+            uint64_t word = 0;
+            for (int k = 0; k < 16; ++k) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k * 4));
+                __m128i m;
+                if constexpr (Op == CmpOp::EQ || Op == CmpOp::NE) m = _mm_cmpeq_epi32(a, q);
+                else if constexpr (Op == CmpOp::GT || Op == CmpOp::LE) m = _mm_cmpgt_epi32(a, q);
+                else m = _mm_cmpgt_epi32(q, a);
+                word |= uint64_t(uint32_t(_mm_movemask_ps(_mm_castsi128_ps(m)))) << (k * 4);
+            }
+            bits[w] = negated(Op) ? ~word : word;
+        }
+        scalarRange<Op>(data, words << 6, n, query, bits);
+    }
+
+    TARGET_SSE42 static void run(const int64_t* data, size_t n, int64_t query, uint64_t* bits) {
+        const __m128i q = _mm_set1_epi64x(query);
+        size_t words = n >> 6;
+        for (size_t w = 0; w < words; ++w) {
+            const int64_t* p = data + (w << 6);
+            uint64_t word = 0;
+            for (int k = 0; k < 32; ++k) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k * 2));
+                __m128i m;
+                if constexpr (Op == CmpOp::EQ || Op == CmpOp::NE) m = _mm_cmpeq_epi64(a, q);
+                else if constexpr (Op == CmpOp::GT || Op == CmpOp::LE) m = _mm_cmpgt_epi64(a, q);
+                else m = _mm_cmpgt_epi64(q, a);
+                word |= uint64_t(uint32_t(_mm_movemask_pd(_mm_castsi128_pd(m)))) << (k * 2);
+            }
+            bits[w] = negated(Op) ? ~word : word;
+        }
+        scalarRange<Op>(data, words << 6, n, query, bits);
+    }
+
+    TARGET_SSE42 static void run(const double* data, size_t n, double query, uint64_t* bits) {
+        const __m128d q = _mm_set1_pd(query);
+        size_t words = n >> 6;
+        for (size_t w = 0; w < words; ++w) {
+            const double* p = data + (w << 6);
+            uint64_t word = 0;
+            for (int k = 0; k < 32; ++k) {
+                __m128d a = _mm_loadu_pd(p + k * 2);
+                __m128d m;
+                if constexpr (Op == CmpOp::EQ) m = _mm_cmpeq_pd(a, q);
+                else if constexpr (Op == CmpOp::NE) m = _mm_cmpneq_pd(a, q);
+                else if constexpr (Op == CmpOp::LT) m = _mm_cmplt_pd(a, q);
+                else if constexpr (Op == CmpOp::GT) m = _mm_cmpgt_pd(a, q);
+                else if constexpr (Op == CmpOp::LE) m = _mm_cmple_pd(a, q);
+                else m = _mm_cmpge_pd(a, q);
+                word |= uint64_t(uint32_t(_mm_movemask_pd(m))) << (k * 2);
+            }
+            bits[w] = word;
+        }
+        scalarRange<Op>(data, words << 6, n, query, bits);
+    }
+};
+
+#endif
+
+struct Kernels {
+    Int32Kernel int32 = dispatch<Scalar, int32_t>;
+    Int64Kernel int64 = dispatch<Scalar, int64_t>;
+    DoubleKernel float64 = dispatch<Scalar, double>;
+    const char* isa = "scalar";
+};
+
+Kernels selectKernels() {
+    Kernels k;
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        k.int32 = dispatch<Avx2, int32_t>;
+        k.int64 = dispatch<Avx2, int64_t>;
+        k.float64 = dispatch<Avx2, double>;
+        k.isa = "avx2";
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        k.int32 = dispatch<Sse42, int32_t>;
+        k.int64 = dispatch<Sse42, int64_t>;
+        k.float64 = dispatch<Sse42, double>;
+        k.isa = "sse4.2";
+    }
+#endif
+    return k;
+}
+
+const Kernels& kernels() {
+    static const Kernels k = selectKernels();
+    return k;
+}
+
+} // namespace
+
+void filterInt32(const int32_t* data, size_t n, CmpOp op, int32_t query, uint64_t* bits) {
+    kernels().int32(data, n, op, query, bits);
+}
+
+void filterInt64(const int64_t* data, size_t n, CmpOp op, int64_t query, uint64_t* bits) {
+    kernels().int64(data, n, op, query, bits);
+}
+
+void filterDouble(const double* data, size_t n, CmpOp op, double query, uint64_t* bits) {
+    kernels().float64(data, n, op, query, bits);
+}
+
+void bitmapToRows(const std::vector<uint64_t>& bits, size_t n, std::vector<size_t>& out) {
+    for (size_t w = 0; w < bits.size(); ++w) {
+        uint64_t word = bits[w];
+        while (word) {
+            size_t idx = (w << 6) + __builtin_ctzll(word);
+            if (idx >= n) return;
+            out.push_back(idx);
+            word &= word - 1;
+        }
+    }
+}
+
+const char* isaName() {
+    return kernels().isa;
+}
+
+}
@@ -0,0 +1,25 @@
+#ifndef SIMDFILTER_HPP
+#define SIMDFILTER_HPP
+
+#include <cstdint>
+#include <vector>
+#include "predicate.hpp"
+
+// 数值列的向量化过滤内核
+// 对连续的定长数组求 value[i] op query，结果写入选择位图: 每 64 行一个 uint64_t，第 i 行对应 bits[i/64] 的第 i%64 位
+// 启动时按 CPU 支持选择 AVX2 / SSE4.2 实现，都不支持时使用标量实现，op 不能是 LIKE
+namespace simd {
+
+void filterInt32(const int32_t* data, size_t n, CmpOp op, int32_t query, uint64_t* bits);
+void filterInt64(const int64_t* data, size_t n, CmpOp op, int64_t query, uint64_t* bits);
+void filterDouble(const double* data, size_t n, CmpOp op, double query, uint64_t* bits);
+
+// 位图中为 1 的行号按升序追加到 out
+void bitmapToRows(const std::vector<uint64_t>& bits, size_t n, std::vector<size_t>& out);
+
+// 当前使用的指令集: "avx2", "sse4.2" 或 "scalar"
+const char* isaName();
+
+}
+
+#endif
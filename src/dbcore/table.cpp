@@ -1,4 +1,11 @@
+#include <cmath>
+#include <numeric>
+#include <filesystem>
+#include <unordered_set>
 #include "table.hpp"
+#include "tablefile.hpp"
+#include "simdfilter.hpp"
+#include "parallelscan.hpp"
 #include "util/util.hpp"
 
 std::vector<Table::Column> Table::jsonToColumns(const json& jsonColumns) {
@@ -69,6 +76,15 @@ void Table::fromJson(const json& j) {
             throw std::invalid_argument("Nullable column must have a default value: " + column.name);
         }
     }
+
+    // 存储方式: "row"(默认) 或 "column"
+    storage_ = storageModefromString(j.value("storage", "row"));
+    std::vector<FieldType> types;
+    types.reserve(columns_.size());
+    for (const auto& column : columns_) {
+        types.push_back(column.type);
+    }
+    store_ = TableStore::create(storage_, types);
 }
 
 bool Table::validateRow(const Row& row) {
@@ -90,7 +106,7 @@ bool Table::validateRow(const Row& row) {
 
 
 bool Table::validatePrimaryKey(const Row& row) {
-    size_t currentRowIdx = rows_.size();  // 获取当前行号
+    RowId rowId = slots_.size();  // 即将分配给该行的行号
     for (size_t i = 0; i < columns_.size(); ++i) {
         const auto& column = columns_[i];
         if (column.primaryKey) {
@@ -104,7 +120,7 @@ bool Table::validatePrimaryKey(const Row& row) {
                     throw std::invalid_argument("Primary key value already exists: " + column.name);
                 }
                 // 如果主键值没有重复，插入主键值到主键索引中
-                primaryKeyIndex_[field] = currentRowIdx;  // 使用当前行号
+                primaryKeyIndex_[field] = rowId;
             //}, field);
         }
     }
@@ -207,8 +223,6 @@ std::vector<Row> Table::jsonToRows(const json& jsonRows) {
 
 int Table::insertRowsFromJson(const json& jsonRows) {
     std::unique_lock<std::shared_mutex> lock(mutex_); // 独占锁
-    std::vector<size_t> newIndexes; // 记录需要更新索引的行
-    int i = 0;
     // 验证 JSON 格式
     if (!jsonRows.contains("rows")) {
         throw std::invalid_argument("Invalid JSON format: 'rows' is missing.");
@@ -217,6 +231,8 @@ int Table::insertRowsFromJson(const json& jsonRows) {
         throw std::invalid_argument("Invalid JSON format: 'rows' must be an array.");
     }
 
+    std::vector<Row> rows;
+    rows.reserve(jsonRows["rows"].size());
     for (const auto& jsonRow : jsonRows["rows"]) {
         Row row(columns_.size());  // 初始化一个 Row，大小为 columns_ 的大小
         for (const auto& [key, j] : jsonRow.items()) {
@@ -234,26 +250,16 @@ int Table::insertRowsFromJson(const json& jsonRows) {
                 row[index] = field;
             }
         }
-        Row newRow = processRowDefaults(row);
-        if (validateRow(newRow) && validatePrimaryKey(newRow)) {
-            rows_.push_back(newRow);
-            newIndexes.push_back(rows_.size() - 1);
-            i++;
-            
-        }
+        rows.push_back(std::move(row));
     }
-
-    // 批量更新索引
-    updateIndexesBatch(newIndexes);
-    return i;
+    return static_cast<int>(appendRows(rows));
 }
 
 bool Table::insertRow(const Row& row) {
     std::unique_lock<std::shared_mutex> lock(mutex_); // 独占锁
     Row newRow = processRowDefaults(row);
     if (validateRow(newRow) && validatePrimaryKey(newRow)) {
-        rows_.push_back(newRow);
-        updateIndexes(newRow, rows_.size() - 1);
+        updateIndexesBatch({appendRow(std::move(newRow))});
 
         return true;
     }
@@ -263,30 +269,63 @@ bool Table::insertRow(const Row& row) {
 
 bool Table::insertRows(const std::vector<Row>& newRows) {
     std::unique_lock<std::shared_mutex> lock(mutex_); // 独占锁
-    std::vector<size_t> newIndexes; // 记录需要更新索引的行
-    for (const auto& row : newRows) {
-        Row newRow = processRowDefaults(row);
-        if (validateRow(newRow) && validatePrimaryKey(newRow)) {
-            rows_.push_back(newRow);
-            newIndexes.push_back(rows_.size() - 1);
+    appendRows(newRows);
+    return true;
+}
 
-        } else {
-            return false;
+size_t Table::appendRows(const std::vector<Row>& rows) {
+    // 先补全默认值并校验所有行，有一行不合法时整批都不插入，失败的请求不会留下写了一半的数据
+    std::vector<Row> newRows;
+    newRows.reserve(rows.size());
+    std::unordered_set<Field, Field::Hash> batchKeys;  // 本批中已出现的主键
+    for (const auto& row : rows) {
+        Row newRow = processRowDefaults(row);
+        validateRow(newRow);
+        for (size_t c = 0; c < columns_.size(); ++c) {
+            if (columns_[c].primaryKey && (primaryKeyIndex_.count(newRow[c]) || !batchKeys.insert(newRow[c]).second)) {
+                throw std::invalid_argument("Primary key value already exists: " + columns_[c].name);
+            }
         }
+        newRows.push_back(std::move(newRow));
+    }
+    std::vector<size_t> newIndexes; // 记录需要更新索引的行
+    newIndexes.reserve(newRows.size());
+    for (auto& newRow : newRows) {
+        validatePrimaryKey(newRow);
+        newIndexes.push_back(appendRow(std::move(newRow)));
     }
     // 批量更新索引
     updateIndexesBatch(newIndexes);
-    return true;
+    return newIndexes.size();
+}
+
+// 追加一行并分配新的行号，返回物理位置
+size_t Table::appendRow(Row&& row) {
+    store_->append(std::move(row));
+    size_t rowIdx = store_->size() - 1;
+    rowIds_.push_back(slots_.size());
+    slots_.push_back(rowIdx);
+    return rowIdx;
+}
+
+void Table::toSlots(const RoaringBitmap& ids, std::vector<size_t>& rowIdxes) const {
+    rowIdxes.reserve(rowIdxes.size() + ids.size());
+    ids.forEach([&](RowId id) { rowIdxes.push_back(slots_[id]); });
 }
 
 std::vector<Row> Table::getRows() const{
     std::shared_lock<std::shared_mutex> lock(mutex_); // 共享锁
-    return rows_;
+    std::vector<Row> rows;
+    rows.reserve(liveRows());
+    for (size_t i = 0; i < store_->size(); ++i) {
+        if (!isDeleted(i)) rows.push_back(store_->getRow(i));
+    }
+    return rows;
 }
 
 size_t Table::getTotalRows() const{
     std::shared_lock<std::shared_mutex> lock(mutex_); // 共享锁
-    return rows_.size();
+    return liveRows();
 }
 
 void Table::updateIndexes(const Row& row, int rowIndex) {
@@ -298,7 +337,7 @@ void Table::updateIndexes(const Row& row, int rowIndex) {
             auto columnValue = row[i];
 
             // 更新索引
-            index[columnValue].insert(rowIndex);
+            index.insert(columnValue, rowIndex);
 
             // 打印索引更新信息
             //std::cout << "Updated index for column: " << column.name << "\n";
@@ -311,8 +350,14 @@ void Table::updateIndexes(const Row& row, int rowIndex) {
 }
 
 void Table::updateIndexesBatch(const std::vector<size_t>& rowIdxes) {
-    for (auto index : rowIdxes) {
-        updateIndexes(rows_[index], index);
+    modCount_ += rowIdxes.size();
+    // 只读取索引列，列存时不必重组整行
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        if (!columns_[i].indexed) continue;
+        auto& index = indexes_[columns_[i].name];
+        for (auto rowIdx : rowIdxes) {
+            index.insert(store_->getValue(rowIdx, i), rowIds_[rowIdx]);
+        }
     }
 }
 
@@ -323,27 +368,46 @@ void Table::buildIndex() {
         
         if (column.indexed) {
             // 该列需要索引，重新构建索引
-            for (size_t rowIdx = 0; rowIdx < rows_.size(); ++rowIdx) {
-                const auto& field = rows_[rowIdx][colIdx];
-                
+            std::vector<std::pair<Field, RowId>> entries;
+            entries.reserve(liveRows());
+            for (size_t rowIdx = 0; rowIdx < store_->size(); ++rowIdx) {
+                if (isDeleted(rowIdx)) continue;
                 // 索引映射：字段值 -> 行号
-                indexes_[column.name][field].insert(rowIdx);
+                entries.emplace_back(store_->getValue(rowIdx, colIdx), rowIds_[rowIdx]);
             }
+            indexes_[column.name].bulkLoad(entries);
+            invalidateStats(column.name);
         }
     }
 }
 
 void Table::createIndex(const std::string& columnName) {
+    createIndexes({columnName});
+}
+
+void Table::createIndexes(const std::vector<std::string>& columnNames) {
     std::unique_lock<std::shared_mutex> lock(mutex_); // 使用写锁，确保线程安全
-    size_t colIdx = getColumnIndex(columnName);
-    auto& column = columns_[colIdx];
-    column.indexed = true;
-    // 该列需要索引，重新构建索引
-    for (size_t rowIdx = 0; rowIdx < rows_.size(); ++rowIdx) {
-        const auto& field = rows_[rowIdx][colIdx];
-        
-        // 索引映射：字段值 -> 行号
-        indexes_[column.name][field].insert(rowIdx);
+    std::vector<size_t> colIdxes;
+    colIdxes.reserve(columnNames.size());
+    for (const auto& columnName : columnNames) {
+        colIdxes.push_back(getColumnIndex(columnName));
+    }
+    std::vector<Index> built(colIdxes.size());
+    for (size_t i = 0; i < colIdxes.size(); ++i) {
+        std::vector<std::pair<Field, RowId>> entries;
+        entries.reserve(liveRows());
+        for (size_t rowIdx = 0; rowIdx < store_->size(); ++rowIdx) {
+            if (isDeleted(rowIdx)) continue;
+            // 索引映射：字段值 -> 行号
+            entries.emplace_back(store_->getValue(rowIdx, colIdxes[i]), rowIds_[rowIdx]);
+        }
+        built[i].bulkLoad(entries);
+    }
+    for (size_t i = 0; i < colIdxes.size(); ++i) {
+        auto& column = columns_[colIdxes[i]];
+        column.indexed = true;
+        indexes_[column.name] = std::move(built[i]);
+        invalidateStats(column.name);
     }
 }
 
@@ -356,11 +420,9 @@ void Table::dropIndex(const std::string& columnName) {
 
     column.indexed = false;
 
-    // 使用 swap() 释放内存
-    Index().swap(indexes_[column.name]);
-
     // 删除索引映射
     indexes_.erase(column.name);
+    invalidateStats(column.name);
 }
 
 // 获取从第 n 行开始的 limit 个数据
@@ -370,13 +432,19 @@ std::vector<Row> Table::getWithLimitAndOffset(int limit, int offset) const {
     std::vector<Row> result;
     
     // 如果 offset 超过表中的行数，直接返回空结果
-    if (offset >= rows_.size()) {
+    if (offset < 0 || limit <= 0 || static_cast<size_t>(offset) >= liveRows()) {
         return result;
     }
 
-    // 从 offset 行开始，最多获取 limit 行
-    for (int i = offset; i < std::min(static_cast<int>(rows_.size()), offset + limit); ++i) {
-        result.push_back(rows_[i]);
+    // 从第 offset 个未删除的行开始，最多获取 limit 行
+    size_t i = deletedCount_ > 0 ? 0 : offset;
+    for (size_t skip = deletedCount_ > 0 ? offset : 0; i < store_->size(); ++i) {
+        if (isDeleted(i)) continue;
+        if (skip == 0) break;
+        skip--;
+    }
+    for (; i < store_->size() && result.size() < static_cast<size_t>(limit); ++i) {
+        if (!isDeleted(i)) result.push_back(store_->getRow(i));
     }
 
     return result;
@@ -435,29 +503,25 @@ bool Table::isPrimaryKey(const std::string& columnName) const {
 
 std::vector<size_t> Table::matchPrimaryKey(
     const std::vector<size_t>& rowSet,
-    const FieldValue& queryValue,
-    const std::string& op,
-    const std::string& columnName
+    const Predicate& pred,
+    size_t colIdx
 ) const {
     std::vector<size_t> matchedRows;
 
     if (!rowSet.empty()) {
         //只遍历rowSet
-        for (size_t rowIndex : rowSet) {
-            auto it = primaryKeyIndex_.find(rows_[rowIndex][getColumnIndex(columnName)]);
-            if (it != primaryKeyIndex_.end()) {
-                // 检查主键值是否符合条件
-                if (compare(it->first.getValue(), queryValue, op)) {
-                    matchedRows.push_back(rowIndex);
-                }
-            }
+        store_->filter(colIdx, pred, &rowSet, matchedRows);
+    } else if (pred.op() == CmpOp::EQ) {
+        // 等值查找直接走哈希
+        auto it = primaryKeyIndex_.find(Field(pred.value()));
+        if (it != primaryKeyIndex_.end()) {
+            matchedRows.push_back(slots_[it->second]);
         }
     } else {
         // 遍历主键索引，查找符合条件的主键
-        for (const auto& [key, rowIndex] : primaryKeyIndex_) {
-            // 使用 compare 来判断主键值是否符合条件
-            if (compare(key.getValue(), queryValue, op)) {
-                matchedRows.push_back(rowIndex);  // 将符合条件的行索引添加到结果
+        for (const auto& [key, rowId] : primaryKeyIndex_) {
+            if (pred(key.getValue())) {
+                matchedRows.push_back(slots_[rowId]);  // 将符合条件的行索引添加到结果
             }
         }
     }
@@ -465,46 +529,147 @@ std::vector<size_t> Table::matchPrimaryKey(
     return matchedRows;
 }
 
-std::vector<size_t> Table::matchIndex(
-    const std::vector<size_t>& rowSet,
-    const FieldValue& queryValue,
-    const std::string& op,
-    const std::string& columnName
-) const {
-    std::vector<size_t> matchedRows;
+RoaringBitmap Table::matchIndex(const Predicate& pred, size_t colIdx) const {
+    RoaringBitmap ids;
+    const auto& columnName = columns_[colIdx].name;
 
     // 检查索引是否存在
+    if (!columns_[colIdx].indexed) {
+        throw std::invalid_argument("Column " + columnName + " is not indexed.");
+    }
     auto itIndex = indexes_.find(columnName);
     if (itIndex == indexes_.end()) {
-        throw std::invalid_argument("Column " + columnName + " is not indexed.");
+        // 还没有插入过数据的空索引
+        return ids;
     }
-    // 获取对应列的索引
-    const auto& index = indexes_.at(columnName);
 
-    // 复制 rowSet 或者填充所有索引行
-    std::vector<size_t> filteredRowSet = rowSet;
-    if (filteredRowSet.empty()) {
-        filteredRowSet.reserve(index.size());
-        for (const auto& [key, rowList] : index) {
-            filteredRowSet.insert(filteredRowSet.end(), rowList.begin(), rowList.end());
+    // 在 B+ 树上做范围查找，只访问命中的键
+    itIndex->second.search(pred, ids);
+    return ids;
+}
+
+std::shared_ptr<const IndexStats> Table::getIndexStats(const std::string& columnName) const {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    auto& stats = stats_[columnName];
+    // 修改的行数超过一定比例后重建
+    size_t threshold = std::max<size_t>(64, store_->size() / 8);
+    if (!stats || modCount_ - stats->version > threshold) {
+        auto itIndex = indexes_.find(columnName);
+        if (itIndex == indexes_.end()) {
+            return std::make_shared<IndexStats>();
         }
+        auto newStats = std::make_shared<IndexStats>(itIndex->second.entryCount());
+        itIndex->second.forEach([&](const Field& key, const BTreeIndex::Posting& posting) {
+            newStats->add(key.getValue(), posting.size());
+        });
+        newStats->version = modCount_;
+        stats = newStats;
     }
+    return stats;
+}
+
+void Table::invalidateStats(const std::string& columnName) {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    stats_.erase(columnName);
+}
+
+std::vector<Table::PlanStep> Table::plan(
+    const std::vector<std::string>& conditions,   // 查询条件列
+    const std::vector<FieldValue>& queryValues,        // 查询条件值
+    const std::vector<std::string>& operators     // 比较操作符（对应每个条件）
+) const
+{
+    // 代价单位: 顺序读取一行的一列为 1，通过索引随机访问一行为 2，在位图上合并一个索引条目为 0.25
+    constexpr double kScanRowCost = 1.0;
+    constexpr double kIndexRowCost = 2.0;
+    constexpr double kBitmapEntryCost = 0.25;
 
-    // 遍历 rowSet 中的每一行
-    for (size_t rowIndex : filteredRowSet) {
-        // 获取该行的索引列值
-        const auto& fieldValue = rows_[rowIndex][getColumnIndex(columnName)].getValue();
+    // 验证输入参数的合法性
+    if (conditions.size() != queryValues.size() || conditions.size() != operators.size()) {
+        throw std::invalid_argument("conditions, queryValues and operators must have the same size.");
+    }
 
-        // 使用模板比较函数，判断查询值与索引值是否匹配
-        bool conditionMatch = compare(fieldValue, queryValue, op);
+    double totalRows = static_cast<double>(store_->size());
+    std::vector<PlanStep> candidates;   // 每个条件的估算结果
+    std::vector<double> seekCosts(conditions.size(), 0);    // 在索引上定位键范围的代价
+    int driver = -1;
+    double driverCost = totalRows * kScanRowCost;   // 全表扫描的代价
 
-        // 如果匹配，将行索引加入结果
-        if (conditionMatch) {
-            matchedRows.push_back(rowIndex);
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        const auto& column = columns_[getColumnIndex(conditions[i])];
+        const auto& op = operators[i];
+        PlanStep step{i, "filter", totalRows * IndexStats::defaultSelectivity(op), 0};
+
+        if (column.primaryKey && op == "==") {
+            // 主键等值查找最多命中一行
+            step.access = "pk";
+            step.estRows = std::min(1.0, totalRows);
+            step.cost = 1;
+        } else if (column.indexed) {
+            auto stats = getIndexStats(column.name);
+            step.access = "index";
+            step.estRows = stats->estimate(queryValues[i], op);
+            // != 和非前缀 LIKE 需要遍历所有键
+            bool rangeSeek = op != "!=";
+            if (op == "LIKE" && std::holds_alternative<std::string>(queryValues[i])) {
+                const auto& pattern = std::get<std::string>(queryValues[i]);
+                rangeSeek = !pattern.empty() && pattern.front() != '%';
+            }
+            seekCosts[i] = rangeSeek ? std::log2(totalRows + 2) : double(stats->distinct());
+            step.cost = seekCosts[i] + step.estRows * kIndexRowCost;
         }
+        if (step.access != "filter" && step.cost < driverCost) {
+            driver = static_cast<int>(i);
+            driverCost = step.cost;
+        }
+        candidates.push_back(step);
     }
 
-    return matchedRows;
+    std::vector<PlanStep> steps;
+    double rows = totalRows;
+    if (driver >= 0) {
+        steps.push_back(candidates[driver]);
+        rows = candidates[driver].estRows;
+    }
+
+    // 其余条件按选择率从高到低依次过滤候选行
+    std::vector<PlanStep> filters;
+    for (auto& step : candidates) {
+        if (static_cast<int>(step.cond) != driver) {
+            filters.push_back(step);
+        }
+    }
+    std::stable_sort(filters.begin(), filters.end(), [](const PlanStep& a, const PlanStep& b) {
+        return a.estRows < b.estRows;
+    });
+    // 驱动条件走索引时，其他有索引的条件也查索引，行号位图直接求交，不读取行数据
+    // 只有比逐行过滤候选行便宜时才这样做，这些步骤紧跟在驱动条件之后执行
+    if (driver >= 0 && candidates[driver].access == "index") {
+        std::vector<PlanStep> rest;
+        for (auto& step : filters) {
+            double cost = seekCosts[step.cond] + step.estRows * kBitmapEntryCost;
+            if (step.access != "index" || cost >= rows * kScanRowCost) {
+                rest.push_back(step);
+                continue;
+            }
+            double selectivity = totalRows > 0 ? step.estRows / totalRows : 0;
+            step.access = "bitmap";
+            step.cost = cost;
+            rows *= selectivity;
+            step.estRows = rows;
+            steps.push_back(step);
+        }
+        filters.swap(rest);
+    }
+    for (auto& step : filters) {
+        double selectivity = totalRows > 0 ? step.estRows / totalRows : 0;
+        step.access = steps.empty() ? "scan" : "filter";
+        step.cost = rows * kScanRowCost;
+        rows *= selectivity;
+        step.estRows = rows;
+        steps.push_back(step);
+    }
+    return steps;
 }
 
 std::vector<size_t> Table::search(
@@ -515,72 +680,212 @@ std::vector<size_t> Table::search(
 {
     std::vector<size_t> rowSet;  // 存储符合条件的行索引
     std::vector<size_t> result;
-    // 验证输入参数的合法性
-    if (conditions.size() != queryValues.size() || conditions.size() != operators.size()) {
-        throw std::invalid_argument("conditions, queryValues and operators must have the same size.");
-    }
+    bool scanAll = true;
 
-    // 优先使用主键索引进行查询
+    // 每个条件只编译一次: 解析列号和操作符，确定比较类型
+    std::vector<size_t> colIdxes;
+    std::vector<Predicate> preds;
+    colIdxes.reserve(conditions.size());
+    preds.reserve(conditions.size());
     for (size_t i = 0; i < conditions.size(); ++i) {
-        const std::string& columnName = conditions[i];
-        if (isPrimaryKey(columnName)) {
-            // 仅根据主键进行查询
-            rowSet = matchPrimaryKey(rowSet, queryValues[i], operators[i], columnName);
-            if (rowSet.empty())// 如果主键查询没有结果，直接返回空结果
-                return result;
-        }
+        colIdxes.push_back(getColumnIndex(conditions[i]));
+        preds.emplace_back(queryValues[i], operators[i]);
     }
 
-    // 使用索引进行查询
-    for (size_t i = 0; i < conditions.size(); ++i) {
-        const std::string& columnName = conditions[i];
-        if (columns_[getColumnIndex(columnName)].indexed) {
-            // 使用索引查找符合条件的行
-            rowSet = matchIndex(rowSet, queryValues[i], operators[i], columnName);
-            if (rowSet.empty())// 如果索引查询没有结果，直接返回空结果
-                return result;
+    // 全表扫描按 morsel 切分，在 DBService 的线程池上并发执行
+    auto& parallel = ParallelScan::getInstance();
+    size_t totalRows = store_->size();
+    constexpr size_t kMorsel = ParallelScan::kMorselRows;
+
+    // 没有驱动条件时，开头连续的全表过滤条件在选择位图上求交，最后再转换为行号
+    std::vector<uint64_t> selection, bits;
+    bool bitmapPhase = false;
+    auto flushSelection = [&]() {
+        rowSet.clear();
+        simd::bitmapToRows(selection, totalRows, rowSet);
+        bitmapPhase = false;
+    };
+    // 驱动索引和之后的 bitmap 步骤在行号位图上求交，最后再转换为物理位置
+    RoaringBitmap indexed;
+    bool indexPhase = false;
+    auto flushIndexed = [&]() {
+        rowSet.clear();
+        toSlots(indexed, rowSet);
+        indexPhase = false;
+    };
+
+    // 按计划依次执行: 先用驱动条件得到候选行，再逐列过滤
+    for (const auto& step : plan(conditions, queryValues, operators)) {
+        size_t colIdx = colIdxes[step.cond];
+        const auto& pred = preds[step.cond];
+        if (step.access == "index" || step.access == "bitmap") {
+            auto ids = matchIndex(pred, colIdx);
+            if (indexPhase) {
+                indexed &= ids;
+            } else {
+                indexed = std::move(ids);
+            }
+            indexPhase = true;
+            scanAll = false;
+            if (indexed.empty())
+                return rowSet;
+            continue;
+        }
+        if (indexPhase) {
+            flushIndexed();
+        }
+        if ((scanAll || bitmapPhase) && step.access != "pk"
+            && store_->vectorized(colIdx, pred)) {
+            // 每个 morsel 只写自己的那段位图
+            if (!bitmapPhase) {
+                selection.resize((totalRows + 63) / 64);
+                bits.resize(selection.size());
+            }
+            uint64_t* out = bitmapPhase ? bits.data() : selection.data();
+            parallel.run(totalRows, kMorsel, [&](size_t, size_t begin, size_t end) {
+                store_->filterBitmap(colIdx, pred, begin, end, out);
+                if (bitmapPhase) {
+                    for (size_t w = begin / 64; w < (end + 63) / 64; ++w) {
+                        selection[w] &= bits[w];
+                    }
+                } else if (deletedCount_ > 0) {
+                    // 第一次生成位图时去掉已删除的行
+                    for (size_t w = begin / 64; w < std::min((end + 63) / 64, deleted_.size()); ++w) {
+                        selection[w] &= ~deleted_[w];
+                    }
+                }
+            });
+            bitmapPhase = true;
+            scanAll = false;
+            // 选中的行已经很少时，后续条件只检查候选行，不再整列扫描
+            size_t selected = 0;
+            for (uint64_t word : selection) {
+                selected += __builtin_popcountll(word);
+            }
+            if (selected * 8 < totalRows) {
+                flushSelection();
+                if (rowSet.empty())
+                    return rowSet;
+            }
+            continue;
+        }
+        if (bitmapPhase) {
+            flushSelection();
+            if (rowSet.empty())
+                return rowSet;
+        }
+        if (step.access == "pk") {
+            rowSet = matchPrimaryKey(rowSet, pred, colIdx);
+        } else if (scanAll) {
+            // 每个 morsel 的结果写入各自的缓冲区，按 morsel 顺序拼接后仍然按行号有序
+            std::vector<std::vector<size_t>> parts(ParallelScan::morselCount(totalRows, kMorsel));
+            parallel.run(totalRows, kMorsel, [&](size_t morsel, size_t begin, size_t end) {
+                auto& part = parts[morsel];
+                store_->filterRange(colIdx, pred, begin, end, part);
+                if (deletedCount_ > 0) {
+                    part.erase(std::remove_if(part.begin(), part.end(), [this](size_t rowIdx) {
+                        return isDeleted(rowIdx);
+                    }), part.end());
+                }
+            });
+            rowSet.clear();
+            for (const auto& part : parts) {
+                rowSet.insert(rowSet.end(), part.begin(), part.end());
+            }
+        } else {
+            result.clear();
+            store_->filter(colIdx, pred, &rowSet, result);
+            rowSet.swap(result);
         }
+        scanAll = false;
+        if (rowSet.empty())// 如果没有结果，直接返回空结果
+            return rowSet;
     }
 
-    // 如果没有主键查询&索引查询,就全文查询
-    if (rowSet.empty()) {
-        // 填充所有行的索引
-        for (size_t i = 0; i < rows_.size(); ++i) {
-            rowSet.push_back(i);
+    if (bitmapPhase) {
+        flushSelection();
+    }
+    if (indexPhase) {
+        flushIndexed();
+    }
+    if (scanAll) {
+        // 没有任何条件，返回所有未删除的行
+        rowSet.reserve(liveRows());
+        for (size_t i = 0; i < store_->size(); ++i) {
+            if (!isDeleted(i)) rowSet.push_back(i);
         }
     }
+    return rowSet;
+}
 
-    // 遍历 rowSet 中的所有行，检查每行是否满足所有查询条件
-    for (size_t rowIdx : rowSet) {
-        const auto& row = rows_[rowIdx];
-        bool match = true;
+json Table::explain(
+    const std::vector<std::string>& conditions,
+    const std::vector<FieldValue>& queryValues,
+    const std::vector<std::string>& operators
+) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);  // 使用读锁，确保线程安全
+    getColumnTypes(conditions);
 
-        // 检查该行是否满足所有条件
-        for (size_t condIdx = 0; condIdx < conditions.size(); ++condIdx) {
-            if (isPrimaryKey(conditions[condIdx]) || columns_[getColumnIndex(conditions[condIdx])].indexed) 
-            //主键和索引已经在上面检查过了
-                continue;
-            size_t colIdx = getColumnIndex(conditions[condIdx]);
-            const auto& fieldValue = row[colIdx].getValue();
-            const auto& queryValue = queryValues[condIdx];
-            const auto& op = operators[condIdx];
-
-            // 使用模板比较函数，判断查询值与索引值是否匹配
-            bool conditionMatch = compare(fieldValue, queryValue, op);
-
-            // 使用 std::visit 比较字段值
-            if (!conditionMatch) {
-                match = false;
-                break;  // 如果某个条件不匹配，跳过该行
-            }
+    json j;
+    j["name"] = name_;
+    j["type"] = type_;
+    j["storage"] = storageModetoString(storage_);
+    j["rows"] = liveRows();
+    j["deleted"] = deletedCount_;
+    j["steps"] = json::array();
+    double totalCost = 0;
+    for (const auto& step : plan(conditions, queryValues, operators)) {
+        json s;
+        s["column"] = conditions[step.cond];
+        s["op"] = operators[step.cond];
+        s["value"] = valuetoJson(queryValues[step.cond]);
+        s["access"] = step.access;
+        s["estRows"] = step.estRows;
+        s["cost"] = step.cost;
+        if (step.access == "index" || step.access == "bitmap") {
+            s["stats"] = getIndexStats(conditions[step.cond])->toJson();
         }
+        totalCost += step.cost;
+        j["steps"].push_back(s);
+    }
+    if (conditions.empty()) {
+        totalCost = static_cast<double>(store_->size());
+    }
+    j["cost"] = totalCost;
+    return j;
+}
 
-        // 如果该行满足所有条件，将其加入结果集
-        if (match) {
-            result.push_back(rowIdx);
+bool Table::isPointQuery(
+    const std::vector<std::string>& conditions,
+    const std::vector<FieldValue>& queryValues,
+    const std::vector<std::string>& operators,
+    size_t limit,
+    size_t maxRows
+) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (conditions.size() != queryValues.size() || conditions.size() != operators.size()) {
+        throw std::invalid_argument("conditions, queryValues and operators must have the same size.");
+    }
+    bool allProbes = !conditions.empty();
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        const auto& column = columns_[getColumnIndex(conditions[i])];
+        if (operators[i] != "==" || !(column.primaryKey || column.indexed)) {
+            allProbes = false;
+            continue;
+        }
+        // 主键最多命中一行；索引按值直接查 posting，行数是准确的
+        if (column.primaryKey) {
+            return true;
+        }
+        auto it = indexes_.find(column.name);
+        const auto* posting = it == indexes_.end() ? nullptr : it->second.find(Field(queryValues[i]));
+        if (posting == nullptr || posting->size() <= maxRows) {
+            return true;
         }
     }
-    return result;
+    return allProbes && limit <= maxRows;
 }
 
 std::vector<std::vector<FieldValue>> Table::query(
@@ -589,7 +894,8 @@ std::vector<std::vector<FieldValue>> Table::query(
     const std::vector<FieldValue>& queryValues,        // 查询条件值
     const std::vector<std::string>& operators,     // 比较操作符（对应每个条件）
     int offset,
-    int limit
+    int limit,
+    std::vector<RowId>* rowIds
 ) const
 {
     std::shared_lock<std::shared_mutex> lock(mutex_);  // 使用读锁，确保线程安全
@@ -601,6 +907,13 @@ std::vector<std::vector<FieldValue>> Table::query(
 
     std::vector<size_t> rowSet = search(conditions, queryValues, operators);
 
+    // 预先解析列号，避免逐行查找列名
+    std::vector<size_t> colIdxes;
+    colIdxes.reserve(columnNames.size());
+    for (const auto& columnName : columnNames) {
+        colIdxes.push_back(getColumnIndex(columnName));
+    }
+
     size_t totalRows = rowSet.size();
 
     // 如果 offset 超过了总行数，直接返回空结果
@@ -617,20 +930,73 @@ std::vector<std::vector<FieldValue>> Table::query(
     // 遍历 rowSet 中的所有行，在 startIdx 和 endIdx 之间
     for (size_t i = startIdx; i < endIdx; ++i) {
         std::vector<FieldValue> fieldValues;
+        fieldValues.reserve(colIdxes.size());
         size_t rowIdx = rowSet[i];
 
-        // 检查该行是否满足所有条件
-        for (auto& columnName : columnNames) {
-            size_t colIdx = getColumnIndex(columnName);
-            fieldValues.push_back(rows_[rowIdx][colIdx].getValue());
+        // 读取选择的列
+        for (size_t colIdx : colIdxes) {
+            fieldValues.push_back(store_->getValue(rowIdx, colIdx));
         }
 
-        result.push_back(fieldValues);
+        result.push_back(std::move(fieldValues));
+        if (rowIds) {
+            rowIds->push_back(rowIds_[rowIdx]);
+        }
     }
 
     return result;
 }
 
+std::vector<RowId> Table::queryRowIds(
+    const std::vector<std::string>& conditions,
+    const std::vector<FieldValue>& queryValues,
+    const std::vector<std::string>& operators) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    getColumnTypes(conditions);
+
+    std::vector<size_t> rowSet = search(conditions, queryValues, operators);
+    std::vector<RowId> ids;
+    ids.reserve(rowSet.size());
+    for (size_t rowIdx : rowSet) {
+        ids.push_back(rowIds_[rowIdx]);
+    }
+    return ids;
+}
+
+std::vector<std::vector<FieldValue>> Table::getRowsById(
+    const std::vector<std::string>& columnNames,
+    const RowId* ids,
+    size_t count,
+    std::vector<RowId>* found) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<size_t> colIdxes;
+    colIdxes.reserve(columnNames.size());
+    for (const auto& columnName : columnNames) {
+        colIdxes.push_back(getColumnIndex(columnName));
+    }
+
+    std::vector<std::vector<FieldValue>> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        RowId id = ids[i];
+        // 游标打开后被删除的行
+        if (id >= slots_.size() || slots_[id] == kNoSlot) continue;
+        size_t rowIdx = slots_[id];
+        std::vector<FieldValue> fieldValues;
+        fieldValues.reserve(colIdxes.size());
+        for (size_t colIdx : colIdxes) {
+            fieldValues.push_back(store_->getValue(rowIdx, colIdx));
+        }
+        result.push_back(std::move(fieldValues));
+        if (found) {
+            found->push_back(id);
+        }
+    }
+    return result;
+}
+
 size_t Table::update(
     const std::vector<std::string>& columnNames,
     const std::vector<FieldValue>& newValues,
@@ -649,49 +1015,54 @@ size_t Table::update(
     }
     
 
-    for (const auto& columnName : columnNames) {
-        size_t colIdx = getColumnIndex(columnName);
+    std::vector<size_t> colIdxes;
+    colIdxes.reserve(columnNames.size());
+    for (size_t i = 0; i < columnNames.size(); ++i) {
+        size_t colIdx = getColumnIndex(columnNames[i]);
         if (columns_[colIdx].primaryKey) {
             throw std::invalid_argument("Updating primary key is not allowed.");
         }
+        // 列存按类型存放，值类型必须与列类型一致
+        if (storage_ == StorageMode::COLUMN && !Field(newValues[i]).typeMatches(columns_[colIdx].type)) {
+            throw std::invalid_argument("Invalid type for FieldValue: " + columnNames[i]);
+        }
+        colIdxes.push_back(colIdx);
     }
 
     std::vector<size_t> rowSet = search(conditions, queryValues, operators);
     // 遍历 rowSet 中的所有行
     for (size_t rowIdx : rowSet) {
         for (size_t i = 0; i < columnNames.size(); ++i) {
-            size_t colIdx = getColumnIndex(columnNames[i]);
+            size_t colIdx = colIdxes[i];
             const auto& newValue = Field(newValues[i]);
-            const auto& oldValue = rows_[rowIdx][colIdx];
+            const auto oldValue = Field(store_->getValue(rowIdx, colIdx));
 
             // 如果更新的是主键列
             if (columns_[colIdx].primaryKey) {
                 // 检查主键唯一性（排除当前行）
                 if (primaryKeyIndex_.find(newValue) != primaryKeyIndex_.end()) {
-                    if (primaryKeyIndex_[newValue] != rowIdx) {
+                    if (primaryKeyIndex_[newValue] != rowIds_[rowIdx]) {
                         throw std::invalid_argument("Primary key uniqueness violated.");
                     }
                 }
                 auto& index = primaryKeyIndex_;
                 index.erase(oldValue);  // 移除旧的主键值
-                index[newValue] = rowIdx;  // 添加新的主键值
+                index[newValue] = rowIds_[rowIdx];  // 添加新的主键值
             }
 
             // 如果更新的是索引列
             if (indexes_.find(columnNames[i]) != indexes_.end()) {
                 auto& index = indexes_[columnNames[i]];
-                index[oldValue].erase(rowIdx);  // 从索引中移除旧值
-                if (index[oldValue].empty()) {
-                    index.erase(oldValue);  // 如果集合为空，移除该索引条目
-                }
-                index[newValue].insert(rowIdx);  // 添加新值到索引
+                index.erase(oldValue, rowIds_[rowIdx]);  // 从索引中移除旧值，posting 为空时自动移除该键
+                index.insert(newValue, rowIds_[rowIdx]);  // 添加新值到索引
             }
 
             // 更新实际数据
-            rows_[rowIdx][colIdx] = newValue;
+            store_->setValue(rowIdx, colIdx, newValues[i]);
         }
     }
 
+    modCount_ += rowSet.size();
     return rowSet.size();
 }
 
@@ -705,35 +1076,68 @@ size_t Table::remove(
     // 验证输入参数的合法性
     getColumnTypes(conditions);
     std::vector<size_t> rowSet = search(conditions, queryValues, operators);
-    // 按降序排列 rowSet
-    std::sort(rowSet.rbegin(), rowSet.rend());
+    // 只在删除位图中标记，行号不变，其他行的索引项不需要修改
+    deleted_.resize((store_->size() + 63) / 64);
     for (size_t rowIdx : rowSet) {
+        deleted_[rowIdx >> 6] |= 1ULL << (rowIdx & 63);
+        slots_[rowIds_[rowIdx]] = kNoSlot;
+    }
+
+    for (size_t colIdx = 0; colIdx < columns_.size(); ++colIdx) {
         // 更新主键索引
-        for (size_t colIdx = 0; colIdx < columns_.size(); ++colIdx) {
-            if (columns_[colIdx].primaryKey) {
-                const auto& primaryKeyValue = rows_[rowIdx][colIdx];
-                primaryKeyIndex_.erase(primaryKeyValue);
+        if (columns_[colIdx].primaryKey) {
+            for (size_t rowIdx : rowSet) {
+                primaryKeyIndex_.erase(store_->getValue(rowIdx, colIdx));
             }
         }
-
-        // 更新列索引
-        for (size_t colIdx = 0; colIdx < columns_.size(); ++colIdx) {
-            const auto& columnName = columns_[colIdx].name;
-            if (columns_[colIdx].indexed) {
-                auto& index = indexes_[columnName];
-                const auto& value = rows_[rowIdx][colIdx];
-                index[value].erase(rowIdx);  // 从索引中移除
-                if (index[value].empty()) {
-                    index.erase(value);  // 如果集合为空，移除索引条目
+        // 更新列索引: 按键分组，每个 posting 只遍历一次
+        if (columns_[colIdx].indexed) {
+            auto& index = indexes_[columns_[colIdx].name];
+            std::vector<std::pair<Field, RowId>> entries;
+            entries.reserve(rowSet.size());
+            for (size_t rowIdx : rowSet) {
+                entries.emplace_back(store_->getValue(rowIdx, colIdx), rowIds_[rowIdx]);
+            }
+            std::sort(entries.begin(), entries.end());
+            std::vector<RowId> rowIds;
+            for (size_t i = 0; i < entries.size();) {
+                size_t j = i;
+                rowIds.clear();
+                for (; j < entries.size() && !(entries[i].first < entries[j].first); ++j) {
+                    rowIds.push_back(entries[j].second);
                 }
+                index.erase(entries[i].first, rowIds);
+                i = j;
             }
         }
-        // 从 rows_ 中删除行
-        rows_.erase(rows_.begin()+rowIdx);
     }
+    deletedCount_ += rowSet.size();
+    modCount_ += rowSet.size();
     return rowSet.size();
 }
 
+bool Table::compact(bool force) {
+    std::unique_lock<std::shared_mutex> lock(mutex_); // 使用写锁，确保线程安全
+    // 已删除的行超过 1/8 时才值得重写存储
+    if (deletedCount_ == 0 || (!force && deletedCount_ * 8 < store_->size())) {
+        return false;
+    }
+
+    store_->compact(deleted_);
+    // 行号不变，只需要更新保留行的槽位，索引和主键索引不需要改动
+    size_t out = 0;
+    for (size_t rowIdx = 0; rowIdx < rowIds_.size(); ++rowIdx) {
+        if (isDeleted(rowIdx)) continue;
+        rowIds_[out] = rowIds_[rowIdx];
+        slots_[rowIds_[out]] = out;
+        out++;
+    }
+    rowIds_.resize(out);
+    std::vector<uint64_t>().swap(deleted_);
+    deletedCount_ = 0;
+    return true;
+}
+
 json Table::rowsToJson(const std::vector<Row>& rows) {
     json jsonRows = json::array();
     for (const auto& row : rows) {
@@ -759,6 +1163,7 @@ json Table::toJson() const{
     json jsonTable;
     jsonTable["name"] = name_;
     jsonTable["type"] = type_;
+    jsonTable["storage"] = storageModetoString(storage_);
     jsonTable["columns"] = columnsToJson(); // 调用封装函数
     //jsonTable["rows"] = rowsToJson(rows_);          // 调用封装函数
     return jsonTable;
@@ -768,8 +1173,13 @@ json Table::toJson() const{
 json Table::showRows() {
     std::shared_lock<std::shared_mutex> lock(mutex_); // 共享锁
 
+    std::vector<Row> rows;
+    rows.reserve(liveRows());
+    for (size_t i = 0; i < store_->size(); ++i) {
+        if (!isDeleted(i)) rows.push_back(store_->getRow(i));
+    }
     json jsonRows;
-    jsonRows["rows"] = rowsToJson(rows_);
+    jsonRows["rows"] = rowsToJson(rows);
     return jsonRows;
 }
 
@@ -778,6 +1188,7 @@ void Table::saveSchema(const std::string& filePath) {
     json root;
     root["name"] = name_;
     root["type"] = "table";
+    root["storage"] = storageModetoString(storage_);
     root["columns"] = columnsToJson();
 
     // 将 JSON 写入文件
@@ -790,68 +1201,71 @@ void Table::saveSchema(const std::string& filePath) {
 }
 
 void Table::exportToBinaryFile(const std::string& filePath) {
-    std::ofstream outFile(filePath, std::ios::binary);
-    if (!outFile.is_open()) {
-        throw std::runtime_error("Failed to open file for writing: " + filePath);
-    }
+    snapshot()(filePath);
+}
 
-    size_t rowsWrite = 0;
-    size_t numRows = rows_.size();
-    size_t numColumns = columns_.size();
-    const size_t bufferSize = 32 * 1024; // 固定缓冲区大小为 128KB
-    char* buffer = new char[bufferSize];
-    size_t bufferUsed = 0;
+DataContainer::Writer Table::snapshot() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    // 存储只复制块指针，之后的修改会复制被共享的块，写文件期间不阻塞修改
+    std::shared_ptr<const TableStore> store = store_->clone();
+    size_t numRows = liveRows();   // 已删除的行不写入文件
+    std::vector<FieldType> types;
+    for (const auto& column : columns_) {
+        types.push_back(column.type);
+    }
+    return [store, deleted = deleted_, numRows, types](const std::string& filePath) {
+        tablefile::write(filePath, *store, deleted, numRows, types);
+    };
+}
 
-    auto flushBuffer = [&]() {
-        if (bufferUsed > 0) {
-            outFile.write(buffer, bufferUsed);
-            bufferUsed = 0;
+void Table::importFromBinaryFile(const std::string& filePath) {
+    auto file = std::make_shared<const tablefile::MappedFile>(filePath);
+    if (!tablefile::isPaged(*file)) {
+        file.reset();
+        importLegacyFile(filePath);
+        // 转换为新格式，下次启动时直接映射，写入失败时旧文件保持不变
+        try {
+            snapshot()(filePath);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to convert " << filePath << " to the paged format: " << e.what() << '\n';
         }
-    };
+        return;
+    }
+    auto layout = tablefile::parse(*file);
+    if (layout.columns.size() != columns_.size()) {
+        throw std::runtime_error("Column count mismatch in binary file.");
+    }
+    std::vector<FieldType> types;
+    for (const auto& column : columns_) {
+        types.push_back(column.type);
+    }
 
-    // 写入行数和列数
-    if (bufferUsed + sizeof(numRows) + sizeof(numColumns) > bufferSize) {
-        flushBuffer();
-    }
-    memcpy(buffer + bufferUsed, &numRows, sizeof(numRows));
-    bufferUsed += sizeof(numRows);
-    memcpy(buffer + bufferUsed, &numColumns, sizeof(numColumns));
-    bufferUsed += sizeof(numColumns);
-
-    // 写入数据
-    for (const auto& row : rows_) {
-        for (const auto& field : row) {
-            // 假设 FieldValue 有一个 toBinary 方法，可以将自身序列化为二进制格式
-            std::string binaryData = field.toBinary();
-            size_t dataSize = binaryData.size();
-
-            // 检查缓冲区是否有足够空间容纳新数据
-            if (bufferUsed + sizeof(dataSize) + dataSize > bufferSize) {
-                flushBuffer();
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    store_ = TableStore::load(storage_, types, std::move(file), layout);
+    std::vector<uint64_t>().swap(deleted_);
+    deletedCount_ = 0;
+    // 文件中的行依次分配行号
+    slots_.resize(store_->size());
+    std::iota(slots_.begin(), slots_.end(), size_t(0));
+    rowIds_.assign(slots_.begin(), slots_.end());
+    ++modCount_;
+
+    // 只解码主键列和索引列
+    primaryKeyIndex_.clear();
+    for (size_t colIdx = 0; colIdx < columns_.size(); ++colIdx) {
+        if (!columns_[colIdx].primaryKey) continue;
+        primaryKeyIndex_.reserve(store_->size());
+        for (size_t rowIdx = 0; rowIdx < store_->size(); ++rowIdx) {
+            if (!primaryKeyIndex_.emplace(Field(store_->getValue(rowIdx, colIdx)), rowIdx).second) {
+                throw std::runtime_error("Duplicate primary key in binary file: " + columns_[colIdx].name);
             }
-
-            memcpy(buffer + bufferUsed, &dataSize, sizeof(dataSize));
-            bufferUsed += sizeof(dataSize);
-            memcpy(buffer + bufferUsed, binaryData.data(), dataSize);
-            bufferUsed += dataSize;
-        }
-        rowsWrite++;
-        if (rowsWrite % 10000 == 0) {
-            std::cout << ".";
-            std::cout.flush();
         }
     }
-
-    // 刷新剩余缓冲区内容
-    flushBuffer();
-
-    std::cout << std::endl;
-    delete[] buffer;
-    outFile.close();
+    buildIndex();
 }
 
-
-void Table::importFromBinaryFile(const std::string& filePath) {
+// 旧格式: [行数][列数]，之后逐个单元格 [长度][Field::toBinary]
+void Table::importLegacyFile(const std::string& filePath) {
     std::ifstream inFile(filePath, std::ios::binary);
     if (!inFile.is_open()) {
         throw std::runtime_error("Failed to open file for reading: " + filePath);
@@ -866,8 +1280,13 @@ void Table::importFromBinaryFile(const std::string& filePath) {
     if (numColumns != columns_.size()) {
         throw std::runtime_error("Column count mismatch in binary file.");
     }
-    rows_.clear();
-    rows_.reserve(numRows);
+    store_->clear();
+    store_->reserve(numRows);
+    primaryKeyIndex_.clear();
+    std::vector<size_t>().swap(slots_);
+    std::vector<RowId>().swap(rowIds_);
+    std::vector<uint64_t>().swap(deleted_);
+    deletedCount_ = 0;
 
     // 读取数据
     for (size_t i = 0; i < numRows; ++i) {
@@ -885,12 +1304,7 @@ void Table::importFromBinaryFile(const std::string& filePath) {
         }
         //rows_.push_back(row);
         this->insertRow(row);
-        if (i % 10000 == 0) {
-            std::cout << ".";
-            std::cout.flush();
-        }
     }
-    std::cout << std::endl;
     inFile.close();
     buildIndex();
 }
@@ -2,14 +2,15 @@
 #define Table_HPP
 #include "datacontainer.hpp"
 
-#include "field.hpp"
+#include "tablestore.hpp"
+#include "btreeindex.hpp"
+#include "indexstats.hpp"
 
-using Row = std::vector<Field>;
-// Define an index type
-using Index = std::map<Field, std::set<size_t>>;
+// Define an index type: 有序 B+ 树，键 -> 行号位图 posting list
+using Index = BTreeIndex;
 
-// 定义主键索引
-using PrimaryKeyIndex = std::unordered_map<Field, size_t, Field::Hash>;
+// 定义主键索引: 主键值 -> 行号
+using PrimaryKeyIndex = std::unordered_map<Field, RowId, Field::Hash>;
 
 class Table: public DataContainer {
 public:
@@ -51,6 +52,8 @@ public:
     // Indexing methods
     void buildIndex();
     void createIndex(const std::string& columnName);
+    // 先校验所有列并在临时索引中构建，全部成功后才加入表；任何一列失败时表上的索引不变
+    void createIndexes(const std::vector<std::string>& columnNames);
     void dropIndex(const std::string& columnName);
     std::vector<Row> getWithLimitAndOffset(int limit, int offset) const;
     
@@ -58,6 +61,7 @@ public:
     std::vector<FieldType> getColumnTypes(const std::vector<std::string>& columnNames) const;
     std::string getColumnType(const std::string& columnName) const;
     bool isPrimaryKey(const std::string& columnName) const;
+    StorageMode getStorageMode() const { return storage_; }
 
     
     std::vector<std::vector<FieldValue>> query(
@@ -66,7 +70,21 @@ public:
         const std::vector<FieldValue>& queryValues,        // 查询条件值
         const std::vector<std::string>& operators,     // 比较操作符（对应每个条件）
         int offset,
-        int limit = 100
+        int limit = 100,
+        std::vector<RowId>* rowIds = nullptr     // 不为空时输出每个结果行的行号
+    ) const;
+    // 只返回满足条件的行号，供游标分批读取
+    std::vector<RowId> queryRowIds(
+        const std::vector<std::string>& conditions,
+        const std::vector<FieldValue>& queryValues,
+        const std::vector<std::string>& operators
+    ) const;
+    // 按行号读取选择的列，跳过已删除的行，found 输出实际读到的行号
+    std::vector<std::vector<FieldValue>> getRowsById(
+        const std::vector<std::string>& columnNames,
+        const RowId* ids,
+        size_t count,
+        std::vector<RowId>* found
     ) const;
     size_t update(
         const std::vector<std::string>& columnNames,  // 待更新的列名
@@ -80,6 +98,23 @@ public:
         const std::vector<FieldValue>& queryValues,        // 查询条件值
         const std::vector<std::string>& operators     // 比较操作符（对应每个条件）
     );
+    // 移除已删除的行并更新槽位表，索引不需要改动，force 为 false 时只在删除比例超过阈值时执行
+    bool compact(bool force = false);
+    // 返回查询计划: 驱动条件、访问方式、各步骤的估算行数和代价
+    json explain(
+        const std::vector<std::string>& conditions,
+        const std::vector<FieldValue>& queryValues,
+        const std::vector<std::string>& operators
+    ) const;
+    // 查询只涉及少量行时返回 true: 主键等值，命中不超过 maxRows 行的索引等值，
+    // 或 limit 不超过 maxRows 且所有条件都是索引等值（只查索引，不逐行过滤）；供调度区分点操作和扫描
+    bool isPointQuery(
+        const std::vector<std::string>& conditions,
+        const std::vector<FieldValue>& queryValues,
+        const std::vector<std::string>& operators,
+        size_t limit,
+        size_t maxRows
+    ) const;
 
     json rowsToJson(const std::vector<Row>& rows);
     std::vector<Row> jsonToRows(const json& jsonRows);
@@ -90,35 +125,69 @@ public:
     //void importFromFile(const std::string& filePath);
     virtual void saveSchema(const std::string& filePath) override;
     virtual void exportToBinaryFile(const std::string& filePath) override;
+    virtual Writer snapshot() const override;
     virtual void importFromBinaryFile(const std::string& filePath) override;
 private:
     bool validateRow(const Row& row) ;
     bool validatePrimaryKey(const Row& row) ;
     void updateIndexes(const Row& row, int rowIndex);
     void updateIndexesBatch(const std::vector<size_t>& rowIdxes);
+    size_t appendRow(Row&& row);
+    // 校验整批（包括本批内的主键重复）后追加并批量更新索引，返回插入的行数；调用方持有写锁
+    size_t appendRows(const std::vector<Row>& rows);
+    void importLegacyFile(const std::string& filePath);
     Row processRowDefaults(const Row& row) const;
 
     std::vector<size_t> matchPrimaryKey(
         const std::vector<size_t>& rowSet,
-        const FieldValue& queryValue,
-        const std::string& op,
-        const std::string& columnName
-    ) const;
-    std::vector<size_t> matchIndex(
-        const std::vector<size_t>& rowSet,
-        const FieldValue& queryValue,
-        const std::string& op,
-        const std::string& columnName
+        const Predicate& pred,
+        size_t colIdx
     ) const;
+    // 索引列上满足条件的行号
+    RoaringBitmap matchIndex(const Predicate& pred, size_t colIdx) const;
     std::vector<size_t> search(const std::vector<std::string>& conditions,   // 查询条件列
         const std::vector<FieldValue>& queryValues,        // 查询条件值
         const std::vector<std::string>& operators     // 比较操作符（对应每个条件）
     ) const;
+
+    // 查询计划中的一步
+    struct PlanStep {
+        size_t cond;            // 条件下标
+        std::string access;     // pk / index: 索引查找，bitmap: 查索引后与之前的索引结果按位图求交，scan: 全表过滤，filter: 过滤候选行
+        double estRows;         // 估算的输出行数
+        double cost;            // 估算代价
+    };
+    // 按统计信息估算每个条件的选择率，选择驱动条件并按选择率排列其余条件
+    std::vector<PlanStep> plan(const std::vector<std::string>& conditions,
+        const std::vector<FieldValue>& queryValues,
+        const std::vector<std::string>& operators
+    ) const;
+    std::shared_ptr<const IndexStats> getIndexStats(const std::string& columnName) const;
+    void invalidateStats(const std::string& columnName);
+
+    bool isDeleted(size_t rowIdx) const { return deletedCount_ > 0 && testBit(deleted_, rowIdx); }
+    // 把索引查找得到的行号转换为当前的物理位置，按位置升序
+    void toSlots(const RoaringBitmap& ids, std::vector<size_t>& rowIdxes) const;
+    size_t liveRows() const { return store_->size() - deletedCount_; }
 private:
     std::vector<Column> columns_;
-    std::vector<Row> rows_;
+    StorageMode storage_ = StorageMode::ROW;
+    TableStore::ptr store_ = std::make_unique<RowStore>();
     std::map<std::string, Index> indexes_;  // Indexes on the columns (if any)
     PrimaryKeyIndex primaryKeyIndex_; 
+    // 索引保存稳定的行号，槽位表记录行号对应的物理位置，compact 移动行时只更新槽位表
+    // 行号按插入顺序递增，compact 保持行的相对顺序，所以行号和物理位置的顺序一致
+    static constexpr size_t kNoSlot = SIZE_MAX;
+    std::vector<size_t> slots_;     // 行号 -> 物理位置，已删除的行为 kNoSlot
+    std::vector<RowId> rowIds_;     // 物理位置 -> 行号
+    // 删除时在位图中标记物理位置，compact 时才真正移除
+    std::vector<uint64_t> deleted_;
+    size_t deletedCount_ = 0;
+
+    // 索引统计信息，查询时按需重建，读锁下也可能更新，单独加锁
+    mutable std::mutex statsMutex_;
+    mutable std::unordered_map<std::string, std::shared_ptr<const IndexStats>> stats_;
+    size_t modCount_ = 0;   // 行修改计数，用于判断统计信息是否过期
 };
 
 #endif // Table_H
@@ -0,0 +1,302 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include "tablefile.hpp"
+
+namespace tablefile {
+
+namespace {
+
+constexpr char kMagic[8] = {'M', 'E', 'M', 'D', 'B', 'T', 'B', 'L'};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pageSize;
+    uint64_t rows;
+    uint64_t columns;
+};
+
+// 偏移都是相对文件开头的字节数
+struct ColumnEntry {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t nulls;
+    uint64_t values;
+    uint64_t valuesLength;
+    uint64_t offsets;
+};
+
+size_t bitmapWords(size_t rows) {
+    return (rows + 63) / 64;
+}
+
+size_t fixedWidth(FieldType type) {
+    switch (type) {
+        case FieldType::INT: return sizeof(int32_t);
+        case FieldType::DOUBLE: return sizeof(double);
+        case FieldType::TIME: return sizeof(std::time_t);
+        default: return 0;
+    }
+}
+
+bool variableLength(FieldType type) {
+    return fixedWidth(type) == 0 && type != FieldType::BOOL;
+}
+
+// 带缓冲的顺序写入，记录当前位置用于填写列目录
+class Sink {
+public:
+    explicit Sink(std::ofstream& out) : out_(out) { buffer_.reserve(kBufferSize); }
+
+    void append(const void* data, size_t len) {
+        if (buffer_.size() + len > kBufferSize) {
+            flush();
+        }
+        if (len > kBufferSize) {
+            out_.write(static_cast<const char*>(data), len);
+        } else {
+            const char* p = static_cast<const char*>(data);
+            buffer_.insert(buffer_.end(), p, p + len);
+        }
+        pos_ += len;
+    }
+    template <typename T>
+    void append(const T& value) {
+        append(&value, sizeof(T));
+    }
+    // 补零到 alignment 的倍数
+    void align(size_t alignment) {
+        static const char zeros[kPageSize] = {};
+        append(zeros, (alignment - pos_ % alignment) % alignment);
+    }
+    void flush() {
+        out_.write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+    uint64_t pos() const { return pos_; }
+
+private:
+    static constexpr size_t kBufferSize = 1 << 20;
+    std::ofstream& out_;
+    std::vector<char> buffer_;
+    uint64_t pos_ = 0;
+};
+
+void appendBytes(Sink& sink, std::vector<uint64_t>& offsets, uint64_t& length, const char* data, size_t len) {
+    sink.append(data, len);
+    length += len;
+    offsets.push_back(length);
+}
+
+bool syncPath(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+void writeFile(const std::string& filePath, const TableStore& store, const std::vector<uint64_t>& deleted,
+    size_t rows, const std::vector<FieldType>& types) {
+    std::ofstream outFile(filePath, std::ios::binary | std::ios::trunc);
+    if (!outFile.is_open()) {
+        throw std::runtime_error("Failed to open file for writing: " + filePath);
+    }
+
+    Sink sink(outFile);
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.pageSize = kPageSize;
+    header.rows = rows;
+    header.columns = types.size();
+    std::vector<ColumnEntry> entries(types.size());
+    sink.append(header);
+    sink.append(entries.data(), entries.size() * sizeof(ColumnEntry));
+
+    for (size_t colIdx = 0; colIdx < types.size(); ++colIdx) {
+        FieldType type = types[colIdx];
+        auto& entry = entries[colIdx];
+        entry.type = static_cast<uint32_t>(type);
+
+        // 值直接写出，空值位图、BOOL 位图和偏移先收集在内存中，写在值之后
+        std::vector<uint64_t> nulls(bitmapWords(rows)), bools, offsets;
+        if (type == FieldType::BOOL) {
+            bools.resize(bitmapWords(rows));
+        } else if (variableLength(type)) {
+            offsets.reserve(rows + 1);
+            offsets.push_back(0);
+        }
+        sink.align(kPageSize);
+        entry.values = sink.pos();
+        size_t out = 0;
+        for (size_t rowIdx = 0; rowIdx < store.size(); ++rowIdx) {
+            if (testBit(deleted, rowIdx)) continue;
+            FieldValue value = store.getValue(rowIdx, colIdx);
+            bool isNull = std::holds_alternative<std::monostate>(value);
+            if (isNull) {
+                nulls[out >> 6] |= 1ULL << (out & 63);
+            }
+            switch (type) {
+                case FieldType::INT: sink.append(int32_t(isNull ? 0 : std::get<int>(value))); break;
+                case FieldType::DOUBLE: sink.append(isNull ? 0.0 : std::get<double>(value)); break;
+                case FieldType::TIME: sink.append(isNull ? std::time_t(0) : std::get<std::time_t>(value)); break;
+                case FieldType::BOOL:
+                    if (!isNull && std::get<bool>(value)) bools[out >> 6] |= 1ULL << (out & 63);
+                    break;
+                case FieldType::STRING: {
+                    const char* data = isNull ? nullptr : std::get<std::string>(value).data();
+                    size_t len = isNull ? 0 : std::get<std::string>(value).size();
+                    appendBytes(sink, offsets, entry.valuesLength, data, len);
+                    break;
+                }
+                case FieldType::BINARY: {
+                    const auto* bytes = isNull ? nullptr : &std::get<std::vector<uint8_t>>(value);
+                    appendBytes(sink, offsets, entry.valuesLength,
+                        bytes ? reinterpret_cast<const char*>(bytes->data()) : nullptr, bytes ? bytes->size() : 0);
+                    break;
+                }
+                default: {
+                    std::string binary = isNull ? std::string() : Field(value).toBinary();
+                    appendBytes(sink, offsets, entry.valuesLength, binary.data(), binary.size());
+                    break;
+                }
+            }
+            out++;
+        }
+        if (out != rows) {
+            throw std::runtime_error("Row count mismatch while writing " + filePath);
+        }
+        if (type == FieldType::BOOL) {
+            sink.append(bools.data(), bools.size() * sizeof(uint64_t));
+        }
+        if (fixedWidth(type) > 0 || type == FieldType::BOOL) {
+            entry.valuesLength = sink.pos() - entry.values;
+        }
+        sink.align(sizeof(uint64_t));
+        entry.nulls = sink.pos();
+        sink.append(nulls.data(), nulls.size() * sizeof(uint64_t));
+        if (variableLength(type)) {
+            entry.offsets = sink.pos();
+            sink.append(offsets.data(), offsets.size() * sizeof(uint64_t));
+        }
+    }
+    sink.flush();
+
+    // 回填列目录
+    outFile.seekp(sizeof(FileHeader));
+    outFile.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(ColumnEntry));
+    outFile.close();
+    if (!outFile || !syncPath(filePath)) {
+        throw std::runtime_error("Failed to write file: " + filePath);
+    }
+}
+
+} // namespace
+
+MappedFile::MappedFile(const std::string& filePath) {
+    int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file for reading: " + filePath);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat file: " + filePath);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+        void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Failed to map file: " + filePath + ": " + std::strerror(errno));
+        }
+        data_ = static_cast<const char*>(addr);
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+bool isPaged(const MappedFile& file) {
+    return file.size() >= sizeof(kMagic) && std::memcmp(file.data(), kMagic, sizeof(kMagic)) == 0;
+}
+
+Layout parse(const MappedFile& file) {
+    if (file.size() < sizeof(FileHeader)) {
+        throw std::runtime_error("Table file is truncated.");
+    }
+    FileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.version != kVersion) {
+        throw std::runtime_error("Unsupported table file version: " + std::to_string(header.version));
+    }
+    if (header.columns > (file.size() - sizeof(FileHeader)) / sizeof(ColumnEntry)) {
+        throw std::runtime_error("Table file is truncated.");
+    }
+
+    Layout layout;
+    layout.rows = header.rows;
+    layout.columns.reserve(header.columns);
+    auto inFile = [&](uint64_t offset, uint64_t length) {
+        return offset % sizeof(uint64_t) == 0 && offset <= file.size() && length <= file.size() - offset;
+    };
+    for (size_t i = 0; i < header.columns; ++i) {
+        ColumnEntry entry;
+        std::memcpy(&entry, file.data() + sizeof(FileHeader) + i * sizeof(ColumnEntry), sizeof(entry));
+        ColumnBlock block{static_cast<FieldType>(entry.type), nullptr, nullptr, entry.valuesLength, nullptr};
+        size_t width = fixedWidth(block.type);
+        bool ok = inFile(entry.nulls, bitmapWords(header.rows) * sizeof(uint64_t)) && inFile(entry.values, entry.valuesLength);
+        if (width > 0) {
+            ok = ok && entry.valuesLength == header.rows * width;
+        } else if (block.type == FieldType::BOOL) {
+            ok = ok && entry.valuesLength == bitmapWords(header.rows) * sizeof(uint64_t);
+        } else {
+            ok = ok && inFile(entry.offsets, (header.rows + 1) * sizeof(uint64_t));
+            block.offsets = ok ? reinterpret_cast<const uint64_t*>(file.data() + entry.offsets) : nullptr;
+        }
+        if (!ok) {
+            throw std::runtime_error("Table file is corrupted at column " + std::to_string(i));
+        }
+        block.nulls = reinterpret_cast<const uint64_t*>(file.data() + entry.nulls);
+        block.values = file.data() + entry.values;
+        layout.columns.push_back(block);
+    }
+    return layout;
+}
+
+void write(const std::string& filePath, const TableStore& store, const std::vector<uint64_t>& deleted,
+    size_t rows, const std::vector<FieldType>& types) {
+    // 先写临时文件并落盘，再 rename 覆盖目标，中途失败或崩溃时旧文件保持完整
+    std::string tmpPath = filePath + ".tmp";
+    try {
+        writeFile(tmpPath, store, deleted, rows, types);
+    } catch (...) {
+        std::error_code ec;
+        std::filesystem::remove(tmpPath, ec);
+        throw;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, filePath, ec);
+    if (ec) {
+        std::filesystem::remove(tmpPath, ec);
+        throw std::runtime_error("Failed to replace file: " + filePath);
+    }
+    auto dir = std::filesystem::path(filePath).parent_path();
+    if (!syncPath(dir.empty() ? "." : dir.string())) {
+        throw std::runtime_error("Failed to sync directory of " + filePath);
+    }
+}
+
+}
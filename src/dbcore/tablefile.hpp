@@ -0,0 +1,59 @@
+#ifndef TABLEFILE_HPP
+#define TABLEFILE_HPP
+
+#include <memory>
+#include "tablestore.hpp"
+
+// 表数据文件（版本 2）: 文件头 + 列目录 + 按页对齐的列块，可以直接 mmap，列在第一次访问时才解码
+// 每列由三段组成，位置记录在列目录中:
+//   空值位图: 每 64 行一个 uint64
+//   值: INT/DOUBLE/TIME 为定长数组，BOOL 为位图，其他类型为各行字节依次拼接（DOCUMENT 为 Field::toBinary）
+//   偏移: 变长类型每行在值中的起始位置，共 rows + 1 个 uint64，定长类型没有这一段
+// 旧格式（逐个单元格写入）的文件没有魔数，仍然可以读取
+namespace tablefile {
+
+constexpr uint32_t kVersion = 2;
+constexpr size_t kPageSize = 4096;
+
+// 只读映射整个文件
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filePath);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// 映射文件中一列的位置，指针在 MappedFile 的生命周期内有效
+struct ColumnBlock {
+    FieldType type;
+    const uint64_t* nulls;
+    const char* values;
+    size_t valuesLength;
+    const uint64_t* offsets;    // 定长类型为空
+};
+
+struct Layout {
+    size_t rows;
+    std::vector<ColumnBlock> columns;
+};
+
+// 文件以魔数开头时为新格式，否则是旧格式
+bool isPaged(const MappedFile& file);
+// 校验文件头和列目录，版本不支持或越界时抛出异常
+Layout parse(const MappedFile& file);
+// 把 store 中未删除的 rows 行写入文件: 写临时文件、fsync、rename 覆盖旧文件、fsync 目录
+// 正在映射旧文件的读者不受影响
+void write(const std::string& filePath, const TableStore& store, const std::vector<uint64_t>& deleted,
+    size_t rows, const std::vector<FieldType>& types);
+
+}
+
+#endif
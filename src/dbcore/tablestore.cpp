@@ -0,0 +1,128 @@
+#include "tablestore.hpp"
+#include "columnstore.hpp"
+
+StorageMode storageModefromString(const std::string& mode) {
+    if (mode == "row") return StorageMode::ROW;
+    if (mode == "column") return StorageMode::COLUMN;
+    throw std::invalid_argument("Unsupported storage mode: " + mode);
+}
+
+std::string storageModetoString(const StorageMode& mode) {
+    switch (mode) {
+        case StorageMode::COLUMN: return "column";
+        default: return "row";
+    }
+}
+
+TableStore::ptr TableStore::create(StorageMode mode, const std::vector<FieldType>& types) {
+    if (mode == StorageMode::COLUMN) {
+        return std::make_unique<ColumnStore>(types);
+    }
+    return std::make_unique<RowStore>();
+}
+
+TableStore::ptr TableStore::load(StorageMode mode, const std::vector<FieldType>& types,
+    std::shared_ptr<const tablefile::MappedFile> file, const tablefile::Layout& layout) {
+    if (layout.columns.size() != types.size()) {
+        throw std::runtime_error("Column count mismatch in table file.");
+    }
+    if (mode == StorageMode::COLUMN) {
+        return std::make_unique<ColumnStore>(types, std::move(file), layout);
+    }
+    // 逐列解码后填入各行，同一时间只多占用一列的内存
+    std::vector<Row> rows(layout.rows, Row(types.size()));
+    for (size_t colIdx = 0; colIdx < types.size(); ++colIdx) {
+        ColumnVector column(types[colIdx]);
+        column.load(layout.columns[colIdx], layout.rows);
+        for (size_t rowIdx = 0; rowIdx < layout.rows; ++rowIdx) {
+            rows[rowIdx][colIdx] = Field(column.get(rowIdx));
+        }
+    }
+    auto store = std::make_unique<RowStore>();
+    store->reserve(rows.size());
+    for (auto& row : rows) {
+        store->append(std::move(row));
+    }
+    return store;
+}
+
+void TableStore::filterBitmap(size_t colIdx, const Predicate& pred, size_t begin, size_t end, uint64_t* bits) const {
+    std::vector<size_t> rows;
+    filterRange(colIdx, pred, begin, end, rows);
+    std::fill(bits + begin / 64, bits + (end + 63) / 64, 0);
+    for (size_t rowIdx : rows) {
+        bits[rowIdx >> 6] |= 1ULL << (rowIdx & 63);
+    }
+}
+
+RowStore::Chunk& RowStore::mutableChunk(size_t chunkIdx) {
+    auto& chunk = chunks_[chunkIdx];
+    if (chunk.use_count() > 1) {
+        chunk = std::make_shared<Chunk>(*chunk);
+    }
+    return *chunk;
+}
+
+void RowStore::append(Row&& row) {
+    if (size_ % kChunkRows == 0) {
+        chunks_.push_back(std::make_shared<Chunk>());
+        chunks_.back()->reserve(kChunkRows);
+    }
+    mutableChunk(chunks_.size() - 1).push_back(std::move(row));
+    size_++;
+}
+
+void RowStore::compact(const std::vector<uint64_t>& deleted) {
+    // 第一个被删除的行之前的块保持不变，之后的行重新分块
+    size_t first = 0;
+    while (first < size_ && !testBit(deleted, first)) {
+        first++;
+    }
+    if (first == size_) {
+        return;
+    }
+    std::vector<std::shared_ptr<Chunk>> chunks(chunks_.begin(), chunks_.begin() + first / kChunkRows);
+    size_t out = first / kChunkRows * kChunkRows;
+    for (size_t chunkIdx = first / kChunkRows; chunkIdx < chunks_.size(); ++chunkIdx) {
+        // 未被快照共享的块可以直接移走其中的行
+        bool owned = chunks_[chunkIdx].use_count() == 1;
+        auto& rows = *chunks_[chunkIdx];
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (testBit(deleted, chunkIdx * kChunkRows + i)) continue;
+            if (out % kChunkRows == 0) {
+                chunks.push_back(std::make_shared<Chunk>());
+                chunks.back()->reserve(kChunkRows);
+            }
+            chunks.back()->push_back(owned ? std::move(rows[i]) : rows[i]);
+            out++;
+        }
+    }
+    chunks_.swap(chunks);
+    size_ = out;
+}
+
+template <typename Rows>
+void RowStore::filterRows(size_t colIdx, const Predicate& pred, const Rows& rowIdxes, std::vector<size_t>& out) const {
+    // 类型和操作符在循环外确定，循环内只做类型化比较
+    pred.visit([&](const auto& match) {
+        for (size_t rowIdx : rowIdxes) {
+            if (match(row(rowIdx)[colIdx].getValue())) {
+                out.push_back(rowIdx);
+            }
+        }
+    });
+}
+
+void RowStore::filter(size_t colIdx, const Predicate& pred,
+    const std::vector<size_t>* candidates, std::vector<size_t>& out) const {
+    if (candidates) {
+        filterRows(colIdx, pred, *candidates, out);
+    } else {
+        filterRows(colIdx, pred, RowRange{0, size_}, out);
+    }
+}
+
+void RowStore::filterRange(size_t colIdx, const Predicate& pred,
+    size_t begin, size_t end, std::vector<size_t>& out) const {
+    filterRows(colIdx, pred, RowRange{begin, end}, out);
+}
@@ -0,0 +1,129 @@
+#ifndef TABLESTORE_HPP
+#define TABLESTORE_HPP
+
+#include <vector>
+#include <memory>
+#include "field.hpp"
+#include "predicate.hpp"
+
+using Row = std::vector<Field>;
+
+// 表的物理存储方式
+enum class StorageMode {
+    ROW,    // 行存: std::vector<Row>
+    COLUMN  // 列存: 每列一个类型化的连续数组
+};
+
+StorageMode storageModefromString(const std::string& mode);
+std::string storageModetoString(const StorageMode& mode);
+
+namespace tablefile {
+class MappedFile;
+struct Layout;
+}
+
+// 位图中第 idx 位是否为 1，超出位图长度的位视为 0
+inline bool testBit(const std::vector<uint64_t>& bits, size_t idx) {
+    size_t w = idx >> 6;
+    return w < bits.size() && ((bits[w] >> (idx & 63)) & 1);
+}
+
+// 连续行号 [first, last)，与候选行列表共用同一套过滤循环
+struct RowRange {
+    size_t first, last;
+    struct iterator {
+        size_t i;
+        size_t operator*() const { return i; }
+        iterator& operator++() { ++i; return *this; }
+        bool operator!=(const iterator& o) const { return i != o.i; }
+    };
+    iterator begin() const { return {first}; }
+    iterator end() const { return {last}; }
+};
+
+// 表存储接口，Table 通过它访问行数据，不关心具体布局
+class TableStore {
+public:
+    using ptr = std::unique_ptr<TableStore>;
+    virtual ~TableStore() = default;
+
+    virtual StorageMode mode() const = 0;
+    virtual size_t size() const = 0;
+    virtual void reserve(size_t rows) = 0;
+    virtual void clear() = 0;
+
+    virtual void append(Row&& row) = 0;
+    virtual Row getRow(size_t rowIdx) const = 0;
+    virtual FieldValue getValue(size_t rowIdx, size_t colIdx) const = 0;
+    virtual void setValue(size_t rowIdx, size_t colIdx, const FieldValue& value) = 0;
+    // 一次性移除 deleted 位图中标记的行，其余行保持原有顺序
+    virtual void compact(const std::vector<uint64_t>& deleted) = 0;
+    // 复制出独立的存储，用于生成快照，实现应共享未修改的数据而不是深拷贝
+    virtual ptr clone() const = 0;
+
+    // 单列过滤: candidates 为空指针时扫描全部行，否则只检查候选行
+    // 结果按行号升序写入 out，只读取 colIdx 这一列
+    virtual void filter(size_t colIdx, const Predicate& pred,
+        const std::vector<size_t>* candidates, std::vector<size_t>& out) const = 0;
+    // 只扫描 [begin, end) 内的行，并行扫描时每个 morsel 调用一次
+    virtual void filterRange(size_t colIdx, const Predicate& pred,
+        size_t begin, size_t end, std::vector<size_t>& out) const = 0;
+
+    // 该列是否有向量化的位图过滤
+    virtual bool vectorized(size_t /*colIdx*/, const Predicate& /*pred*/) const { return false; }
+    // 把 [begin, end) 的过滤结果写入选择位图（每 64 行一个字，按全表行号寻址），begin 必须是 64 的倍数
+    virtual void filterBitmap(size_t colIdx, const Predicate& pred, size_t begin, size_t end, uint64_t* bits) const;
+
+    static ptr create(StorageMode mode, const std::vector<FieldType>& types);
+    // 从映射的数据文件创建: 列存在访问时按列解码，行存一次性转换成行
+    static ptr load(StorageMode mode, const std::vector<FieldType>& types,
+        std::shared_ptr<const tablefile::MappedFile> file, const tablefile::Layout& layout);
+};
+
+// 行存实现，行按固定大小分块，各块由快照共享，修改前复制被共享的块
+class RowStore : public TableStore {
+public:
+    StorageMode mode() const override { return StorageMode::ROW; }
+    size_t size() const override { return size_; }
+    void reserve(size_t rows) override { chunks_.reserve((rows + kChunkRows - 1) / kChunkRows); }
+    void clear() override {
+        std::vector<std::shared_ptr<Chunk>>().swap(chunks_);
+        size_ = 0;
+    }
+
+    void append(Row&& row) override;
+    Row getRow(size_t rowIdx) const override { return row(rowIdx); }
+    FieldValue getValue(size_t rowIdx, size_t colIdx) const override {
+        return row(rowIdx)[colIdx].getValue();
+    }
+    void setValue(size_t rowIdx, size_t colIdx, const FieldValue& value) override {
+        mutableChunk(rowIdx / kChunkRows)[rowIdx % kChunkRows][colIdx].setValue(value);
+    }
+    void compact(const std::vector<uint64_t>& deleted) override;
+    // 只复制块指针
+    ptr clone() const override { return std::make_unique<RowStore>(*this); }
+
+    void filter(size_t colIdx, const Predicate& pred,
+        const std::vector<size_t>* candidates, std::vector<size_t>& out) const override;
+    void filterRange(size_t colIdx, const Predicate& pred,
+        size_t begin, size_t end, std::vector<size_t>& out) const override;
+
+private:
+    using Chunk = std::vector<Row>;
+    static constexpr size_t kChunkRows = 1024;
+
+    const Row& row(size_t rowIdx) const {
+        return (*chunks_[rowIdx / kChunkRows])[rowIdx % kChunkRows];
+    }
+    // 块同时被快照持有时先复制一份
+    // 只在写锁下调用，此时不会有新的快照共享该块
+    Chunk& mutableChunk(size_t chunkIdx);
+
+    template <typename Rows>
+    void filterRows(size_t colIdx, const Predicate& pred, const Rows& rowIdxes, std::vector<size_t>& out) const;
+
+    std::vector<std::shared_ptr<Chunk>> chunks_;
+    size_t size_ = 0;
+};
+
+#endif
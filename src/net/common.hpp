@@ -10,6 +10,8 @@
 #include "util/util.hpp"
 
 #define TCP_BUFFER_SIZE 1460
+// 握手时协商的分段大小上限，未协商（旧版本对端）时按 TCP_BUFFER_SIZE 分段
+#define TCP_MAX_SEGMENT_SIZE (64 * 1024)
 template <typename T>
 class IObserver {
 public:
@@ -63,6 +65,8 @@ class IDataCallback {
 public:
     virtual void on_data_received(int len,int msg_id) = 0;  // 回调处理逻辑
     virtual DataVariant& get_data() = 0;  // 获取数据缓存
+    // 返回 false 时暂停向该回调输出数据，数据留在 CircularBuffer 中，写入方因此等待
+    virtual bool writable() { return true; }
     virtual ~IDataCallback() = default; // 虚析构函数
 };
 
@@ -231,11 +231,28 @@ bool decryptData(const std::vector<unsigned char>& key,
     const std::vector<unsigned char>& ciphertext,  
     std::vector<unsigned char>& decryptedData,
     const std::vector<unsigned char>& associatedData) {
-
     if (ciphertext.size() < (AES_GCM_nonce_len + AES_GCM_tag_len)) { 
         std::cerr << "Ciphertext too short!" << std::endl;
         return false;
     }
+    decryptedData.resize(ciphertext.size() - AES_GCM_nonce_len - AES_GCM_tag_len);
+    size_t len = 0;
+    if (!decryptData(key, ciphertext.data(), ciphertext.size(), decryptedData.data(), len, associatedData)) {
+        return false;
+    }
+    decryptedData.resize(len);
+    return true;
+}
+
+bool decryptData(const std::vector<unsigned char>& key,
+    const unsigned char* ciphertext, size_t size,
+    unsigned char* decrypted, size_t& decryptedLen,
+    const std::vector<unsigned char>& associatedData) {
+
+    if (size < (AES_GCM_nonce_len + AES_GCM_tag_len)) { 
+        std::cerr << "Ciphertext too short!" << std::endl;
+        return false;
+    }
 
     EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
     if (!ctx) {
@@ -243,18 +260,12 @@ bool decryptData(const std::vector<unsigned char>& key,
         return false;
     }
 
-    // 提取 Nonce
-    std::vector<unsigned char> nonce(AES_GCM_nonce_len);
-    std::memcpy(nonce.data(), ciphertext.data(), nonce.size());
-
-    // 提取密文 (去掉 Nonce 和 Tag)
-    size_t encryptedDataLen = ciphertext.size() - nonce.size() - AES_GCM_tag_len;
-    std::vector<unsigned char> encryptedData(encryptedDataLen);
-    std::memcpy(encryptedData.data(), ciphertext.data() + nonce.size(), encryptedDataLen);
-
-    // 提取认证标签
+    // 格式: Nonce + 密文 + 认证标签，各部分直接在输入上引用，不再复制
+    const unsigned char* nonce = ciphertext;
+    size_t encryptedDataLen = size - AES_GCM_nonce_len - AES_GCM_tag_len;
+    const unsigned char* encryptedData = ciphertext + AES_GCM_nonce_len;
     unsigned char tag[AES_GCM_tag_len];
-    std::memcpy(tag, ciphertext.data() + nonce.size() + encryptedDataLen, AES_GCM_tag_len);
+    std::memcpy(tag, encryptedData + encryptedDataLen, AES_GCM_tag_len);
 
     // 初始化解密
     if (1 != EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, nullptr, nullptr)) {
@@ -264,7 +275,7 @@ bool decryptData(const std::vector<unsigned char>& key,
     }
 
     // 设置密钥和 IV
-    if (1 != EVP_DecryptInit_ex(ctx, nullptr, nullptr, key.data(), nonce.data())) {
+    if (1 != EVP_DecryptInit_ex(ctx, nullptr, nullptr, key.data(), nonce)) {
         std::cerr << "Failed to set key and IV." << std::endl;
         EVP_CIPHER_CTX_free(ctx);
         return false;
@@ -280,8 +291,7 @@ bool decryptData(const std::vector<unsigned char>& key,
     }
 
     // 执行解密
-    decryptedData.resize(encryptedData.size());
-    if (1 != EVP_DecryptUpdate(ctx, decryptedData.data(), &len, encryptedData.data(), encryptedData.size())) {
+    if (1 != EVP_DecryptUpdate(ctx, decrypted, &len, encryptedData, encryptedDataLen)) {
         std::cerr << "Decryption failed." << std::endl;
         EVP_CIPHER_CTX_free(ctx);
         return false;
@@ -296,14 +306,14 @@ bool decryptData(const std::vector<unsigned char>& key,
     }
 
     // 结束解密
-    if (1 != EVP_DecryptFinal_ex(ctx, decryptedData.data() + plaintextLen, &len)) {
+    if (1 != EVP_DecryptFinal_ex(ctx, decrypted + plaintextLen, &len)) {
         std::cerr << "Decryption failed: Authentication failed." << std::endl;
         EVP_CIPHER_CTX_free(ctx);
         return false;
     }
     plaintextLen += len;
 
-    decryptedData.resize(plaintextLen);
+    decryptedLen = plaintextLen;
     EVP_CIPHER_CTX_free(ctx);
     return true;
 }
@@ -536,7 +546,11 @@ int compressData(const uint8_t* data, size_t size, std::vector<unsigned char>& c
 }
 
 int decompressData(const std::vector<unsigned char>& compressed, uint8_t* decompressed, size_t max_size) {
-    if (compressed.size() < sizeof(uint32_t)) {
+    return decompressData(compressed.data(), compressed.size(), decompressed, max_size);
+}
+
+int decompressData(const uint8_t* compressed, size_t size, uint8_t* decompressed, size_t max_size) {
+    if (size < sizeof(uint32_t)) {
         std::cerr << "Invalid compressed data" << std::endl;
         return -1;
     }
@@ -544,7 +558,7 @@ int decompressData(const std::vector<unsigned char>& compressed, uint8_t* decomp
     // 读取原始数据大小
     // 读取原始数据大小并转换回主机字节序
     uint32_t networkOrderSize;
-    std::memcpy(&networkOrderSize, compressed.data(), sizeof(uint32_t));
+    std::memcpy(&networkOrderSize, compressed, sizeof(uint32_t));
     uint32_t originalSize = ntohl(networkOrderSize);  // 转换回主机字节序
 
     if (originalSize > max_size) {
@@ -558,8 +572,8 @@ int decompressData(const std::vector<unsigned char>& compressed, uint8_t* decomp
     //decompressed.resize(decompressedSize);  // 预分配解压缓冲区
 
     int result = uncompress(decompressed, &decompressedSize,
-                            reinterpret_cast<const Bytef*>(compressed.data() + sizeof(uint32_t)),
-                            compressed.size() - sizeof(uint32_t));
+                            reinterpret_cast<const Bytef*>(compressed + sizeof(uint32_t)),
+                            size - sizeof(uint32_t));
 
     if (result != Z_OK) {
         std::cerr << "Decompression failed! Error code: " << result << std::endl;
@@ -42,6 +42,11 @@ bool decryptData(const std::vector<unsigned char>& key,
 	const std::vector<unsigned char>& ciphertext,  
 	std::vector<unsigned char>& decryptedData,
 	const std::vector<unsigned char>& associatedData = {});
+// 直接解密到 decrypted，长度至少为 size - AES_GCM_nonce_len - AES_GCM_tag_len，decryptedLen 输出明文长度
+bool decryptData(const std::vector<unsigned char>& key,
+	const unsigned char* ciphertext, size_t size,
+	unsigned char* decrypted, size_t& decryptedLen,
+	const std::vector<unsigned char>& associatedData = {});
 
 std::vector<uint8_t> generateSalt(size_t length = 16);
 std::string hashPassword(const std::string& password);
@@ -49,4 +54,5 @@ bool verifyPassword(const std::string& password, const std::string& stored_hash)
 
 int compressData(const uint8_t* data, size_t size, std::vector<unsigned char>& compressed);
 int decompressData(const std::vector<unsigned char>& compressed, uint8_t* decompressed, size_t max_size);
+int decompressData(const uint8_t* compressed, size_t size, uint8_t* decompressed, size_t max_size);
 #endif
\ No newline at end of file
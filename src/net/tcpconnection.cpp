@@ -7,8 +7,8 @@ TcpConnection::TcpConnection(tcp::socket socket, uint32_t id)
     : socket_(std::move(socket)),
       id_(id) {
     memset(read_buffer_, 0, sizeof(read_buffer_));
-    memset(write_buffer_, 0, sizeof(write_buffer_));
-    cached_data_ = std::make_tuple(write_buffer_, sizeof(write_buffer_), id_);
+    fill_.resize(kChunkSize);
+    cached_data_ = std::make_tuple(fill_.data(), int(fill_.size()), id_);
 }
 
 TcpConnection::~TcpConnection() {
@@ -43,28 +43,96 @@ void TcpConnection::stop() {
     notify_close_item(id_);
 }
 
+// Transport::on_send 持有发送锁依次调用，每次 len 字节已写入 fill_
 void TcpConnection::on_data_received(int len, int ) {
 	//std::cout << std::dec << get_timestamp() << " : PORT->TCP :" << std::this_thread::get_id() << std::endl;
     if (len > 0) {
-        //write(std::string(write_buffer_, len));
-        auto self(shared_from_this());
-        boost::asio::async_write(
-            socket_,
-            boost::asio::buffer(write_buffer_, len),
-            [this, self](boost::system::error_code ec, size_t bytes_transferred) {
-                if (!ec) {
-                #ifdef DEBUG
-                    std::cout << std::dec << "PID[" << std::this_thread::get_id() << "]["  << get_timestamp() 
-                        << "]TCP[" << id_ << "] SEND[" << bytes_transferred << "]: \n";
-                    //print_packet(reinterpret_cast<const uint8_t*>(write_buffer_),bytes_transferred);
-                #endif
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        queued_bytes_ += len;
+        if (static_cast<size_t>(len) <= kCopyLimit) {
+            // 小块 (点查询的响应) 按实际长度复制，不为每个响应占用一整块缓冲区
+            write_queue_.emplace_back(std::vector<char>(fill_.begin(), fill_.begin() + len), len);
+        } else {
+            write_queue_.emplace_back(std::move(fill_), len);
+            if (!free_chunks_.empty()) {
+                fill_ = std::move(free_chunks_.back());
+                free_chunks_.pop_back();
+            } else {
+                fill_.assign(kChunkSize, 0);
+            }
+            // on_send 通过引用读取缓存中的指针，下一次 output 写到新的缓冲区
+            cached_data_ = std::make_tuple(fill_.data(), int(fill_.size()), id_);
+        }
+        if (!writing_) {
+            writing_ = true;
+            do_write();
+        }
+    }
+}
+
+void TcpConnection::do_write() {
+    size_t count = std::min(write_queue_.size(), kMaxGather);
+    std::vector<boost::asio::const_buffer> buffers;
+    buffers.reserve(count);
+    // deque 在尾部追加时不会移动已有元素，发送期间 buffer 指向的数据保持有效
+    for (size_t i = 0; i < count; ++i) {
+        buffers.emplace_back(write_queue_[i].first.data(), write_queue_[i].second);
+    }
+    auto self(shared_from_this());
+    boost::asio::async_write(
+        socket_,
+        buffers,
+        [this, self, count](boost::system::error_code ec, size_t bytes_transferred) {
+            bool resume = false;
+            {
+                std::lock_guard<std::mutex> lock(write_mutex_);
+                for (size_t i = 0; i < count; ++i) {
+                    auto& chunk = write_queue_.front();
+                    queued_bytes_ -= chunk.second;
+                    // 只回收整块缓冲区，按长度复制的小块直接释放
+                    if (chunk.first.size() == kChunkSize && free_chunks_.size() < kMaxFreeChunks) {
+                        free_chunks_.push_back(std::move(chunk.first));
+                    }
+                    write_queue_.pop_front();
+                }
+                if (!ec && !write_queue_.empty()) {
+                    do_write();
                 } else {
-                    std::cerr << "Error on send: " << ec.message() << std::endl;
-                    stop();
+                    writing_ = false;
                 }
+                if (stalled_ && queued_bytes_ < kMaxQueuedBytes) {
+                    stalled_ = false;
+                    resume = !ec;
+                }
+            }
+            if (resume) {
+                // 暂停期间 Transport 中积压的数据继续发送，不持有 write_mutex_ 调用
+                if (auto port = transport_.lock()) {
+                    port->resume_output();
+                }
+            }
+            if (!ec) {
+            #ifdef DEBUG
+                std::cout << std::dec << "PID[" << std::this_thread::get_id() << "]["  << get_timestamp() 
+                    << "]TCP[" << id_ << "] SEND[" << bytes_transferred << "]: \n";
+            #else
+                (void)bytes_transferred;
+            #endif
+            } else {
+                std::cerr << "Error on send: " << ec.message() << std::endl;
+                stop();
             }
-        );
+        }
+    );
+}
+
+bool TcpConnection::writable() {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (queued_bytes_ >= kMaxQueuedBytes) {
+        stalled_ = true;
+        return false;
     }
+    return true;
 }
 
 DataVariant& TcpConnection::get_data() {
@@ -6,6 +6,7 @@
 #include <atomic>
 #include <iostream>
 #include <deque>
+#include <mutex>
 #include "common.hpp"
 
 using tcp = boost::asio::ip::tcp; // 简化命名空间
@@ -25,6 +26,8 @@ public:
 
     void on_data_received(int len, int ) override;
     DataVariant& get_data() override;
+    // 发送队列超过 kMaxQueuedBytes 时返回 false，对端读得慢时数据留在 Transport 的缓冲区中
+    bool writable() override;
     void set_transport(const std::shared_ptr<Transport>& transport) {
         transport_ = transport;
     }
@@ -33,7 +36,8 @@ public:
     }
 private:
     void do_read();          // 异步读取数据
-    //void do_write();         // 异步写入数据
+    // 把队列中已有的数据块作为一个 buffer 序列交给 async_write，一次系统调用发送多个块，调用时持有 write_mutex_
+    void do_write();
     void handle_read(const boost::system::error_code& ec, size_t bytes_transferred);
     
     //void handle_write(const boost::system::error_code& ec, size_t bytes_transferred);
@@ -42,8 +46,23 @@ private:
     uint32_t id_;
     std::weak_ptr<Transport> transport_;
     
-    char read_buffer_[TCP_BUFFER_SIZE];     // 读缓冲区
-    char write_buffer_[TCP_BUFFER_SIZE];    // 写缓冲区
+    // 数据块: second 为有效长度；小块按长度复制，大块直接取走 kChunkSize 的缓冲区
+    using Chunk = std::pair<std::vector<char>, size_t>;
+    static constexpr size_t kChunkSize = TCP_MAX_SEGMENT_SIZE;
+    static constexpr size_t kCopyLimit = kChunkSize / 4;            // 不超过该长度的块复制一份入队，fill_ 继续使用
+    static constexpr size_t kMaxGather = 64;     // 一次 async_write 最多发送的块数
+    static constexpr size_t kMaxFreeChunks = 4;  // 每个连接最多保留的空闲缓冲区
+    static constexpr size_t kMaxQueuedBytes = 16 * kChunkSize;      // 发送队列的上限
+
+    char read_buffer_[TCP_MAX_SEGMENT_SIZE];    // 读缓冲区
+    // Transport 把待发送的数据写入 fill_，写满一次后整个缓冲区移入发送队列，换一个空闲缓冲区继续写
+    std::vector<char> fill_;
+    std::mutex write_mutex_;
+    std::deque<Chunk> write_queue_;             // 等待发送和正在发送的块
+    size_t queued_bytes_ = 0;                   // write_queue_ 中的字节数
+    std::vector<std::vector<char>> free_chunks_;
+    bool writing_ = false;                      // 有一个 async_write 未完成
+    bool stalled_ = false;                      // writable 返回过 false，发送完成后需要恢复输出
     DataVariant cached_data_;    // 数据缓存
 };
 #endif // TCPCONNECTION_HPP
\ No newline at end of file
@@ -11,7 +11,8 @@ size_t Transport::max_message_size_ = get_env_var("MAX_MESSAGE_SIZE", size_t(10*
 uint32_t Transport::message_timeout_ = get_env_var("TRANSPORT_TIMEOUT", uint32_t(100));
 
 Transport::Transport(/*boost::asio::io_context& io_ctx_rx, boost::asio::io_context& io_ctx_tx,*/ uint32_t id)
-    : app_to_tcp_(circular_buffer_size_),
+    : segment_scratch_(max_segment_size_),
+      app_to_tcp_(circular_buffer_size_),
       tcp_to_app_(circular_buffer_size_),
       //io_context_{io_contexts[0], io_contexts[1]},  // 初始化指针数组
       //timer_{ Timer(io_ctx_tx, 0, false, [this](int, int, std::thread::id) { this->on_send(); }),
@@ -34,6 +35,7 @@ Transport::~Transport() {
 }
 
 void Transport::stop() {
+    stopped_.store(true, std::memory_order_release);
     callbacks_.clear();
     #ifdef DEBUG
     std::cout << "transport " << this->id_ << " stop" << std::endl;
@@ -52,6 +54,9 @@ void Transport::on_send() {
                     if (port_id == this->id_) {
                         std::lock_guard<std::mutex> lock(mutex_[0]);
                         do {
+                            if (!callback->writable()) {
+                                break;
+                            }
                             int len = this->output(buffer, buffer_size, std::chrono::milliseconds(0));
                             if (len > 0) {
                                 #ifdef DEBUG
@@ -85,7 +90,7 @@ void Transport::on_input() {
                     std::lock_guard<std::mutex> lock(mutex_[1]);
                     while (true) {
                         uint32_t id;
-                        int len = this->read(app_data->data(), id, max_cache_size, std::chrono::milliseconds(0));
+                        int len = this->read(*app_data, id, max_cache_size, std::chrono::milliseconds(0));
                         if (len > 0) {
                             #ifdef DEBUG
                             //std::cout << std::dec << get_timestamp() << " : PORT[" << port_id << "]->APP :" << std::this_thread::get_id() << std::endl;
@@ -129,6 +134,10 @@ void Transport::triger_event(ChannelType type) {
 
 // 计算校验和
 uint32_t Transport::calculateChecksum(const std::vector<uint8_t>& data) {
+    return calculateChecksum(data.data(), data.size());
+}
+
+uint32_t Transport::calculateChecksum(const uint8_t* data, size_t size) {
     static const uint32_t polynomial = 0xEDB88320;
     static uint32_t crc_table[256];
     static bool table_generated = false;
@@ -145,8 +154,8 @@ uint32_t Transport::calculateChecksum(const std::vector<uint8_t>& data) {
     }
 
     uint32_t crc = 0xFFFFFFFF;
-    for (uint8_t c : data) {
-        crc = (crc >> 8) ^ crc_table[(crc & 0xFF) ^ c];
+    for (size_t i = 0; i < size; ++i) {
+        crc = (crc >> 8) ^ crc_table[(crc & 0xFF) ^ data[i]];
     }
 
     return ~crc;
@@ -180,41 +189,6 @@ std::vector<char> Transport::serializeMsg(const Msg& msg) {
         return buffer;
 }
 
-// 反序列化网络字节序为 Msg
-Msg Transport::deserializeMsg(const std::vector<char>& buffer) {
-    if (buffer.size() < sizeof(MsgHeader) + sizeof(MsgFooter)) {
-        throw std::runtime_error("Invalid Msg size");
-    }
-
-    Msg msg;
-    size_t offset = 0;
-
-    // 反序列化消息头并转换为主机字节序
-    MsgHeader header_net;
-    std::memcpy(&header_net, buffer.data() + offset, sizeof(MsgHeader));
-    offset += sizeof(MsgHeader);
-
-    msg.header.length = ntohl(header_net.length); // 转换为主机字节序
-    msg.header.msg_id = ntohl(header_net.msg_id);
-    msg.header.segment_id = ntohl(header_net.segment_id);
-	msg.header.flag = ntohl(header_net.flag);
-
-    // 反序列化负载
-    size_t payload_size = buffer.size() - sizeof(MsgHeader) - sizeof(MsgFooter);
-    if (payload_size > 0) {
-        msg.payload.resize(payload_size);
-        std::memcpy(msg.payload.data(), buffer.data() + offset, payload_size);
-        offset += payload_size;
-    }
-
-    // 反序列化消息尾并转换为主机字节序
-    MsgFooter footer_net;
-    std::memcpy(&footer_net, buffer.data() + offset, sizeof(MsgFooter));
-    msg.footer.checksum = ntohl(footer_net.checksum);
-    return msg;
-}
-
-
 int Transport::send(const uint8_t* data, size_t size, uint32_t msg_id, std::chrono::milliseconds timeout) {
     std::vector<uint8_t> compressedData;
     const uint8_t* dataToSend = data;
@@ -238,6 +212,7 @@ int Transport::send(const uint8_t* data, size_t size, uint32_t msg_id, std::chro
         total_size = compressedData.size();
     }
 
+    const size_t segment_size = segment_size_;
 	while (offset < total_size) {
         size_t chunk_size;
         Msg msg;
@@ -255,7 +230,7 @@ int Transport::send(const uint8_t* data, size_t size, uint32_t msg_id, std::chro
         if (encryptMode_) {
             msg.header.flag |= FLAG_ENCRYPTED;
             chunk_size = std::min(total_size - offset, 
-                segment_size_-sizeof(MsgHeader)-sizeof(MsgFooter)-encrypt_size_increment_);
+                segment_size-sizeof(MsgHeader)-sizeof(MsgFooter)-encrypt_size_increment_);
             msg.payload.assign(dataToSend + offset, dataToSend + offset + chunk_size);
             std::vector<unsigned char> encrypted_segment;
             encryptData(sessionKey_tx_, msg.payload, encrypted_segment);
@@ -266,7 +241,7 @@ int Transport::send(const uint8_t* data, size_t size, uint32_t msg_id, std::chro
             msg.payload.clear();  // 避免意外情况
             msg.payload = std::move(encrypted_segment);
         } else {
-            chunk_size = std::min(total_size - offset, segment_size_-sizeof(MsgHeader) - sizeof(MsgFooter));
+            chunk_size = std::min(total_size - offset, segment_size-sizeof(MsgHeader) - sizeof(MsgFooter));
             msg.header.length = chunk_size + sizeof(MsgHeader) + sizeof(MsgFooter);
             msg.payload.assign(dataToSend + offset, dataToSend + offset + chunk_size);
         }
@@ -285,6 +260,7 @@ int Transport::send(const uint8_t* data, size_t size, uint32_t msg_id, std::chro
 
 
 		std::vector<char> network_data = serializeMsg(msg);
+        std::unique_lock<std::mutex> producer(send_mutex_);
         int ret = app_to_tcp_.write(network_data.data(), network_data.size(), timeout);
 		if (ret<0) {
             on_send();
@@ -294,11 +270,18 @@ int Transport::send(const uint8_t* data, size_t size, uint32_t msg_id, std::chro
             std::cout << "app -> CircularBuffer fail and retry" << std::endl;
             #endif
             ret = app_to_tcp_.write(network_data.data(), network_data.size(), timeout);
+            // 第一片之前超时可以整条放弃；已经发出部分分片后只能等对端读走，
+            // 否则对端收到的是缺少后续分片的消息，直到端口关闭才放弃
+            while (ret < 0 && offset > 0 && !stopped_.load(std::memory_order_acquire)) {
+                on_send();
+                ret = app_to_tcp_.write(network_data.data(), network_data.size(), timeout);
+            }
             if(ret<0) {
                 std::cerr << "app -> CircularBuffer fail" << std::endl;
                 return -1; // 写入超时
             }
 		}
+        producer.unlock();
         on_send();
         #ifdef DEBUG
 		//std::cout << get_timestamp() << " APP->PORT :" << std::this_thread::get_id() << std::endl;
@@ -341,120 +324,146 @@ int Transport::input(const char* buffer, size_t size, std::chrono::milliseconds
     return ret;
 }
 
-int Transport::read(uint8_t* data, uint32_t& msg_id, size_t size, std::chrono::milliseconds timeout) {
-    while (true) {
-        // 检查并处理已完成的消息
-        for (auto it = message_cache.begin(); it != message_cache.end();) {
-            auto& buffer = it->second;
-            int readSize = buffer.total_size;
-            if (!buffer.is_complete) {
-                ++it;
-                continue;
-            }
-            // 重组消息
-            std::vector<uint8_t> reconstructed_data;
-            reconstructed_data.reserve(buffer.total_size);
-            for (const auto& [segment_id, segment_data] : buffer.segments) {
-                reconstructed_data.insert(reconstructed_data.end(), segment_data.begin(), segment_data.end());
-            }
-        
-            msg_id = it->first;  // 记录消息 ID
-            
-            if (buffer.is_compressed) {
-                readSize = decompressData(reconstructed_data, data, size);
-                if (readSize <= 0) {
-                    std::cerr << "Decompression failed! Error code: " << readSize << std::endl;
-                    it = message_cache.erase(it);  // 清理损坏的消息
-                    continue; // 继续处理下一个消息
-                }
-            } else {
-                memcpy(data, reconstructed_data.data(), reconstructed_data.size());
-            }
-            // 清理已完成的消息
-            it = message_cache.erase(it);
-            return readSize; // 处理完成后返回
-        }
-        
-        // 读取消息长度
-        uint32_t dataLen;
-        if (tcp_to_app_.peek(reinterpret_cast<char*>(&dataLen), sizeof(uint32_t), timeout) < 0) {
-            return -1; // 超时
-        }
-        dataLen = ntohl(dataLen);
-
-        if (dataLen > segment_size_ || dataLen <= sizeof(uint32_t)) {
-            std::cout << "Wrong Msg size: " << dataLen << " clear the data" << std::endl;
-            //tcp_to_app_.read(reinterpret_cast<char*>(&dataLen), sizeof(uint32_t), timeout); // 跳过无效数据
-            tcp_to_app_.clear();
-            return -2;
-        }
-        std::vector<char> temp_buffer(dataLen);
-        // 读取完整分包
-        if (tcp_to_app_.read(temp_buffer.data(), dataLen, timeout) < 0) {
-            //std::cout << "Read timeout\n";
-            return -1; // 超时
-        }
-
-        // 反序列化消息
-        Msg msg = deserializeMsg(temp_buffer);
-
-        //crc check
-        uint32_t crc = calculateChecksum(msg.payload);
-        if (msg.footer.checksum != crc) {
-            // Print CRC in hexadecimal format
-            std::cout << "crc error: 0x" << std::hex 
-                << std::uppercase << std::setfill('0') 
-                << std::setw(8) << crc << std::endl;
-            return -3;
-        }
-        //如果对端切换key
-        if (msg.header.flag & FLAG_KEY_UPDATE) {
-            switchToNewKeys();
-        }
-        // 如果对端加密，直接把模式改成加密
-        if (msg.header.flag & FLAG_ENCRYPTED) {
-            std::vector<uint8_t> decrypted_segment;
-            if (!decryptData(sessionKey_rx_, msg.payload, decrypted_segment)) {
-                std::cerr << "Warning: Decryption failed for msg: " << msg.header.msg_id << std::endl;
-                return -4;
-            }
-            // 只有解密成功，才设置加密模式，防止错误状态
-            setEncryptMode(true);
-            msg.payload = std::move(decrypted_segment);
-        } else {
-            setEncryptMode(false);
-        }
+void Transport::dropMessage(std::map<uint32_t, MessageBuffer>::iterator it) {
+    if (buffer_pool_.size() < max_cache_size_) {
+        buffer_pool_.push_back(std::move(it->second.data));
+    }
+    message_cache.erase(it);
+}
 
-        // 查找或创建缓存项
-        auto& buffer = message_cache[msg.header.msg_id];
-        //if (buffer.last_update == std::chrono::steady_clock::time_point::min()) {
-            buffer.last_update = std::chrono::steady_clock::now();
-        //}
-        buffer.is_compressed = msg.header.flag & FLAG_COMPRESSED;
+int Transport::readSegment(size_t size, std::chrono::milliseconds timeout, uint32_t& msg_id) {
+    // 读取消息长度
+    uint32_t dataLen;
+    if (tcp_to_app_.peek(reinterpret_cast<char*>(&dataLen), sizeof(uint32_t), timeout) < 0) {
+        return -1; // 超时
+    }
+    dataLen = ntohl(dataLen);
 
-        // 累计总大小
-        buffer.total_size += msg.payload.size();
+    if (dataLen > max_segment_size_ || dataLen < sizeof(MsgHeader) + sizeof(MsgFooter)) {
+        std::cout << "Wrong Msg size: " << dataLen << " clear the data" << std::endl;
+        //tcp_to_app_.read(reinterpret_cast<char*>(&dataLen), sizeof(uint32_t), timeout); // 跳过无效数据
+        tcp_to_app_.clear();
+        return -2;
+    }
+    // 等完整分包到达后再读，之后的读取不会超时
+    if (!tcp_to_app_.waitReadable(dataLen, timeout)) {
+        //std::cout << "Read timeout\n";
+        return -1; // 超时
+    }
 
-        // 检查总大小限制
-        if (buffer.total_size > max_message_size_ || buffer.total_size > size) {
-            std::cerr << "Message too large, msg_id: " << msg.header.msg_id 
-                << " size: " << buffer.total_size 
+    MsgHeader header;
+    tcp_to_app_.read(reinterpret_cast<char*>(&header), sizeof(MsgHeader), timeout);
+    header.msg_id = ntohl(header.msg_id);
+    header.segment_id = ntohl(header.segment_id);
+    header.flag = ntohl(header.flag);
+    size_t payloadLen = dataLen - sizeof(MsgHeader) - sizeof(MsgFooter);
+    bool encrypted = header.flag & FLAG_ENCRYPTED;
+
+    // 查找或创建缓存项，新消息从池中取缓冲区
+    auto [it, inserted] = message_cache.try_emplace(header.msg_id);
+    auto& buffer = it->second;
+    if (inserted && !buffer_pool_.empty()) {
+        buffer.data = std::move(buffer_pool_.back());
+        buffer_pool_.pop_back();
+    }
+    buffer.last_update = std::chrono::steady_clock::now();
+    buffer.is_compressed = header.flag & FLAG_COMPRESSED;
+
+    // 明文分段直接读到最终位置，加密分段读到临时区，解密时写到最终位置
+    size_t plainLen = encrypted ? payloadLen - std::min(payloadLen, encrypt_size_increment_) : payloadLen;
+    bool tooLarge = buffer.total_size + plainLen > max_message_size_ || buffer.total_size + plainLen > size;
+    // 同一消息的分段按顺序发送，TCP 保证顺序，ID 不连续说明中间的分段已经丢失
+    bool outOfOrder = header.segment_id != buffer.next_segment;
+    if (!tooLarge && buffer.data.size() < buffer.total_size + plainLen) {
+        buffer.data.resize(std::max(buffer.data.size() * 2, buffer.total_size + plainLen));
+    }
+    uint8_t* target = encrypted || tooLarge || outOfOrder ? segment_scratch_.data() : buffer.data.data() + buffer.total_size;
+    tcp_to_app_.read(reinterpret_cast<char*>(target), payloadLen, timeout);
+    MsgFooter footer;
+    tcp_to_app_.read(reinterpret_cast<char*>(&footer), sizeof(MsgFooter), timeout);
+
+    if (tooLarge || outOfOrder) {
+        if (tooLarge) {
+            std::cerr << "Message too large, msg_id: " << header.msg_id 
+                << " size: " << buffer.total_size + plainLen
                 << " buffer size: " << size
                 << " max size: " << max_message_size_
                 << std::endl;
-            message_cache.erase(msg.header.msg_id); // 丢弃超大消息
-            continue;
+        } else if (!inserted) {
+            // 新建的缓存项说明是已丢弃消息的后续分段，不再重复报告
+            std::cerr << "Segment out of order, msg_id: " << header.msg_id
+                << " segment: " << header.segment_id << " expected: " << buffer.next_segment << std::endl;
         }
-                
-        buffer.segments[msg.header.segment_id] = msg.payload;
-        
-        if ((msg.header.flag & FLAG_SEGMENTED) == 0) {
-            buffer.total_segments = msg.header.segment_id + 1;
+        dropMessage(it); // 丢弃整条消息
+        return 0;
+    }
+
+    //crc check
+    uint32_t crc = calculateChecksum(target, payloadLen);
+    if (ntohl(footer.checksum) != crc) {
+        // Print CRC in hexadecimal format
+        std::cout << "crc error: 0x" << std::hex 
+            << std::uppercase << std::setfill('0') 
+            << std::setw(8) << crc << std::endl;
+        dropMessage(it);
+        return -3;
+    }
+    //如果对端切换key
+    if (header.flag & FLAG_KEY_UPDATE) {
+        switchToNewKeys();
+    }
+    // 如果对端加密，直接把模式改成加密
+    if (encrypted) {
+        size_t decryptedLen = 0;
+        if (!decryptData(sessionKey_rx_, target, payloadLen, buffer.data.data() + buffer.total_size, decryptedLen)) {
+            std::cerr << "Warning: Decryption failed for msg: " << header.msg_id << std::endl;
+            dropMessage(it);
+            return -4;
         }
+        // 只有解密成功，才设置加密模式，防止错误状态
+        setEncryptMode(true);
+        plainLen = decryptedLen;
+    } else {
+        setEncryptMode(false);
+    }
+
+    // 累计总大小
+    buffer.total_size += plainLen;
+    buffer.next_segment++;
+    if ((header.flag & FLAG_SEGMENTED) == 0) {
+        msg_id = header.msg_id;
+        return 1;
+    }
+    return 0;
+}
 
-        // 检查是否完成
-        if (buffer.segments.size() == buffer.total_segments) {
-            buffer.is_complete = true;
+int Transport::read(std::vector<uint8_t>& data, uint32_t& msg_id, size_t size, std::chrono::milliseconds timeout) {
+    while (true) {
+        uint32_t id = 0;
+        int ret = readSegment(size, timeout, id);
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret > 0) {
+            // 消息完成: 压缩的消息解压到调用方的缓冲区，未压缩的直接交换缓冲区，换出的缓冲区放回池中
+            auto it = message_cache.find(id);
+            auto& buffer = it->second;
+            int readSize = buffer.total_size;
+            if (buffer.is_compressed) {
+                if (data.size() < size) {
+                    data.resize(size);
+                }
+                readSize = decompressData(buffer.data.data(), buffer.total_size, data.data(), size);
+            } else {
+                data.swap(buffer.data);
+            }
+            dropMessage(it);
+            if (readSize <= 0) {
+                std::cerr << "Decompression failed! Error code: " << readSize << std::endl;
+                continue; // 继续处理下一个消息
+            }
+            msg_id = id;  // 记录消息 ID
+            return readSize; // 处理完成后返回
         }
 
         // 检查缓存大小限制
@@ -466,7 +475,7 @@ int Transport::read(uint8_t* data, uint32_t& msg_id, size_t size, std::chrono::m
                 [](const auto& a, const auto& b) {
                     return a.second.last_update < b.second.last_update;
                 });
-            message_cache.erase(oldest);
+            dropMessage(oldest);
         }
 
         // 超时清理未完成消息
@@ -474,7 +483,7 @@ int Transport::read(uint8_t* data, uint32_t& msg_id, size_t size, std::chrono::m
         for (auto it = message_cache.begin(); it != message_cache.end();) {
             if (now - it->second.last_update > std::chrono::milliseconds(message_timeout_)) {
                 std::cout << "Message timeout, msg_id: " << it->first << std::endl;
-                it = message_cache.erase(it);
+                dropMessage(it++);
             } else {
                 ++it;
             }
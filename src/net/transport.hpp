@@ -6,6 +6,8 @@
 #include <cstring>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
 #include <array>
 #include <thread>
 #include <boost/asio.hpp>
@@ -36,11 +38,11 @@ struct Msg {
     MsgFooter footer;
 };
 
+// 同一消息的分段按顺序到达，负载依次追加到 data 中，data 从池中取得，只增不减
 struct MessageBuffer {
-    std::map<uint32_t, std::vector<uint8_t>> segments; // 按 segment_id 存储分包
-    uint32_t total_segments = 0;             // 总分包数
-    size_t total_size = 0;                   // 当前消息的总大小
-    bool is_complete = false;                // 是否已完成
+    std::vector<uint8_t> data;               // 重组缓冲区，size() 为容量
+    size_t total_size = 0;                   // 已收到的负载大小
+    uint32_t next_segment = 0;               // 下一个期望的分段 ID
     bool is_compressed = false;              // 是否压缩
     std::chrono::steady_clock::time_point last_update = std::chrono::steady_clock::time_point::min();; // 最近更新的时间
 };
@@ -77,6 +79,17 @@ public:
         compressFlag_ = flag;
     }
 
+    // 握手时双方交换各自支持的最大分段，取较小值
+    static size_t maxSegmentSize() {
+        return max_segment_size_;
+    }
+    void setSegmentSize(size_t size) {
+        segment_size_ = std::clamp<size_t>(size, TCP_BUFFER_SIZE, max_segment_size_);
+    }
+    size_t getSegmentSize() const {
+        return segment_size_;
+    }
+
     void setSessionKeys(const std::vector<uint8_t>& rxKey, const std::vector<uint8_t>& txKey, const bool updateImmediately = false) {
         sessionKey_rx_new_ = rxKey;
         sessionKey_tx_new_ = txKey;
@@ -92,13 +105,19 @@ public:
     }
 
     // 1. APP 缓存到下行 CircularBuffer
+    // timeout 只限制第一个分片: 超时则整条消息都不发送；之后的分片一直等到写入或端口关闭，不会只发出一部分
     int send(const uint8_t* data, size_t size, uint32_t msg_id, std::chrono::milliseconds timeout);
     // 2. TCP 读取下行 CircularBuffer
     int output(char* buffer, size_t size, std::chrono::milliseconds timeout);
     // 3. TCP 缓存到上行 CircularBuffer
     int input(const char* buffer, size_t size, std::chrono::milliseconds timeout);
-    // 4. APP 读取上行 CircularBuffer
-    int read(uint8_t* data, uint32_t& msg_id, size_t size, std::chrono::milliseconds timeout);
+    // 4. APP 读取上行 CircularBuffer: 未压缩的消息把重组缓冲区与 data 交换，不再复制，data 原来的缓冲区放回池中
+    // 返回消息长度，消息在 data 的开头；解压时 data 至少扩展到 size
+    int read(std::vector<uint8_t>& data, uint32_t& msg_id, size_t size, std::chrono::milliseconds timeout);
+    // 5. TCP 暂停接收后重新可写时，继续读取下行 CircularBuffer
+    void resume_output() {
+        on_send();
+    }
 
 	void reset(ChannelType type) {
         if (ChannelType::ALL == type) {
@@ -113,19 +132,25 @@ public:
 
 private:
     static constexpr size_t max_cache_size_ = 8;
-    static constexpr size_t segment_size_ = TCP_BUFFER_SIZE;// 分段大小
+    static constexpr size_t max_segment_size_ = TCP_MAX_SEGMENT_SIZE;// 接收时允许的最大分段
+    std::atomic<size_t> segment_size_{TCP_BUFFER_SIZE};// 发送的分段大小，握手后按协商结果调整
     static constexpr size_t encrypt_size_increment_ = AES_GCM_nonce_len + AES_GCM_tag_len;
     static size_t max_message_size_;// = 10 * 1024*1024; // 限制最大消息大小为 10 MB
-    static constexpr size_t circular_buffer_size_ = 32*1024; //32k
+    static constexpr size_t circular_buffer_size_ = 4 * TCP_MAX_SEGMENT_SIZE; // 至少容纳几个最大分段
     static uint32_t message_timeout_; // = 200; // 200ms
     
     std::mutex mutex_[2];
+    // 缓冲区只允许一个写者，同一连接上并发的响应在这里排队写入 app_to_tcp_
+    std::mutex send_mutex_;
     std::map<uint32_t, MessageBuffer> message_cache; // 缓存容器
+    std::vector<std::vector<uint8_t>> buffer_pool_;  // 重组缓冲区池，最多 max_cache_size_ 个
+    std::vector<uint8_t> segment_scratch_;           // 加密分段先读到这里再解密到消息缓冲区
     CircularBuffer app_to_tcp_; // 缓存上层发送的数据
     CircularBuffer tcp_to_app_; // 缓存下层接收的数据
     //boost::asio::io_context* io_context_[2];
     //Timer timer_[2];
     uint32_t id_;
+    std::atomic<bool> stopped_{false};  // 端口已关闭，发送中的消息不再等待
     bool encryptMode_;
     bool updateKey_;
     bool compressFlag_;
@@ -142,12 +167,15 @@ private:
 
 	// 计算校验和
 	uint32_t calculateChecksum(const std::vector<uint8_t>& data);
+	uint32_t calculateChecksum(const uint8_t* data, size_t size);
 
     // 序列化 Msg 为网络字节序
     std::vector<char> serializeMsg(const Msg& msg);
 
-    // 反序列化网络字节序为 Msg
-    Msg deserializeMsg(const std::vector<char>& buffer);
+    // 从上行缓冲区读出一个分段，负载直接写到所属消息缓冲区的末尾，返回完成的消息 ID 或错误码
+    int readSegment(size_t size, std::chrono::milliseconds timeout, uint32_t& msg_id);
+    // 丢弃未完成的消息，缓冲区放回池中
+    void dropMessage(std::map<uint32_t, MessageBuffer>::iterator it);
 
     void switchToNewKeys() {
         sessionKey_rx_ = sessionKey_rx_new_;
@@ -4,6 +4,7 @@
 #include "transportclient.hpp"
 
 TransportClient::ptr TransportClient::my_instance = nullptr;
+size_t TransportClient::max_inflight_ = get_env_var("MDB_MAX_INFLIGHT", size_t(256));
 
 int TransportClient::Ecdh() {
     auto clientKxPair = generateKxKeypair();
@@ -13,6 +14,7 @@ int TransportClient::Ecdh() {
     jsonData["action"] = "ECDH";
     jsonData["primitive"] = "HKDF";
     jsonData["pkc"] = toHexString(clientKxPair.first);
+    jsonData["segment"] = Transport::maxSegmentSize();
     // Convert JSON to string
     std::string jsonConfig = jsonData.dump();
     
@@ -51,6 +53,10 @@ int TransportClient::Ecdh() {
 	if (auto port = transport_.lock()) {
 		port->setSessionKeys(sessionKeys.first, sessionKeys.second, true);
 		port->setEncryptMode(true);
+		// 服务端回复了协商结果才使用大分段，旧版本服务端仍按默认分段
+		if (jsonData.contains("segment")) {
+			port->setSegmentSize(jsonData["segment"].get<size_t>());
+		}
 	} else
 		return -5;
     
@@ -119,6 +125,7 @@ int TransportClient::connect() {
         io_context_.restart();  // 重新启动 io_context
     }
 	work_guard_ = std::make_shared<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>(io_context_.get_executor());
+	expire_timer_.start();
 	asio_eventLoopThread = std::thread([this]() {
 		io_context_.run();
 	});
@@ -149,6 +156,7 @@ void TransportClient::stop() {
 	if (work_guard_) {
 		work_guard_->reset();  // 释放 work_guard
 	}
+	failPending(-2);
 }
 
 int TransportClient::send(const uint8_t* data, size_t size, uint32_t msg_id, uint32_t timeout) {
@@ -159,7 +167,138 @@ int TransportClient::send(const uint8_t* data, size_t size, uint32_t msg_id, uin
 }
 
 int TransportClient::recv(uint8_t* pack_data,uint32_t& msg_id, size_t size,uint32_t timeout) {
-	if (auto port = transport_.lock())
-		return port->read(pack_data,msg_id,size,std::chrono::milliseconds(timeout));
-	return -2;
+	std::unique_lock<std::mutex> lock(ready_mutex_);
+	if (!ready_cv_.wait_for(lock, std::chrono::milliseconds(timeout), [this]() {
+			return !ready_.empty() || transport_.expired();
+		})) {
+		return -1;
+	}
+	if (ready_.empty()) {
+		return -2;
+	}
+	auto [id, data] = std::move(ready_.front());
+	ready_.pop_front();
+	lock.unlock();
+	if (data.size() > size) {
+		std::cerr << "recv buffer too small for message " << id << ": " << data.size() << " > " << size << std::endl;
+		return -3;
+	}
+	memcpy(pack_data, data.data(), data.size());
+	msg_id = id;
+	return data.size();
+}
+
+void TransportClient::on_data_received(int len, int msg_id) {
+	uint32_t id = msg_id;
+	if (id >= kAsyncIdBase) {
+		Callback callback;
+		{
+			std::lock_guard<std::mutex> lock(pending_mutex_);
+			auto it = pending_.find(id);
+			if (it == pending_.end()) {
+				return; // 已经超时的请求，响应直接丢弃
+			}
+			callback = std::move(it->second.callback);
+			pending_.erase(it);
+		}
+		inflight_cv_.notify_one();
+		callback(0, id, recv_buffer_.data(), len);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(ready_mutex_);
+		// 没有人读取时只保留最近的响应
+		if (ready_.size() >= max_inflight_) {
+			std::cerr << "recv queue full, dropping message " << ready_.front().first << std::endl;
+			ready_.pop_front();
+		}
+		ready_.emplace_back(id, std::vector<uint8_t>(recv_buffer_.begin(), recv_buffer_.begin() + len));
+	}
+	ready_cv_.notify_one();
+}
+
+int TransportClient::sendAsync(const uint8_t* data, size_t size, Callback callback, uint32_t timeout) {
+	auto port = transport_.lock();
+	if (!port) {
+		return -2;
+	}
+	uint32_t msg_id;
+	{
+		std::unique_lock<std::mutex> lock(pending_mutex_);
+		if (!inflight_cv_.wait_for(lock, std::chrono::milliseconds(timeout), [this]() {
+				return pending_.size() < max_inflight_;
+			})) {
+			return -1;
+		}
+		do {
+			msg_id = next_async_id_;
+			next_async_id_ = next_async_id_ == kAsyncIdMax ? kAsyncIdBase : next_async_id_ + 1;
+		} while (pending_.count(msg_id));
+		// 先登记再发送，响应可能在 send 返回之前到达
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		pending_.emplace(msg_id, Pending{std::move(callback), deadline});
+	}
+	int ret = port->send(data, size, msg_id, std::chrono::milliseconds(timeout));
+	if (ret < 0) {
+		std::lock_guard<std::mutex> lock(pending_mutex_);
+		// 已经被超时或断开清理时回调已经执行过，按成功发出返回
+		if (pending_.erase(msg_id) > 0) {
+			inflight_cv_.notify_one();
+			return ret;
+		}
+	}
+	return msg_id;
+}
+
+std::future<std::vector<uint8_t>> TransportClient::request(const uint8_t* data, size_t size, uint32_t timeout) {
+	auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+	auto future = promise->get_future();
+	int ret = sendAsync(data, size, [promise](int status, uint32_t, const uint8_t* resp, size_t len) {
+		if (status == 0) {
+			promise->set_value(std::vector<uint8_t>(resp, resp + len));
+		} else {
+			promise->set_exception(std::make_exception_ptr(
+				std::runtime_error(status == -1 ? "request timeout" : "connection closed")));
+		}
+	}, timeout);
+	if (ret < 0) {
+		promise->set_exception(std::make_exception_ptr(
+			std::runtime_error("request send failed: " + std::to_string(ret))));
+	}
+	return future;
+}
+
+void TransportClient::expirePending() {
+	std::vector<std::pair<uint32_t, Callback>> expired;
+	auto now = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(pending_mutex_);
+		for (auto it = pending_.begin(); it != pending_.end();) {
+			if (it->second.deadline <= now) {
+				expired.emplace_back(it->first, std::move(it->second.callback));
+				it = pending_.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+	if (expired.empty()) {
+		return;
+	}
+	inflight_cv_.notify_all();
+	for (auto& [id, callback] : expired) {
+		callback(-1, id, nullptr, 0);
+	}
+}
+
+void TransportClient::failPending(int status) {
+	std::unordered_map<uint32_t, Pending> failed;
+	{
+		std::lock_guard<std::mutex> lock(pending_mutex_);
+		failed.swap(pending_);
+	}
+	inflight_cv_.notify_all();
+	for (auto& [id, pending] : failed) {
+		pending.callback(status, id, nullptr, 0);
+	}
 }
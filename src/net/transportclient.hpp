@@ -7,6 +7,12 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <optional>
+#include <functional>
+#include <future>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/executor_work_guard.hpp>
 #include "transportmng.hpp"
@@ -15,17 +21,25 @@
 #include "tcpconnection.hpp"
 
 
-class TransportClient: public IObserver<TcpConnection>,public std::enable_shared_from_this<TransportClient> {
+// 客户端连接: 同步接口按 send/recv 收发，异步接口为每个请求分配 msg_id，响应按 msg_id 匹配，可以乱序完成
+// 一个连接上可以同时有多个请求在途，不必每个请求等待一次往返
+class TransportClient: public IObserver<TcpConnection>, public IDataCallback, public std::enable_shared_from_this<TransportClient> {
 private:
 	TransportClient(const TransportClient&) = delete;
     TransportClient& operator=(const TransportClient&) = delete;
 
 public:
 	using ptr = std::shared_ptr<TransportClient>;
+	// 异步请求的结果: status 为 0 时 data/size 是响应，超时为 -1，连接断开为 -2
+	using Callback = std::function<void(int status, uint32_t msg_id, const uint8_t* data, size_t size)>;
+	// 同步接口使用的 msg_id 必须小于 kAsyncIdBase，之上的编号留给异步请求
+	static constexpr uint32_t kAsyncIdBase = 0x40000000;
+	static constexpr uint32_t kAsyncIdMax = 0x7fffffff;
 
 	TransportClient(boost::asio::io_context& io_context, const std::string& user, const std::string& pwd)
 		: io_context_(io_context), 
-		user_(user), passwd_(pwd) {
+		user_(user), passwd_(pwd),
+		expire_timer_(io_context, 100, true, [this](int, int, std::thread::id) { this->expirePending(); }) {
 		tranportMng_ = TransportMng::get_instance();
 		id_ = 0;
 		tcp_client_ = nullptr;
@@ -37,6 +51,14 @@ public:
 	void on_new_item(const std::shared_ptr<TcpConnection>& connection, uint32_t id) override {
 		auto transport = tranportMng_->open_port(id_);
     	transport->add_callback(tcp_client_);
+		// 收到的完整消息由 on_data_received 分发给异步请求或同步 recv
+		recv_buffer_.resize(transport->getMessageSize());
+		cached_data_ = std::make_tuple(&recv_buffer_, int(recv_buffer_.size()), 0xffffffff);
+		{
+			std::lock_guard<std::mutex> lock(ready_mutex_);
+			ready_.clear();
+		}
+		transport->add_callback(shared_from_this());
 		transport->setCompressFlag(true);
 		transport->setEncryptMode(false);
 		transport->reset(Transport::ChannelType::ALL);
@@ -47,7 +69,14 @@ public:
 	void on_close_item(const uint32_t id) override {
         tranportMng_->close_port(id);
 		tcp_client_ = nullptr;
+		failPending(-2);
+		ready_cv_.notify_all();
     }
+
+	DataVariant& get_data() override {
+		return cached_data_;
+	}
+	void on_data_received(int len, int msg_id) override;
 	
 
 	static ptr& get_instance(boost::asio::io_context& io_context,const std::string& user, const std::string& pwd) {
@@ -62,8 +91,15 @@ public:
 	
 	// 1. APP 缓存到下行 CircularBuffer
     int send(const uint8_t* data, size_t size, uint32_t msg_id, uint32_t timeout);
-	// 4. APP 读取上行 CircularBuffer
+	// 4. APP 读取同步请求的响应，缓冲区不足时丢弃该响应并返回 -3
     int recv(uint8_t* pack_data,uint32_t& msg_id, size_t size, uint32_t timeout);
+
+	// 异步发送请求，返回分配的 msg_id，发送失败返回负数且不会调用回调
+	// 回调在网络线程中执行，不能阻塞，也不能在回调里等待其他请求的响应
+	// 在途请求达到 MDB_MAX_INFLIGHT 时等待其他请求完成，timeout 同时是等待响应的期限（毫秒）
+	int sendAsync(const uint8_t* data, size_t size, Callback callback, uint32_t timeout);
+	// 同上，以 future 返回响应，超时或连接断开时 future 中是 std::runtime_error
+	std::future<std::vector<uint8_t>> request(const uint8_t* data, size_t size, uint32_t timeout);
 	
 protected:
 	//for tcp client
@@ -87,6 +123,9 @@ protected:
     }
 	int connect();
 	int Ecdh();
+	void expirePending();
+	// 以 status 结束所有在途的异步请求
+	void failPending(int status);
 private:
 	static ptr my_instance;
 	boost::asio::io_context& io_context_;
@@ -100,6 +139,23 @@ private:
 	std::string passwd_;
 	std::shared_ptr<TcpConnection> tcp_client_;
 	std::weak_ptr<Transport> transport_;
+
+	struct Pending {
+		Callback callback;
+		std::chrono::steady_clock::time_point deadline;
+	};
+	static size_t max_inflight_;
+	std::mutex pending_mutex_;
+	std::condition_variable inflight_cv_;
+	std::unordered_map<uint32_t, Pending> pending_;
+	uint32_t next_async_id_ = kAsyncIdBase;
+	// 同步请求的响应排队等待 recv 读取
+	std::mutex ready_mutex_;
+	std::condition_variable ready_cv_;
+	std::deque<std::pair<uint32_t, std::vector<uint8_t>>> ready_;
+	std::vector<uint8_t> recv_buffer_;
+	DataVariant cached_data_;
+	Timer expire_timer_;
 };
 
 #endif
\ No newline at end of file
@@ -19,6 +19,10 @@ void TransportMng::start() {
 
 void TransportMng::stop() {
     std::lock_guard<std::mutex> lock(mutex_);
+    // 先停止各端口，正在等待发送后续分片的线程随之返回
+    for (auto& [id, port] : ports_) {
+        port->stop();
+    }
     ports_.clear(); // 清空 map
 #ifdef DEBUG
     std::cout << "TransportMng stopped." << std::endl;
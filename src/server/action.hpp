@@ -1,14 +1,63 @@
 #ifndef ACTIONHANDLER_HPP
 #define ACTIONHANDLER_HPP
 
+#include <functional>
 #include "dbcore/database.hpp"
 #include "util/util.hpp"
+
+// 响应编码后的长度限制: limit 为结果可用的字节数，sizeOf 按请求的编码计算一个值编码后的长度
+// sizeOf 为空时不限制，游标按它决定每批返回多少条，避免整批结果超过消息上限
+struct ResponseBudget {
+    size_t limit = SIZE_MAX;
+    std::function<size_t(const json&)> sizeOf;
+};
+
 // 动作处理器基类
 class ActionHandler {
 public:
     virtual void handle(const json& task, Database::ptr db, json& response) = 0;
+    // 修改数据的动作返回 true: 执行成功后请求写入预写日志，启动时重放
+    // 失败的请求不写日志，这类动作失败时不能留下部分修改
+    virtual bool logged() const { return false; }
+    // 可能扫描整个容器或处理大批数据的请求返回 true，调度时进入扫描通道，不与点操作一起排队
+    virtual bool heavy(const json& /*task*/, Database::ptr /*db*/) const { return false; }
+    // 写日志前补全请求中每次执行结果不同的部分（例如自动生成的文档 ID），使重放得到相同的数据
+    virtual void prepare(json& /*task*/, Database::ptr /*db*/) {}
     virtual ~ActionHandler() = default;
     uint32_t port_id_;
+    ResponseBudget budget_;
+
+protected:
+    // 按点操作调度的请求最多涉及的行数或文档数
+    static constexpr size_t kPointRows = 64;
+
+    // select、update、delete 的条件只涉及少量行或文档时返回 true，见 Table::isPointQuery 和 Collection::isPointQuery
+    // limited 为 true 时按表查询的 limit 判断；容器不存在或请求有误时返回 false，按扫描调度，执行时再返回错误
+    static bool pointQuery(const json& task, const Database::ptr& db, bool limited = false) {
+        if (!db) {
+            return false;
+        }
+        try {
+            auto container = db->getContainer(task.at("name").get<std::string>());
+            if (auto tb = std::dynamic_pointer_cast<Table>(container)) {
+                std::vector<std::string> conditions = task.at("conditions").get<std::vector<std::string>>();
+                std::vector<std::string> operators = task.at("ops").get<std::vector<std::string>>();
+                std::vector<FieldValue> queryValues;
+                for (const auto& value : task.at("qvalues")) {
+                    Field field;
+                    field.fromJson(value);
+                    queryValues.push_back(field.getValue());
+                }
+                size_t limit = limited ? task.at("limit").get<size_t>() : SIZE_MAX;
+                return tb->isPointQuery(conditions, queryValues, operators, limit, kPointRows);
+            }
+            if (auto collection = std::dynamic_pointer_cast<Collection>(container)) {
+                return collection->isPointQuery(task, kPointRows);
+            }
+        } catch (const std::exception&) {
+        }
+        return false;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include "cursor.hpp"
+
+namespace {
+
+// 游标空闲超过该时间（秒）后由定时器释放
+const auto kIdleTimeout = std::chrono::seconds(get_env_var("DB_CURSOR_TIMEOUT", int(300)));
+
+// 表游标每次从表中读取的行数，一批结果按长度截断时最多多读这么多行
+constexpr size_t kReadChunk = 1024;
+
+// 一条结果放入数组后的编码长度，多算 1 字节分隔符；不限制长度时不计算
+size_t entrySize(const ResponseBudget& budget, const json& value) {
+    return budget.sizeOf ? budget.sizeOf(value) + 1 : 0;
+}
+
+}
+
+bool TableCursor::fetch(size_t count, const ResponseBudget& budget, json& response) {
+    size_t end = pos_ + std::min(count, ids_.size() - pos_);
+    json results = json::array();
+    std::vector<RowId> found;
+    size_t used = 0;
+    bool full = false;
+    // 分段读取，结果超过长度限制时不必读出整批
+    while (pos_ < end && !full) {
+        size_t next = pos_ + std::min(kReadChunk, end - pos_);
+        std::vector<RowId> chunkIds;
+        auto rows = table_->getRowsById(columns_, ids_.data() + pos_, next - pos_, &chunkIds);
+        for (size_t r = 0; r < rows.size(); ++r) {
+            json rowJson;
+            for (size_t i = 0; i < columns_.size(); ++i) {
+                rowJson[columns_[i]] = valuetoJson(rows[r][i]);
+            }
+            size_t size = entrySize(budget, rowJson) + entrySize(budget, chunkIds[r]);
+            if (used + size > budget.limit) {
+                if (results.empty()) {
+                    throw std::runtime_error("Row " + std::to_string(chunkIds[r]) + " exceeds the max message size");
+                }
+                // 下一批从这一行开始
+                next = std::find(ids_.begin() + pos_, ids_.begin() + next, chunkIds[r]) - ids_.begin();
+                full = true;
+                break;
+            }
+            used += size;
+            results.push_back(std::move(rowJson));
+            found.push_back(chunkIds[r]);
+        }
+        pos_ = next;
+    }
+    response["results"] = std::move(results);
+    response["rowids"] = found;
+    return pos_ < ids_.size();
+}
+
+bool CollectionCursor::fetch(size_t count, const ResponseBudget& budget, json& response) {
+    size_t end = pos_ + std::min(count, docs_.size() - pos_);
+    json results = json::array();
+    size_t used = 0;
+    for (; pos_ < end; ++pos_) {
+        auto& [docId, doc] = docs_[pos_];
+        json entry = {docId, doc->toJson()};
+        size_t size = entrySize(budget, entry);
+        if (used + size > budget.limit) {
+            if (results.empty()) {
+                throw std::runtime_error("Document " + std::to_string(docId) + " exceeds the max message size");
+            }
+            break;
+        }
+        used += size;
+        results.push_back(std::move(entry));
+        // 已返回的文档不再持有，修改时不必复制
+        doc.reset();
+    }
+    response["results"] = std::move(results);
+    return pos_ < docs_.size();
+}
+
+CursorManager& CursorManager::getInstance() {
+    static CursorManager instance;
+    return instance;
+}
+
+uint64_t CursorManager::open(uint32_t portId, Cursor::ptr cursor) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t opened = std::count_if(cursors_.begin(), cursors_.end(),
+        [portId](const auto& item) { return item.second.portId == portId; });
+    if (opened >= kMaxPerConnection) {
+        throw std::runtime_error("Too many open cursors on this connection");
+    }
+    uint64_t id = nextId_++;
+    cursors_.emplace(id, Entry{portId, std::move(cursor), std::chrono::steady_clock::now()});
+    return id;
+}
+
+Cursor::ptr CursorManager::get(uint32_t portId, uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cursors_.find(id);
+    if (it == cursors_.end() || it->second.portId != portId) {
+        return nullptr;
+    }
+    it->second.lastAccess = std::chrono::steady_clock::now();
+    return it->second.cursor;
+}
+
+bool CursorManager::close(uint32_t portId, uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cursors_.find(id);
+    if (it == cursors_.end() || it->second.portId != portId) {
+        return false;
+    }
+    cursors_.erase(it);
+    return true;
+}
+
+void CursorManager::closeAll(uint32_t portId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = cursors_.begin(); it != cursors_.end();) {
+        it = it->second.portId == portId ? cursors_.erase(it) : std::next(it);
+    }
+}
+
+void CursorManager::expire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto deadline = std::chrono::steady_clock::now() - kIdleTimeout;
+    for (auto it = cursors_.begin(); it != cursors_.end();) {
+        it = it->second.lastAccess < deadline ? cursors_.erase(it) : std::next(it);
+    }
+}
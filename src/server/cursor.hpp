@@ -0,0 +1,104 @@
+#ifndef CURSOR_HPP
+#define CURSOR_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include "dbcore/database.hpp"
+#include "util/util.hpp"
+#include "action.hpp"
+
+// 查询游标: select 带 batch 参数时只保存结果的行号（表）或文档指针（集合），每次返回一批
+// 客户端处理完一批后再用 fetch_next 取下一批，服务端不会主动推送，大结果集不再一次生成巨大的响应
+class Cursor {
+public:
+    using ptr = std::shared_ptr<Cursor>;
+    virtual ~Cursor() = default;
+
+    // 把最多 count 条结果写入 response["results"]，返回是否还有剩余，同一游标的并发请求依次执行
+    // 结果编码后超过 budget 时提前结束本批，未返回的结果留给下一批；一条结果就超过限制时抛出异常，游标位置不变
+    bool next(size_t count, const ResponseBudget& budget, json& response) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return fetch(count, budget, response);
+    }
+    virtual size_t total() const = 0;
+
+protected:
+    virtual bool fetch(size_t count, const ResponseBudget& budget, json& response) = 0;
+
+private:
+    std::mutex mutex_;
+};
+
+// 表游标: 保存打开时满足条件的行号，取数时按行号读取当前值，期间被删除的行跳过
+class TableCursor : public Cursor {
+public:
+    TableCursor(std::shared_ptr<Table> table, std::vector<std::string> columns, std::vector<RowId> ids)
+        : table_(std::move(table)), columns_(std::move(columns)), ids_(std::move(ids)) {}
+    size_t total() const override { return ids_.size(); }
+
+protected:
+    bool fetch(size_t count, const ResponseBudget& budget, json& response) override;
+
+private:
+    std::shared_ptr<Table> table_;
+    std::vector<std::string> columns_;
+    std::vector<RowId> ids_;
+    size_t pos_ = 0;
+};
+
+// 集合游标: 文档写时复制，保存的指针就是打开时的快照
+class CollectionCursor : public Cursor {
+public:
+    using Results = std::vector<std::pair<DocumentId, std::shared_ptr<Document>>>;
+    explicit CollectionCursor(Results docs) : docs_(std::move(docs)) {}
+    size_t total() const override { return docs_.size(); }
+
+protected:
+    bool fetch(size_t count, const ResponseBudget& budget, json& response) override;
+
+private:
+    Results docs_;
+    size_t pos_ = 0;
+};
+
+// 按连接管理游标，连接关闭或空闲超时后释放
+class CursorManager {
+public:
+    static CursorManager& getInstance();
+
+    CursorManager(const CursorManager&) = delete;
+    CursorManager& operator=(const CursorManager&) = delete;
+
+    // 返回游标编号，连接打开的游标超过上限时抛出异常
+    uint64_t open(uint32_t portId, Cursor::ptr cursor);
+    // 游标不存在或不属于该连接时返回空
+    Cursor::ptr get(uint32_t portId, uint64_t id);
+    bool close(uint32_t portId, uint64_t id);
+    void closeAll(uint32_t portId);
+    // 释放空闲超时的游标
+    void expire();
+
+    static size_t maxBatch() { return kMaxBatch; }
+
+private:
+    CursorManager() = default;
+
+    struct Entry {
+        uint32_t portId;
+        Cursor::ptr cursor;
+        std::chrono::steady_clock::time_point lastAccess;
+    };
+
+    static constexpr size_t kMaxBatch = 100000;
+    static constexpr size_t kMaxPerConnection = 16;
+
+    std::mutex mutex_;
+    uint64_t nextId_ = 1;
+    std::unordered_map<uint64_t, Entry> cursors_;
+};
+
+#endif
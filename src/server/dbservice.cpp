@@ -2,17 +2,30 @@
 #include "log/logger.hpp"
 #include "net/transportmng.hpp"
 #include "util/util.hpp"
+#include "dbcore/parallelscan.hpp"
+#include "wal.hpp"
+#include "registry.hpp"
 
 size_t DBService::thread_pool_size_ = get_env_var("DB_SERVICE_POOL_SIZE", int(4));
+// 预写日志超过该大小（MB）时由定时器触发 checkpoint
+static const size_t wal_checkpoint_size_ = get_env_var("DB_WAL_CHECKPOINT_MB", size_t(64)) << 20;
 
-DBService::DBService() :thread_pool_(thread_pool_size_),
+DBService::DBService() :thread_pool_(1),
 	io_(),
 	db(Database::getInstance()),
 	timer(io_, keep_alv_timer, true, [this](int tick, int time, std::thread::id id) {
         this->on_timer(tick,time,id);
 	}),
-	work_guard_(boost::asio::make_work_guard(io_)) {
+	work_guard_(boost::asio::make_work_guard(io_)),
+	executor_(thread_pool_size_, WorkStealingExecutor::parseAffinity(get_env_var("DB_SERVICE_AFFINITY", std::string("none")))),
+	scheduler_([this](std::function<void()> task) {
+		executor_.post(std::move(task));
+	}, thread_pool_size_) {
 	std::cout << "DBService start" << std::endl;
+	// 容器加载和保存的进度写入服务日志
+	db->setLogSink([](Database::LogLevel level, const std::string& message) {
+		logger.log(level == Database::LogLevel::ERROR ? Logger::LogLevel::ERROR : Logger::LogLevel::INFO, "{}", message);
+	});
 	load_db();
 	std::string user, pwd;
 	load_users(user, pwd);
@@ -21,15 +34,18 @@ DBService::DBService() :thread_pool_(thread_pool_size_),
 
 	// 启动事件循环
 	//std::cout << "DBService thread pool started with " << std::thread::hardware_concurrency()/2 << " threads." << std::endl;
-	// 在线程池中运行 io_context
-	for (std::size_t i = 0; i < thread_pool_size_; ++i) {
-		boost::asio::post(thread_pool_, [this]() {
-			io_.run();
-		});
-	}
+	// io_ 只处理定时器，一个线程就够，请求和后台任务都在 executor_ 中执行
+	boost::asio::post(thread_pool_, [this]() {
+		io_.run();
+	});
+	// 大表扫描切分成 morsel 投递到 executor_，由空闲的工作线程并行执行
+	ParallelScan::getInstance().setExecutor([this](std::function<void()> task) {
+		executor_.post(std::move(task));
+	}, thread_pool_size_);
 }
 
 DBService::~DBService() {
+	ParallelScan::getInstance().resetExecutor();
 	// 停止事件循环
     io_.stop();
 	
@@ -39,6 +55,7 @@ DBService::~DBService() {
 	work_guard_.reset();
     // 等待线程池中的所有线程完成任务
     thread_pool_.join();
+	executor_.stop();
 	#ifdef DEBUG
 	std::cout << "DBService thread pool joined\n";
 	#endif
@@ -50,8 +67,9 @@ DBService::~DBService() {
 	#ifdef DEBUG
     std::cout << "DBtasks stopped" << std::endl;
 	#endif
-    // 保存数据库
+    // 保存有修改的容器，成功后删除旧的日志段
     save_db();
+    WriteAheadLog::getInstance().close();
     //std::cout << "DBService saved" << std::endl;
 
     #ifdef DEBUG
@@ -66,7 +84,7 @@ void DBService::on_msg(const std::shared_ptr<DBVariantMsg> msg) {
 		auto it = tasks_.find(port_id);
 		if (it != tasks_.end()) {
 			// 显式捕获 msg_id 和 jsonDatas
-            boost::asio::post(io_, [task = it->second, jsonDatas,msg_id]() {
+            executor_.post([task = it->second, jsonDatas,msg_id]() {
                 task->handle_task(jsonDatas,msg_id);
             });
 		}
@@ -116,20 +134,84 @@ void DBService::load_users(std::string& admin, std::string& pwd) {
 	}
 }
 
+// fsync 临时文件后替换目标文件，再同步目标目录
+static bool commit_file(const std::filesystem::path& tmpPath, const std::filesystem::path& path) {
+	std::error_code ec;
+	if (!WriteAheadLog::syncPath(tmpPath.string())) {
+		return false;
+	}
+	std::filesystem::rename(tmpPath, path, ec);
+	return !ec && WriteAheadLog::syncPath(path.parent_path().string());
+}
+
 void DBService::save_db() {
 	std::string baseDir = std::string(std::getenv("HOME"));
 	std::filesystem::path fullPath = std::filesystem::path(baseDir) / std::string("data");
-//std::cout << "DBService::on_timer :save db to" << fullPath.string() << std::endl;
-	db->save(fullPath.string());
+	std::filesystem::path tmpPath = fullPath / "tmp";
+	for (const auto& dir : {fullPath / "config", fullPath / "data", tmpPath}) {
+		std::filesystem::create_directories(dir);
+	}
+	// 增量 checkpoint: 只保存上次 checkpoint 之后有修改的容器，快照在锁外写盘，不阻塞其他请求
+	// 各容器在 DB_PERSIST_THREADS 个线程中并行生成快照并写盘
+	WriteAheadLog::getInstance().checkpoint([this]() {
+		std::vector<std::string> names;
+		for (const auto& container : db->listContainers()) {
+			names.push_back(container->getName());
+		}
+		return names;
+	}, [&](const std::string& name) -> std::function<bool()> {
+		auto container = db->getContainer(name);
+		if (!container) {
+			return nullptr;
+		}
+		// 先写到临时目录，完整落盘后再替换，load_db 不会读到写了一半的文件
+		std::filesystem::path configTmp = tmpPath / ("config." + name), dataTmp = tmpPath / ("data." + name);
+		container->saveSchema(configTmp.string());
+		auto writer = container->snapshot();
+		return [this, container, name, writer, configTmp, dataTmp, fullPath]() {
+			writer(dataTmp.string());
+			if (!commit_file(configTmp, fullPath / "config" / name) || !commit_file(dataTmp, fullPath / "data" / name)) {
+				return false;
+			}
+			// 写盘期间容器被删除时，删除刚写入的文件
+			if (db->getContainer(name) != container) {
+				db->remove(fullPath.string(), name);
+			}
+			return true;
+		};
+	}, Database::persistThreads());
 }
 
 void DBService::load_db() {
 	std::string baseDir = std::string(std::getenv("HOME"));
 	std::filesystem::path fullPath = std::filesystem::path(baseDir) / std::string("data");
 	db->upload(fullPath.string());
+
+	// 在快照之上重放各容器快照之后的修改
+	std::string walPath = (fullPath / "wal").string();
+	auto& wal = WriteAheadLog::getInstance();
+	size_t replayed = wal.replay(walPath, [this](const json& task) {
+		auto handler = ActionRegistry::getInstance().getHandler(task["action"]);
+		json response;
+		handler->handle(task, db, response);
+	});
+	if (replayed > 0) {
+		logger.log(Logger::LogLevel::INFO, "WAL replayed {} records", replayed);
+	}
+	wal.open(walPath);
 }
 
 void DBService::on_timer(int , int , std::thread::id ) {
+	// 删除只做标记，定期在线程池中压缩删除较多的表
+	executor_.post([this]() {
+		db->compact();
+		CursorManager::getInstance().expire();
+		// 日志过大时做一次 checkpoint，缩短重启时的重放时间；日志写失败后由 checkpoint 恢复
+		auto& wal = WriteAheadLog::getInstance();
+		if (wal.failed() || wal.size() > wal_checkpoint_size_) {
+			save_db();
+		}
+	});
 	//save_db();
 	//keep_alive();
 }
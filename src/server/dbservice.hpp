@@ -17,7 +17,9 @@
 #include "util/threadbase.hpp"
 #include "net/transport.hpp"
 #include "util/timer.hpp"
+#include "util/executor.hpp"
 #include "dbtask.hpp"
+#include "cursor.hpp"
 
 using DBMsg = std::tuple<std::shared_ptr<json>,uint32_t,uint32_t>;
 using DBVariantMsg = std::variant<DBMsg>;
@@ -45,7 +47,7 @@ public:
 	void on_new_item(const std::shared_ptr<Transport>& transport, uint32_t id) override {
 		std::lock_guard<std::mutex> lock(mutex_);
 		//std::cout << "on_new_transport" << transport->get_id() << std::endl;
-		auto dbtask = std::make_shared<DbTask>(io_);
+		auto dbtask = std::make_shared<DbTask>(scheduler_);
 		dbtask->initialize(transport, id);
 		tasks_.emplace(id, dbtask);
         transport->add_callback(dbtask);
@@ -60,6 +62,8 @@ public:
 			#endif
 			tasks_.erase(it);  // 从容器中移除
 		}
+		scheduler_.closeConnection(port_id);
+		CursorManager::getInstance().closeAll(port_id);
     }
 
 private:
@@ -80,6 +84,10 @@ private:
 	std::unordered_map<uint32_t, std::shared_ptr<DbTask>> tasks_;
 	static constexpr uint32_t keep_alv_timer = 30000;
 	boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_guard_;
+	// 工作窃取线程池，线程数为 DB_SERVICE_POOL_SIZE
+	WorkStealingExecutor executor_;
+	// 客户端请求经过调度器投递到 executor_
+	RequestScheduler scheduler_;
 
 };
 
@@ -1,47 +1,101 @@
 #include "dbtask.hpp"
 #include "dbservice.hpp"
 #include "registry.hpp"
+#include "wal.hpp"
 
 
+namespace {
+
+// 按请求的编码序列化响应
+std::vector<uint8_t> encode(const json& j, DbTask::WireFormat format) {
+    switch (format) {
+        case DbTask::WireFormat::MSGPACK: return json::to_msgpack(j);
+        case DbTask::WireFormat::CBOR: return json::to_cbor(j);
+        default: {
+            std::string text = j.dump();
+            return std::vector<uint8_t>(text.begin(), text.end());
+        }
+    }
+}
+
+// 响应中结果以外的字段（状态、游标编号、总数等）预留的长度
+constexpr size_t kResponseReserve = 4096;
+
+}
+
+DbTask::WireFormat DbTask::detectFormat(const uint8_t* data, size_t len) {
+    if (len == 0) {
+        return WireFormat::JSON;
+    }
+    uint8_t b = data[0];
+    // MessagePack: fixmap 0x80-0x8f, map16 0xde, map32 0xdf
+    if ((b & 0xf0) == 0x80 || b == 0xde || b == 0xdf) {
+        return WireFormat::MSGPACK;
+    }
+    // CBOR: 主类型 5 (map) 0xa0-0xbb，不定长 map 0xbf
+    if ((b >= 0xa0 && b <= 0xbb) || b == 0xbf) {
+        return WireFormat::CBOR;
+    }
+    return WireFormat::JSON;
+}
+
 void DbTask::on_data_received(int len, int msg_id) {
     if (len > 0) {
+        const uint8_t* begin = data_packet_.data();
+        const uint8_t* end = begin + len;
+        WireFormat format = detectFormat(begin, len);
         try {
-            // 限制解析范围，避免解析额外无效数据
-            json j = json::parse(std::string(data_packet_.begin(), data_packet_.begin() + len));
-    
-            auto jsonTask = std::make_shared<json>(j);
-            if (auto self = shared_from_this()) {  
-                boost::asio::post(io_context_, [self, this, jsonTask, msg_id]() {  
-                    this->handle_task(jsonTask, msg_id);
-                });
+            // 限制解析范围，避免解析额外无效数据，直接从缓存解析，不再复制成字符串
+            auto jsonTask = std::make_shared<json>(
+                format == WireFormat::MSGPACK ? json::from_msgpack(begin, end) :
+                format == WireFormat::CBOR ? json::from_cbor(begin, end) :
+                json::parse(begin, end));
+            // 按处理器的类型排队: 写请求是本连接的屏障，扫描和大批写入走扫描通道
+            // 未知的 action 照常排队，执行时返回错误
+            std::shared_ptr<ActionHandler> handler;
+            try {
+                handler = ActionRegistry::getInstance().getHandler((*jsonTask)["action"]);
+            } catch (const std::exception&) {
             }
+            auto lane = handler && handler->heavy(*jsonTask, DBService::getInstance()->getDb()) ? RequestScheduler::SCAN : RequestScheduler::POINT;
+            bool barrier = handler && handler->logged();
+            auto self = shared_from_this();
+            scheduler_.submit(id_, lane, barrier, [self, jsonTask, msg_id, format, handler]() {
+                self->handle_task(jsonTask, msg_id, format, handler);
+            });
         } catch (...) {
-            std::cout << "json parse fail:\n" 
-                      << std::string(data_packet_.begin(), data_packet_.begin() + len) 
-                      << std::endl;
+            if (format == WireFormat::JSON) {
+                std::cout << "json parse fail:\n" 
+                          << std::string(begin, end) 
+                          << std::endl;
+            } else {
+                std::cout << "binary request parse fail:\n";
+                print_packet(begin, std::min<size_t>(len, 64));
+            }
         }
         // 移除已处理的数据（避免不必要的 clear + resize）
         //data_packet_.erase(data_packet_.begin(), data_packet_.begin() + result);
     }    
 }
 
-void DbTask::handle_task(std::shared_ptr<json> json_data, uint32_t msg_id) {
+void DbTask::handle_task(std::shared_ptr<json> json_data, uint32_t msg_id, WireFormat format,
+    std::shared_ptr<ActionHandler> handler) {
     //std::cout << "handle_task in, the memory info:\n";
     //print_memory_usage();
     auto sendResponse = [&](const uint32_t msg_id, const json& response) {
         auto port = transport_.lock();
         if (port) {
-            std::string strResp = response.dump();
-            if (strResp.size() > port->getMessageSize()) {
+            std::vector<uint8_t> resp = encode(response, format);
+            if (resp.size() > port->getMessageSize()) {
                 json jErr;
                 jErr["error"] = "Response message too big, please adjust request parameters";
-                jErr["size"] = strResp.size();
+                jErr["size"] = resp.size();
                 jErr["max size"] = port->getMessageSize();
                 jErr["status"] = "503";
-                strResp = jErr.dump();
+                resp = encode(jErr, format);
             }
-            int ret = port->send(reinterpret_cast<const uint8_t*>(strResp.data()), 
-                            strResp.size(),
+            int ret = port->send(resp.data(), 
+                            resp.size(),
                             msg_id, std::chrono::milliseconds(100));
             if (ret < 0) {
                 std::cerr << "APP SEND err: " << ret << std::endl;
@@ -53,9 +107,27 @@ void DbTask::handle_task(std::shared_ptr<json> json_data, uint32_t msg_id) {
     json jsonResp;
     try {
         auto db = DBService::getInstance()->getDb();
-        auto handler = ActionRegistry::getInstance().getHandler((*json_data)["action"]);
+        if (!handler) {
+            handler = ActionRegistry::getInstance().getHandler((*json_data)["action"]);
+        }
         handler->port_id_ = id_;
-        handler->handle(*json_data, db, jsonResp);
+        if (auto port = transport_.lock()) {
+            size_t maxSize = port->getMessageSize();
+            handler->budget_.limit = maxSize > kResponseReserve ? maxSize - kResponseReserve : 0;
+            handler->budget_.sizeOf = [format](const json& j) { return encode(j, format).size(); };
+        }
+        if (handler->logged()) {
+            // 执行成功的修改写入预写日志，落盘后再返回响应
+            auto& wal = WriteAheadLog::getInstance();
+            handler->prepare(*json_data, db);
+            uint64_t lsn = wal.apply((*json_data)["name"], *json_data, [&]() {
+                handler->handle(*json_data, db, jsonResp);
+                return jsonResp.value("status", "") == "200";
+            });
+            wal.waitDurable(lsn);
+        } else {
+            handler->handle(*json_data, db, jsonResp);
+        }
     } catch (const std::exception& e) {
         jsonResp["error"] = e.what();
     } catch (...) {
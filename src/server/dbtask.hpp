@@ -20,10 +20,16 @@
 #include <boost/asio.hpp>
 #include <boost/asio/strand.hpp>
 #include "net/transport.hpp"
+#include "action.hpp"
+#include "scheduler.hpp"
 class DbTask: public IDataCallback, public std::enable_shared_from_this<DbTask> {
 public:
-	DbTask(boost::asio::io_context& io_context)
-		: io_context_(io_context){
+	// 请求的编码，按第一个字节区分: JSON 文本以 '{' 开头，MessagePack 和 CBOR 的 map 类型各有固定的前缀
+	// 响应使用与请求相同的编码，客户端选定一种编码后整个连接都使用它
+	enum class WireFormat { JSON, MSGPACK, CBOR };
+	static WireFormat detectFormat(const uint8_t* data, size_t len);
+	DbTask(RequestScheduler& scheduler)
+		: scheduler_(scheduler){
 			
 	}
 	
@@ -47,13 +53,15 @@ public:
     }
 	void on_data_received(int len, int msg_id) override;
 
-	void handle_task(std::shared_ptr<json> json_data, uint32_t msg_id);
+	// handler 为空时按请求中的 action 创建
+	void handle_task(std::shared_ptr<json> json_data, uint32_t msg_id, WireFormat format = WireFormat::JSON,
+		std::shared_ptr<ActionHandler> handler = nullptr);
 private:
 	std::vector<uint8_t> data_packet_;//the container to read msg from transport layer
 	uint32_t id_;
 	std::weak_ptr<Transport> transport_;
 	DataVariant cached_data_;
-	boost::asio::io_context& io_context_;
+	RequestScheduler& scheduler_;
 };
 
 
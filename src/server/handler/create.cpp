@@ -2,6 +2,8 @@
 
 class CreateTableHandler : public ActionHandler {
 public:
+    bool logged() const override { return true; }
+
     void handle(const json& task, Database::ptr db , json& response) override {
         std::string tableName = task["name"];
         // 假设 DBService 是一个数据库服务的单例
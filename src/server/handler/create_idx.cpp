@@ -2,6 +2,9 @@
 
 class CreateIdexesHandler : public ActionHandler {
 public:
+    bool logged() const override { return true; }
+    bool heavy(const json& /*task*/, Database::ptr /*db*/) const override { return true; }
+
     void handle(const json& task, Database::ptr db , json& response) override {
         std::string name = task["name"];
 		std::vector<std::string> indexes;
@@ -19,17 +22,22 @@ public:
             response["status"] = "404";
             return;
         }
+		// 索引类型: ordered（默认）或 hash，哈希索引只用于集合
+		std::string type = task.value("type", "ordered");
 		try {
 			if (container->getType() == "table") {
-				auto tb = std::dynamic_pointer_cast<Table>(container);
-				for (auto& idx: indexes) {
-					tb->createIndex(idx);
+				if (type != "ordered") {
+					response["response"] = "Index type " + type + " is not supported for tables";
+					response["status"] = "400";
+					return;
 				}
+				// 所有列都建成功后才加入，失败的请求不写日志，也不能留下部分索引
+				auto tb = std::dynamic_pointer_cast<Table>(container);
+				tb->createIndexes(indexes);
 			} else if (container->getType() == "collection") {
 				auto collection = std::dynamic_pointer_cast<Collection>(container);
-				for (auto& idx: indexes) {
-					collection->createIndex(idx);
-				}
+				IndexType indexType = Collection::parseIndexType(type);
+				collection->createIndexes(indexes, indexType);
 			}
 		} catch (const std::exception& e) {
             response["response"] = std::string("Error: ") + e.what();
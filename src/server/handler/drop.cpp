@@ -2,6 +2,8 @@
 
 class DropTableHandler : public ActionHandler {
 public:
+    bool logged() const override { return true; }
+
     void handle(const json& task, Database::ptr db , json& response) override {
         std::string tableName = task["name"];
         db->removeContainer(tableName);
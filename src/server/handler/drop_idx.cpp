@@ -2,6 +2,8 @@
 
 class DropIdexesHandler : public ActionHandler {
 public:
+    bool logged() const override { return true; }
+
     void handle(const json& task, Database::ptr db , json& response) override {
         std::string name = task["name"];
 		std::vector<std::string> indexes;
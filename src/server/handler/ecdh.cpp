@@ -22,6 +22,12 @@ public:
 				//std::cout << "Tx: ";
 				//printHex(sessionKeys.second);
 			}	
+			// 协商分段大小，旧版本客户端不带该字段时保持默认分段
+			if (port && task.contains("segment")) {
+				size_t agreed = std::min(task["segment"].get<size_t>(), Transport::maxSegmentSize());
+				port->setSegmentSize(agreed);
+				response["segment"] = port->getSegmentSize();
+			}
 			response["primitive"] = "HKDF";
 			response["pks"] = toHexString(serverKxPair.first);
 		} else if (primitive == "Argon2") {
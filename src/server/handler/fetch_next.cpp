@@ -0,0 +1,47 @@
+#include "../registry.hpp"
+#include "../cursor.hpp"
+
+class FetchNextHandler : public ActionHandler {
+public:
+    bool heavy(const json& /*task*/, Database::ptr /*db*/) const override { return true; }
+
+    void handle(const json& task, Database::ptr /*db*/, json& response) override {
+        auto& cursors = CursorManager::getInstance();
+        uint64_t id = task["cursor"];
+        response["cursor"] = id;
+        // close 为 true 时提前释放游标
+        if (task.value("close", false)) {
+            bool closed = cursors.close(port_id_, id);
+            response["response"] = closed ? "cursor closed" : "Cursor not found";
+            response["status"] = closed ? "200" : "404";
+            return;
+        }
+        auto cursor = cursors.get(port_id_, id);
+        if (cursor == nullptr) {
+            response["response"] = "Cursor not found";
+            response["status"] = "404";
+            return;
+        }
+        size_t batch = task["batch"].get<size_t>();
+        if (batch == 0 || batch > CursorManager::maxBatch()) {
+            response["response"] = "batch must be between 1 and " + std::to_string(CursorManager::maxBatch());
+            response["status"] = "400";
+            return;
+        }
+        try {
+            bool more = cursor->next(batch, budget_, response);
+            response["more"] = more;
+            response["total"] = cursor->total();
+            if (!more) {
+                cursors.close(port_id_, id);
+            }
+            response["response"] = "fetch success";
+            response["status"] = "200";
+        } catch (const std::exception& e) {
+            response["response"] = std::string("Error: ") + e.what();
+            response["status"] = "500";
+        }
+    }
+};
+
+REGISTER_ACTION("fetch_next", FetchNextHandler)
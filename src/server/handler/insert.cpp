@@ -2,6 +2,26 @@
 
 class InsertTableHandler : public ActionHandler {
 public:
+    bool logged() const override { return true; }
+    // 少量行的插入按点操作调度，大批插入进入扫描通道
+    bool heavy(const json& task, Database::ptr /*db*/) const override {
+        const char* key = task.contains("documents") ? "documents" : "rows";
+        return task.contains(key) && task[key].size() > kPointRows;
+    }
+
+    // 集合自动生成的文档 ID 每次不同，写日志前先生成好，重放时使用相同的 ID
+    void prepare(json& task, Database::ptr db) override {
+        auto container = db->getContainer(task["name"]);
+        if (!container || container->getType() != "collection" || !task.contains("documents")) {
+            return;
+        }
+        for (auto& jDoc : task["documents"]) {
+            if (jDoc.is_object() && !(jDoc.contains("_id") && jDoc["_id"].is_number_integer())) {
+                jDoc["_id"] = static_cast<DocumentId>(std::hash<std::string>{}(generateUniqueId()));
+            }
+        }
+    }
+
     void handle(const json& task, Database::ptr db, json& response) override {
         std::string name = task["name"];
         auto container = db->getContainer(name);
@@ -1,7 +1,13 @@
 #include "../registry.hpp"
+#include "../cursor.hpp"
 
 class SelectTableHandler : public ActionHandler {
 public:
+    // 游标查询按扫描调度；主键或索引等值查找少量行时按点操作调度
+    bool heavy(const json& task, Database::ptr db) const override {
+        return task.contains("batch") || !pointQuery(task, db, true);
+    }
+
     void handle(const json& task, Database::ptr db , json& response) override {
         std::string name = task["name"];
 		auto container = db->getContainer(name);
@@ -16,8 +22,10 @@ public:
         }
 		try {
             if (container->getType() == "table") {
-				uint32_t limit = task["limit"];
-				uint32_t offset = task["offset"];
+				// 游标模式下 limit 和 offset 可以省略
+				bool streaming = task.contains("batch");
+				uint32_t limit = streaming ? task.value("limit", UINT32_MAX) : task["limit"].get<uint32_t>();
+				uint32_t offset = streaming ? task.value("offset", 0u) : task["offset"].get<uint32_t>();
 				std::vector<std::string> columnNames = task["columns"].get<std::vector<std::string>>();
 				std::vector<std::string> conditions = task["conditions"].get<std::vector<std::string>>();
 				std::vector<std::string> operators = task["ops"].get<std::vector<std::string>>();
@@ -41,17 +49,29 @@ public:
 					queryValues.push_back(field.getValue());
 				}
 
-				auto ret = tb->query(columnNames,conditions,queryValues,operators,offset,limit);
+				if (streaming) {
+					auto ids = tb->queryRowIds(conditions, queryValues, operators);
+					size_t begin = std::min<size_t>(offset, ids.size());
+					size_t end = begin + std::min<size_t>(limit, ids.size() - begin);
+					ids = std::vector<RowId>(ids.begin() + begin, ids.begin() + end);
+					openCursor(std::make_shared<TableCursor>(tb, columnNames, std::move(ids)), task, response);
+					return;
+				}
+				std::vector<RowId> rowIds;
+				auto ret = tb->query(columnNames,conditions,queryValues,operators,offset,limit,&rowIds);
+				json results = json::array();
 				for (auto& fieldValues : ret) { //每一行数据
 					json rowJson;
 					for (size_t i = 0; i < columnNames.size(); ++i) { //每一列
-						if (rowJson[columnNames[i]].is_null()) {
-							rowJson[columnNames[i]] = json::array();
-						}
-						rowJson[columnNames[i]] = Field(fieldValues[i]).toJson();
+						rowJson[columnNames[i]] = valuetoJson(fieldValues[i]);
 					}
-					response["results"].push_back(rowJson);
+					results.push_back(std::move(rowJson));
 				}
+				if (!results.empty()) {
+					response["results"] = std::move(results);
+				}
+				// 每行的稳定行号，与 results 一一对应
+				response["rowids"] = rowIds;
 				// 总行数
 				response["total"] = ret.size();
             } else if (container->getType() == "collection") {
@@ -60,6 +80,10 @@ public:
                     throw std::runtime_error("Failed to cast to Collection");
                 }
                 auto results = collection->queryFromJson(task);
+                if (task.contains("batch")) {
+                    openCursor(std::make_shared<CollectionCursor>(std::move(results)), task, response);
+                    return;
+                }
                 json j = json::array();
                 for (const auto& [docId, doc] : results) {
                     j.push_back({docId,doc->toJson()});
@@ -74,6 +98,21 @@ public:
             response["status"] = "500";
         }
     }
+
+private:
+    // 返回第一批结果，还有剩余时登记游标，客户端用 fetch_next 继续读取
+    void openCursor(Cursor::ptr cursor, const json& task, json& response) {
+        size_t batch = task["batch"].get<size_t>();
+        if (batch == 0 || batch > CursorManager::maxBatch()) {
+            throw std::invalid_argument("batch must be between 1 and " + std::to_string(CursorManager::maxBatch()));
+        }
+        response["total"] = cursor->total();
+        bool more = cursor->next(batch, budget_, response);
+        response["more"] = more;
+        if (more) {
+            response["cursor"] = CursorManager::getInstance().open(port_id_, std::move(cursor));
+        }
+    }
 };
 
 REGISTER_ACTION("select", SelectTableHandler)
\ No newline at end of file
@@ -2,6 +2,10 @@
 
 class UpdateTableHandler : public ActionHandler {
 public:
+    bool logged() const override { return true; }
+    // 主键或索引等值只更新少量行时按点操作调度
+    bool heavy(const json& task, Database::ptr db) const override { return !pointQuery(task, db); }
+
     void handle(const json& task, Database::ptr db , json& response) override {
 		std::string name = task["name"];
 		auto container = db->getContainer(name);
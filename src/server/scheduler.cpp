@@ -0,0 +1,165 @@
+#include <algorithm>
+#include "scheduler.hpp"
+#include "util/util.hpp"
+
+RequestScheduler::RequestScheduler(Post post, size_t workers)
+    : post_(std::move(post)),
+      workers_(std::max<size_t>(workers, 1)),
+      scanSlots_(get_env_var("DB_SCAN_THREADS", std::max<size_t>(workers_ - 1, 1))),
+      pointWeight_(std::max<size_t>(get_env_var("DB_POINT_WEIGHT", size_t(4)), 1)) {
+}
+
+void RequestScheduler::submit(uint32_t portId, Lane lane, bool barrier, std::function<void()> job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& conn = connections_[portId];
+    if (conn.closed) {
+        return;
+    }
+    uint64_t seq = conn.nextSeq++;
+    if (barrier) {
+        conn.barriers.push_back(seq);
+    }
+    if (conn.lanes[lane].empty()) {
+        active_[lane].push_back(portId);
+    }
+    conn.lanes[lane].push_back(Job{seq, barrier, std::move(job)});
+    ++queued_;
+    kick();
+}
+
+void RequestScheduler::closeConnection(uint32_t portId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = connections_.find(portId);
+    if (it == connections_.end()) {
+        return;
+    }
+    auto& conn = it->second;
+    for (auto& jobs : conn.lanes) {
+        queued_ -= jobs.size();
+        jobs.clear();
+    }
+    conn.barriers.clear();
+    for (auto& ids : active_) {
+        ids.erase(std::remove(ids.begin(), ids.end(), portId), ids.end());
+    }
+    if (conn.running == 0) {
+        connections_.erase(it);
+    } else {
+        conn.closed = true;
+    }
+}
+
+bool RequestScheduler::eligible(const Connection& conn, int lane) const {
+    if (conn.barrierRunning) {
+        return false;
+    }
+    const Job& job = conn.lanes[lane].front();
+    if (!job.barrier) {
+        // 排在之前的屏障请求执行完以后才能开始
+        return conn.barriers.empty() || job.seq < conn.barriers.front();
+    }
+    // 屏障请求等之前的请求都已完成
+    const auto& other = conn.lanes[1 - lane];
+    return conn.running == 0 && job.seq == conn.barriers.front() &&
+           (other.empty() || other.front().seq > job.seq);
+}
+
+bool RequestScheduler::pickFrom(int lane, uint32_t& portId, Job& job) {
+    auto& ids = active_[lane];
+    for (size_t n = ids.size(); n > 0; --n) {
+        uint32_t id = ids.front();
+        ids.pop_front();
+        auto it = connections_.find(id);
+        if (it == connections_.end() || it->second.lanes[lane].empty()) {
+            continue;
+        }
+        auto& conn = it->second;
+        if (!eligible(conn, lane)) {
+            ids.push_back(id);
+            continue;
+        }
+        job = std::move(conn.lanes[lane].front());
+        conn.lanes[lane].pop_front();
+        if (!conn.lanes[lane].empty()) {
+            ids.push_back(id);
+        }
+        portId = id;
+        return true;
+    }
+    return false;
+}
+
+bool RequestScheduler::pick(uint32_t& portId, Job& job, int& lane) {
+    bool canScan = scansRunning_ < scanSlots_;
+    // 连续执行了 pointWeight_ 个点操作后优先执行一个扫描，避免扫描饿死
+    if (canScan && pointStreak_ >= pointWeight_ && pickFrom(SCAN, portId, job)) {
+        lane = SCAN;
+    } else if (pickFrom(POINT, portId, job)) {
+        lane = POINT;
+    } else if (canScan && pickFrom(SCAN, portId, job)) {
+        lane = SCAN;
+    } else {
+        return false;
+    }
+    pointStreak_ = lane == POINT ? pointStreak_ + 1 : 0;
+    return true;
+}
+
+void RequestScheduler::kick() {
+    size_t busy = running_ + posted_;
+    size_t idle = workers_ > busy ? workers_ - busy : 0;
+    for (size_t n = std::min(idle, queued_); n > 0; --n) {
+        ++posted_;
+        post_([this]() { runOne(); });
+    }
+}
+
+void RequestScheduler::runOne() {
+    uint32_t portId;
+    Job job;
+    int lane;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --posted_;
+        if (!pick(portId, job, lane)) {
+            return;
+        }
+        --queued_;
+        ++running_;
+        if (lane == SCAN) {
+            ++scansRunning_;
+        }
+        auto& conn = connections_[portId];
+        ++conn.running;
+        if (job.barrier) {
+            conn.barriers.pop_front();
+            conn.barrierRunning = true;
+        }
+    }
+
+    try {
+        job.run();
+    } catch (const std::exception& e) {
+        std::cerr << "request job error: " << e.what() << std::endl;
+    }
+    job.run = nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    --running_;
+    if (lane == SCAN) {
+        --scansRunning_;
+    }
+    auto it = connections_.find(portId);
+    if (it != connections_.end()) {
+        auto& conn = it->second;
+        --conn.running;
+        if (job.barrier) {
+            conn.barrierRunning = false;
+        }
+        if (conn.closed && conn.running == 0) {
+            connections_.erase(it);
+        }
+    }
+    // 完成的请求可能解除了同一连接后续请求的等待，或者空出了扫描名额
+    kick();
+}
@@ -0,0 +1,70 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+// 请求调度: 每个连接按到达顺序排队，分点操作和扫描两个通道
+// 同一通道内各连接轮流取请求，一个连接大量的扫描不会让其他连接排在它后面
+// 通道之间按权重交替，同时执行的扫描数有上限，始终留出线程处理点操作
+// 修改数据的请求是所在连接的屏障: 等之前的请求都完成后单独执行，之后的请求等它完成，保证写后读
+class RequestScheduler {
+public:
+    enum Lane { POINT = 0, SCAN = 1 };
+    using Post = std::function<void(std::function<void()>)>;
+
+    // post 把任务投递到线程池，workers 为线程池的线程数
+    RequestScheduler(Post post, size_t workers);
+
+    RequestScheduler(const RequestScheduler&) = delete;
+    RequestScheduler& operator=(const RequestScheduler&) = delete;
+
+    void submit(uint32_t portId, Lane lane, bool barrier, std::function<void()> job);
+    // 连接关闭时丢弃排队的请求，正在执行的请求照常完成
+    void closeConnection(uint32_t portId);
+
+private:
+    struct Job {
+        uint64_t seq;
+        bool barrier;
+        std::function<void()> run;
+    };
+
+    struct Connection {
+        std::deque<Job> lanes[2];
+        std::deque<uint64_t> barriers;      // 还未开始执行的屏障请求序号
+        uint64_t nextSeq = 0;
+        size_t running = 0;
+        bool barrierRunning = false;
+        bool closed = false;
+    };
+
+    // 以下函数调用时持有 mutex_
+    bool eligible(const Connection& conn, int lane) const;
+    // 在 lane 中轮转查找下一个可以执行的请求
+    bool pickFrom(int lane, uint32_t& portId, Job& job);
+    bool pick(uint32_t& portId, Job& job, int& lane);
+    // 按空闲线程数投递执行者，每个执行者取一个请求执行
+    void kick();
+
+    void runOne();
+
+    Post post_;
+    const size_t workers_;
+    const size_t scanSlots_;      // 同时执行的扫描上限
+    const size_t pointWeight_;    // 两个通道都有请求时，每执行一个扫描之前最多连续执行的点操作数
+
+    std::mutex mutex_;
+    std::unordered_map<uint32_t, Connection> connections_;
+    std::deque<uint32_t> active_[2];    // 通道中有排队请求的连接，按轮转顺序
+    size_t queued_ = 0;
+    size_t posted_ = 0;
+    size_t running_ = 0;
+    size_t scansRunning_ = 0;
+    size_t pointStreak_ = 0;
+};
+
+#endif
@@ -0,0 +1,458 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include "wal.hpp"
+#include "log/logger.hpp"
+
+namespace {
+
+constexpr size_t kHeaderSize = 2 * sizeof(uint32_t);
+constexpr size_t kMinBodySize = sizeof(uint16_t) + sizeof(uint64_t);
+constexpr uint32_t kMaxRecordSize = 1u << 30;
+constexpr const char* kManifest = "checkpoint";
+constexpr const char* kSegmentSuffix = ".log";
+
+// 分段计算 CRC32: 从 0xFFFFFFFF 开始累积，最后取反
+uint32_t crc32Update(uint32_t crc, const char* data, size_t len) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+template <typename T>
+void append(std::vector<char>& buf, const T& value) {
+    const char* p = reinterpret_cast<const char*>(&value);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+} // namespace
+
+WriteAheadLog& WriteAheadLog::getInstance() {
+    static WriteAheadLog instance;
+    return instance;
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+std::string WriteAheadLog::segmentPath(uint64_t seq) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020llu%s", static_cast<unsigned long long>(seq), kSegmentSuffix);
+    return (std::filesystem::path(dir_) / name).string();
+}
+
+std::vector<uint64_t> WriteAheadLog::listSegments() const {
+    std::vector<uint64_t> segments;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+        const auto& path = entry.path();
+        if (!entry.is_regular_file() || path.extension() != kSegmentSuffix) {
+            continue;
+        }
+        std::string stem = path.stem().string();
+        if (!stem.empty() && std::all_of(stem.begin(), stem.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            segments.push_back(std::stoull(stem));
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+size_t WriteAheadLog::replay(const std::string& dirPath, const std::function<void(const json&)>& apply) {
+    dir_ = dirPath;
+    std::ifstream manifest(std::filesystem::path(dir_) / kManifest);
+    if (manifest.is_open()) {
+        // manifest 通过 rename 原子替换，解析失败说明文件被破坏，不能继续重放
+        json j = json::parse(manifest);
+        checkpointedLsn_ = j.at("lsn").get<uint64_t>();
+        checkpointLsn_ = j.at("containers").get<std::unordered_map<std::string, uint64_t>>();
+    }
+
+    uint64_t maxLsn = checkpointedLsn_;
+    size_t count = 0;
+    for (uint64_t seq : listSegments()) {
+        std::string filePath = segmentPath(seq);
+        std::ifstream inFile(filePath, std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+        inFile.close();
+
+        size_t offset = 0;
+        while (offset + kHeaderSize <= data.size()) {
+            uint32_t len, crc;
+            std::memcpy(&len, data.data() + offset, sizeof(len));
+            std::memcpy(&crc, data.data() + offset + sizeof(len), sizeof(crc));
+            const char* body = data.data() + offset + kHeaderSize;
+            if (len < kMinBodySize || len > kMaxRecordSize || offset + kHeaderSize + len > data.size()
+                || (crc32Update(0xFFFFFFFFu, body, len) ^ 0xFFFFFFFFu) != crc) {
+                break;
+            }
+            uint16_t nameLen;
+            uint64_t lsn;
+            std::memcpy(&nameLen, body, sizeof(nameLen));
+            std::memcpy(&lsn, body + len - sizeof(lsn), sizeof(lsn));
+            if (sizeof(nameLen) + nameLen > len - sizeof(lsn)) {
+                break;
+            }
+            std::string name(body + sizeof(nameLen), nameLen);
+            const char* payload = body + sizeof(nameLen) + nameLen;
+            offset += kHeaderSize + len;
+            maxLsn = std::max(maxLsn, lsn);
+
+            // 已经包含在容器快照中的记录跳过
+            auto saved = checkpointLsn_.find(name);
+            if (saved != checkpointLsn_.end() && lsn <= saved->second) {
+                continue;
+            }
+            try {
+                const char* payloadEnd = body + len - sizeof(lsn);
+                // 旧版本写入的是 JSON 文本
+                apply(payload < payloadEnd && *payload == '{' ? json::parse(payload, payloadEnd) :
+                    json::from_msgpack(payload, payloadEnd));
+            } catch (const std::exception& e) {
+                logger.log(Logger::LogLevel::ERROR, "WAL replay record {} failed: {}", lsn, e.what());
+            }
+            lastLsn_[name] = lsn;
+            count++;
+        }
+        if (offset < data.size()) {
+            // 最后一条记录没有写完整，丢弃
+            logger.log(Logger::LogLevel::WARNING, "WAL segment {} truncated at offset {}, {} bytes dropped",
+                seq, offset, data.size() - offset);
+            std::filesystem::resize_file(filePath, offset);
+        }
+        retainedBytes_ += offset;
+    }
+    // 序号在重启后继续递增，新记录不会被快照序号误判为已保存
+    appendedLsn_ = durableLsn_ = maxLsn;
+    return count;
+}
+
+void WriteAheadLog::openSegment(uint64_t seq) {
+    std::string filePath = segmentPath(seq);
+    int fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open WAL: " + filePath + ": " + std::strerror(errno));
+    }
+    // 新段的目录项落盘后才能在其中确认记录
+    if (!syncPath(dir_)) {
+        ::close(fd);
+        throw std::runtime_error("Failed to sync WAL directory: " + dir_ + ": " + std::strerror(errno));
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = fd;
+    segment_ = seq;
+    bytes_ = 0;
+}
+
+void WriteAheadLog::open(const std::string& dirPath) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ >= 0) {
+        return;
+    }
+    dir_ = dirPath;
+    std::filesystem::create_directories(dir_);
+    auto segments = listSegments();
+    openSegment(segments.empty() ? 1 : segments.back() + 1);
+    stop_ = false;
+    failed_ = false;
+    flusher_ = std::thread(&WriteAheadLog::flushLoop, this);
+}
+
+void WriteAheadLog::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fd_ < 0) {
+            return;
+        }
+        stop_ = true;
+    }
+    pending_.notify_one();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    ::close(fd_);
+    fd_ = -1;
+}
+
+uint64_t WriteAheadLog::apply(const std::string& name, const json& record, const std::function<bool()>& fn) {
+    if (name.size() > UINT16_MAX) {
+        throw std::invalid_argument("Container name is too long: " + name.substr(0, 64));
+    }
+    std::shared_lock<std::shared_mutex> block(checkpointMutex_);
+    std::lock_guard<std::mutex> order(orderMutexes_[std::hash<std::string>{}(name) % orderMutexes_.size()]);
+    {
+        // 写失败后日志中缺了记录，之后的修改即使写成功也无法按顺序重放，checkpoint 之前不再执行修改
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (failed_) {
+            throw std::runtime_error("WAL write failed, changes are rejected until the next checkpoint");
+        }
+    }
+    if (!fn()) {
+        return 0;
+    }
+    // 序号放在记录末尾，锁外先算好前面部分的 CRC，锁内只补上序号
+    // 请求可能带有二进制值，用 MessagePack 保存才能原样重放
+    std::vector<uint8_t> payload = json::to_msgpack(record);
+    uint16_t nameLen = static_cast<uint16_t>(name.size());
+    uint32_t len = static_cast<uint32_t>(sizeof(nameLen) + name.size() + payload.size() + sizeof(uint64_t));
+    uint32_t crc = crc32Update(0xFFFFFFFFu, reinterpret_cast<const char*>(&nameLen), sizeof(nameLen));
+    crc = crc32Update(crc, name.data(), name.size());
+    crc = crc32Update(crc, reinterpret_cast<const char*>(payload.data()), payload.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) {
+        return 0;
+    }
+    uint64_t lsn = ++appendedLsn_;
+    crc = crc32Update(crc, reinterpret_cast<const char*>(&lsn), sizeof(lsn)) ^ 0xFFFFFFFFu;
+    append(buffer_, len);
+    append(buffer_, crc);
+    append(buffer_, nameLen);
+    buffer_.insert(buffer_.end(), name.begin(), name.end());
+    buffer_.insert(buffer_.end(), payload.begin(), payload.end());
+    append(buffer_, lsn);
+    lastLsn_[name] = lsn;
+    pending_.notify_one();
+    return lsn;
+}
+
+void WriteAheadLog::waitDurable(uint64_t lsn) {
+    if (lsn == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    durable_.wait(lock, [&] { return durableLsn_ >= lsn || failed_ || fd_ < 0; });
+    if (durableLsn_ < lsn) {
+        throw std::runtime_error("WAL write failed, the change is not durable");
+    }
+}
+
+void WriteAheadLog::flushLoop() {
+    std::vector<char> batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        pending_.wait(lock, [&] { return !buffer_.empty() || stop_; });
+        if (buffer_.empty()) {
+            break;
+        }
+        // 取走当前积累的所有记录，写盘期间新的记录继续追加到 buffer_，由下一次同步覆盖
+        batch.swap(buffer_);
+        uint64_t lsn = appendedLsn_;
+        if (failed_) {
+            // 失败之后追加的记录不再写入，等待的请求返回错误，修改由 checkpoint 的快照保存
+            batch.clear();
+            durable_.notify_all();
+            continue;
+        }
+        flushing_ = true;
+        size_t good = bytes_;
+        lock.unlock();
+
+        bool ok = true;
+        for (size_t written = 0; written < batch.size();) {
+            ssize_t n = ::write(fd_, batch.data() + written, batch.size() - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { ok = false; break; }
+            written += static_cast<size_t>(n);
+        }
+        ok = ok && ::fdatasync(fd_) == 0;
+        if (!ok) {
+            logger.log(Logger::LogLevel::ERROR, "WAL write failed: {}", std::strerror(errno));
+            // 去掉写了一半的记录，段中只留下已确认的部分
+            if (::ftruncate(fd_, good) != 0) {
+                logger.log(Logger::LogLevel::ERROR, "WAL truncate failed: {}", std::strerror(errno));
+            }
+        }
+
+        lock.lock();
+        flushing_ = false;
+        if (ok) {
+            durableLsn_ = lsn;
+            bytes_ += batch.size();
+        } else {
+            // durableLsn_ 不越过失败的记录，直到 checkpoint 成功
+            failed_ = true;
+        }
+        batch.clear();
+        durable_.notify_all();
+    }
+}
+
+bool WriteAheadLog::checkpoint(const std::function<std::vector<std::string>()>& listNames, const Snapshot& snapshot,
+    size_t threads) {
+    std::lock_guard<std::mutex> running(checkpointRunning_);
+    std::vector<std::string> names;
+    bool recovering = false;    // 切换时日志处于写失败状态
+    uint64_t switchLsn = 0;
+    {
+        // 切换日志段: 等已追加的记录写完，之后的记录写入新段
+        std::unique_lock<std::shared_mutex> block(checkpointMutex_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (fd_ < 0) {
+            return false;
+        }
+        durable_.wait(lock, [&] { return buffer_.empty() && !flushing_; });
+        recovering = failed_;
+        switchLsn = appendedLsn_;
+        size_t oldBytes = bytes_;
+        try {
+            openSegment(segment_ + 1);
+        } catch (const std::exception& e) {
+            logger.log(Logger::LogLevel::ERROR, "WAL checkpoint failed: {}", e.what());
+            return false;
+        }
+        retainedBytes_ += oldBytes;
+        lock.unlock();
+        // 修改仍被阻塞，取到的容器与旧段中的记录一致
+        names = listNames();
+    }
+
+    // 各容器在不同的线程中生成快照并写盘，checkpointLsn_ 在此期间只读
+    std::atomic<bool> ok{true};
+    std::vector<uint64_t> savedLsns(names.size(), 0);
+    parallelFor(names.size(), threads, [&](size_t i) {
+        const auto& name = names[i];
+        auto it = checkpointLsn_.find(name);
+        uint64_t savedLsn = it == checkpointLsn_.end() ? 0 : it->second;
+        uint64_t lsn = 0;
+        std::function<bool()> write;
+        try {
+            // 持有容器的顺序锁时复制数据，快照恰好包含序号不大于 lsn 的记录
+            std::lock_guard<std::mutex> order(orderMutexes_[std::hash<std::string>{}(name) % orderMutexes_.size()]);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto last = lastLsn_.find(name);
+                lsn = last == lastLsn_.end() ? 0 : last->second;
+            }
+            if (lsn > savedLsn) {
+                write = snapshot(name);
+            }
+        } catch (const std::exception& e) {
+            logger.log(Logger::LogLevel::ERROR, "Snapshot of {} failed: {}", name, e.what());
+            ok = false;
+        }
+
+        bool written = false;
+        if (write) {
+            try {
+                written = write();
+            } catch (const std::exception& e) {
+                logger.log(Logger::LogLevel::ERROR, "Saving {} failed: {}", name, e.what());
+            }
+            if (!written) {
+                ok = false;
+            }
+        }
+        savedLsns[i] = written ? lsn : savedLsn;
+    });
+    std::unordered_map<std::string, uint64_t> saved;
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (savedLsns[i] > 0) {
+            saved[names[i]] = savedLsns[i];
+        }
+    }
+
+    // 已删除的容器不再出现在 manifest 中
+    checkpointLsn_.swap(saved);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        checkpointedLsn_ = appendedLsn_;
+    }
+    if (!saveManifest()) {
+        return false;
+    }
+    if (!ok) {
+        // 有容器没有保存成功，保留旧段
+        return false;
+    }
+    uint64_t current;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current = segment_;
+    }
+    for (uint64_t seq : listSegments()) {
+        if (seq < current) {
+            std::error_code ec;
+            std::filesystem::remove(segmentPath(seq), ec);
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    retainedBytes_ = 0;
+    if (recovering) {
+        // 旧段中写失败的记录已经执行，全部快照保存成功后才算落盘，恢复接受修改
+        durableLsn_ = std::max(durableLsn_, switchLsn);
+        failed_ = false;
+        durable_.notify_all();
+        logger.log(Logger::LogLevel::INFO, "WAL recovered by checkpoint at {}", switchLsn);
+    }
+    return true;
+}
+
+bool WriteAheadLog::failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+bool WriteAheadLog::saveManifest() {
+    json j;
+    j["lsn"] = checkpointedLsn_;
+    j["containers"] = checkpointLsn_;
+    std::filesystem::path path = std::filesystem::path(dir_) / kManifest;
+    std::string tmpPath = path.string() + ".tmp";
+    {
+        std::ofstream outFile(tmpPath, std::ios::trunc);
+        outFile << j.dump();
+        outFile.close();
+        if (!outFile) {
+            logger.log(Logger::LogLevel::ERROR, "Failed to write {}", tmpPath);
+            return false;
+        }
+    }
+    // 写临时文件后 rename，重启时读到的总是完整的 manifest
+    std::error_code ec;
+    if (syncPath(tmpPath)) {
+        std::filesystem::rename(tmpPath, path, ec);
+        if (!ec && syncPath(dir_)) {
+            return true;
+        }
+    }
+    logger.log(Logger::LogLevel::ERROR, "Failed to save {}: {}", path.string(), ec ? ec.message() : std::strerror(errno));
+    return false;
+}
+
+size_t WriteAheadLog::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_ + retainedBytes_;
+}
+
+bool WriteAheadLog::syncPath(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
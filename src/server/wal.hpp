@@ -0,0 +1,91 @@
+#ifndef WAL_HPP
+#define WAL_HPP
+
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include "util/util.hpp"
+
+// 预写日志: 修改数据的请求执行成功后追加到日志，记录落盘后才返回响应
+// 后台线程把这段时间内追加的记录一次写入并 fdatasync，多个并发请求共用一次同步（group commit）
+// 日志按段存放在目录中，checkpoint 时切换到新段，只为有修改的容器写快照，全部写完后删除旧段
+// 目录中的 checkpoint 文件记录每个容器快照对应的序号，启动时只重放序号更大的记录
+// 记录格式: [uint32 长度][uint32 CRC32][uint16 容器名长度][容器名][MessagePack 编码的请求][uint64 序号]，长度和 CRC 覆盖 CRC 之后的内容
+class WriteAheadLog {
+public:
+    static WriteAheadLog& getInstance();
+
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // 按序号依次读出各段中快照之后的记录，遇到不完整或校验失败的记录时截断到最后一条完整的记录，返回重放的条数
+    size_t replay(const std::string& dirPath, const std::function<void(const json&)>& apply);
+    // 在目录中新建一个日志段并启动刷盘线程
+    void open(const std::string& dirPath);
+    void close();
+
+    // 在容器的顺序锁内执行 fn，fn 返回 true 时追加 record，同一容器的修改在日志中的顺序与执行顺序一致
+    // 返回记录的序号，没有追加时返回 0；日志写失败后不执行 fn，抛出 runtime_error
+    uint64_t apply(const std::string& name, const json& record, const std::function<bool()>& fn);
+    // 等待序号不大于 lsn 的记录落盘
+    void waitDurable(uint64_t lsn);
+
+    // snapshot 在容器的顺序锁内调用，只复制数据，返回在锁外把快照写盘的函数，写盘并同步成功时返回 true
+    using Snapshot = std::function<std::function<bool()>(const std::string& name)>;
+    // 增量 checkpoint: 切换日志段时短暂阻塞修改，之后为有修改的容器生成快照并写盘，其他容器的修改不受影响
+    // 最多 threads 个容器同时生成快照和写盘；listNames 在切换日志段时调用，返回当前所有容器；全部快照成功后删除旧日志段
+    bool checkpoint(const std::function<std::vector<std::string>()>& listNames, const Snapshot& snapshot,
+        size_t threads = 1);
+    // 日志文件的字节数
+    size_t size() const;
+    // 写盘失败后为 true，此时拒绝所有修改，直到 checkpoint 把已执行的修改保存到快照
+    bool failed() const;
+
+    // fsync 文件或目录
+    static bool syncPath(const std::string& path);
+
+private:
+    WriteAheadLog() = default;
+    void flushLoop();
+    void openSegment(uint64_t seq);
+    bool saveManifest();
+    std::string segmentPath(uint64_t seq) const;
+    std::vector<uint64_t> listSegments() const;
+
+    std::string dir_;
+    uint64_t segment_ = 0;              // 当前日志段编号
+    int fd_ = -1;
+    std::thread flusher_;
+    bool stop_ = false;
+    bool flushing_ = false;             // 刷盘线程正在写入
+    bool failed_ = false;               // 写入或同步失败后不再写入和确认新的记录
+
+    mutable std::mutex mutex_;
+    std::condition_variable pending_;   // 有新记录待写入
+    std::condition_variable durable_;   // 记录已落盘
+    std::vector<char> buffer_;          // 待写入的记录
+    uint64_t appendedLsn_ = 0;
+    uint64_t durableLsn_ = 0;
+    size_t bytes_ = 0;                  // 当前段的字节数
+    size_t retainedBytes_ = 0;          // 等待删除的旧段的字节数
+    std::unordered_map<std::string, uint64_t> lastLsn_;        // 容器最后一条记录的序号
+
+    // 修改请求持有共享锁，切换日志段时持有独占锁
+    std::shared_mutex checkpointMutex_;
+    // 同一时间只有一个 checkpoint
+    std::mutex checkpointRunning_;
+    // 按容器名分段的顺序锁
+    std::array<std::mutex, 64> orderMutexes_;
+    // 容器快照对应的序号，只在 replay 和 checkpoint 中访问
+    std::unordered_map<std::string, uint64_t> checkpointLsn_;
+    uint64_t checkpointedLsn_ = 0;
+};
+
+#endif
@@ -0,0 +1,210 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+#include "executor.hpp"
+
+namespace {
+
+// 当前线程所属的线程池和队列下标，工作线程内提交的任务直接进入自己的队列
+thread_local WorkStealingExecutor* current_executor = nullptr;
+thread_local size_t current_index = 0;
+
+// 解析 "0-3,8-11" 形式的 CPU 列表
+std::vector<int> parseCpuList(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream ss(text);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// 每个 NUMA 节点的 CPU，读不到拓扑时把所有 CPU 当作一个节点
+std::vector<std::vector<int>> numaNodes() {
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0;; ++node) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!file) {
+            break;
+        }
+        std::string text;
+        std::getline(file, text);
+        auto cpus = parseCpuList(text);
+        if (!cpus.empty()) {
+            nodes.push_back(std::move(cpus));
+        }
+    }
+    if (nodes.empty()) {
+        std::vector<int> cpus(std::max(1u, std::thread::hardware_concurrency()));
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            cpus[i] = i;
+        }
+        nodes.push_back(std::move(cpus));
+    }
+    return nodes;
+}
+
+}
+
+WorkStealingExecutor::Affinity WorkStealingExecutor::parseAffinity(const std::string& name) {
+    if (name == "cpu") {
+        return Affinity::CPU;
+    }
+    if (name == "numa") {
+        return Affinity::NUMA;
+    }
+    return Affinity::NONE;
+}
+
+WorkStealingExecutor::WorkStealingExecutor(size_t workers, Affinity affinity) {
+    workers = std::max<size_t>(workers, 1);
+    std::vector<int> nodeOf(workers, 0);
+    workers_.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+
+    if (affinity != Affinity::NONE) {
+        auto nodes = numaNodes();
+        if (affinity == Affinity::CPU) {
+            std::vector<std::pair<int, int>> cpus;  // (cpu, node)，按节点排列
+            for (size_t n = 0; n < nodes.size(); ++n) {
+                for (int cpu : nodes[n]) {
+                    cpus.emplace_back(cpu, n);
+                }
+            }
+            for (size_t i = 0; i < workers; ++i) {
+                auto [cpu, node] = cpus[i % cpus.size()];
+                workers_[i]->cpus = {cpu};
+                nodeOf[i] = node;
+            }
+        } else {
+            for (size_t i = 0; i < workers; ++i) {
+                nodeOf[i] = i % nodes.size();
+                workers_[i]->cpus = nodes[nodeOf[i]];
+            }
+        }
+    }
+
+    // 先找同节点的线程，再找其他节点，各自从下一个线程开始，避免所有线程都先去窃取同一个队列
+    for (size_t i = 0; i < workers; ++i) {
+        auto& victims = workers_[i]->victims;
+        for (int sameNode = 1; sameNode >= 0; --sameNode) {
+            for (size_t k = 1; k < workers; ++k) {
+                size_t j = (i + k) % workers;
+                if ((nodeOf[j] == nodeOf[i]) == bool(sameNode)) {
+                    victims.push_back(j);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < workers; ++i) {
+        workers_[i]->thread = std::thread([this, i]() { run(i); });
+        auto& cpus = workers_[i]->cpus;
+        if (!cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus) {
+                CPU_SET(cpu, &set);
+            }
+            if (pthread_setaffinity_np(workers_[i]->thread.native_handle(), sizeof(set), &set) != 0) {
+                std::cerr << "executor: failed to pin worker " << i << std::endl;
+            }
+        }
+    }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+    stop();
+}
+
+void WorkStealingExecutor::post(Task task) {
+    if (stopped_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    size_t index = current_executor == this ? current_index
+                 : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    // 先增加任务数再检查睡眠的线程，与 run 中的顺序相反，两边至少有一方能看到对方
+    pending_.fetch_add(1);
+    if (sleepers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        sleep_cv_.notify_one();
+    }
+}
+
+void WorkStealingExecutor::stop() {
+    if (stopped_.exchange(true)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        sleep_cv_.notify_all();
+    }
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+bool WorkStealingExecutor::tryPop(size_t index, Task& task) {
+    auto take = [&task](Worker& worker) {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) {
+            return false;
+        }
+        task = std::move(worker.tasks.front());
+        worker.tasks.pop_front();
+        return true;
+    };
+    auto& self = *workers_[index];
+    if (take(self)) {
+        return true;
+    }
+    for (size_t victim : self.victims) {
+        if (take(*workers_[victim])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingExecutor::run(size_t index) {
+    current_executor = this;
+    current_index = index;
+    Task task;
+    while (!stopped_.load(std::memory_order_relaxed)) {
+        if (tryPop(index, task)) {
+            pending_.fetch_sub(1);
+            try {
+                task();
+            } catch (const std::exception& e) {
+                std::cerr << "executor task error: " << e.what() << std::endl;
+            }
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleepers_.fetch_add(1);
+        sleep_cv_.wait(lock, [this]() {
+            return pending_.load() > 0 || stopped_.load();
+        });
+        sleepers_.fetch_sub(1);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 工作窃取线程池: 每个工作线程有自己的任务队列
+// 工作线程内提交的任务进入自己的队列，外部提交的任务轮流分给各个线程，自己的队列空了再从其他线程的队列窃取
+// 提交和领取大多落在不同的队列上，线程数增加时不再争用同一个队列
+class WorkStealingExecutor {
+public:
+    using Task = std::function<void()>;
+
+    // 线程绑定: NONE 不绑定；CPU 每个线程绑定一个 CPU；NUMA 线程按节点轮流分配，绑定到节点的 CPU，优先从同节点的线程窃取
+    enum class Affinity { NONE, CPU, NUMA };
+    // "cpu"、"numa"，其他值按 NONE
+    static Affinity parseAffinity(const std::string& name);
+
+    explicit WorkStealingExecutor(size_t workers, Affinity affinity = Affinity::NONE);
+    ~WorkStealingExecutor();
+
+    WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    void post(Task task);
+    // 等待工作线程退出，队列中未执行的任务丢弃
+    void stop();
+
+    size_t size() const { return workers_.size(); }
+
+private:
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::vector<size_t> victims;    // 窃取顺序，同节点的线程在前
+        std::vector<int> cpus;          // 绑定的 CPU，空表示不绑定
+        std::thread thread;
+    };
+
+    void run(size_t index);
+    bool tryPop(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> next_{0};       // 外部提交时轮流选择的队列
+    std::atomic<size_t> pending_{0};    // 所有队列中的任务数
+    std::atomic<size_t> sleepers_{0};
+    std::atomic<bool> stopped_{false};
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+};
+
+#endif
@@ -1,43 +1,46 @@
+#ifndef MSGBUFFER_HPP
+#define MSGBUFFER_HPP
+
 #include <iostream>
 #include <vector>
-#include <mutex>
-#include <condition_variable>
+#include <atomic>
 #include <cstring>
 #include <chrono>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+// 单生产者单消费者环形缓冲区，读写位置各自只由一方修改，不加锁
+// 只有对方正在等待时才通过 futex 唤醒，没有等待者时一次读写只是几次原子操作
+// 多个线程写入（或读取）同一个缓冲区时，由调用方保证同一时间只有一个写者（或读者）
 class CircularBuffer {
 public:
     explicit CircularBuffer(size_t size)
-        : buffer_(size), capacity_(size), read_pos_(0), write_pos_(0), full_(false) {}
+        : buffer_(size), capacity_(size) {}
+
+    CircularBuffer(const CircularBuffer&) = delete;
+    CircularBuffer& operator=(const CircularBuffer&) = delete;
 
+    // 由读者调用（或者两端都空闲时），丢弃所有未读数据
     void clear() {
-        std::unique_lock<std::mutex> lock(mutex_);
-        read_pos_ = 0;
-        write_pos_ = 0;
-        full_ = false;
-        write_cv_.notify_all();
-        read_cv_.notify_all();
+        read_pos_.store(write_pos_.load(std::memory_order_acquire), std::memory_order_release);
+        writable_.notify();
         //std::cout << "Buffer cleared.\n";
     }
 
     int write(const char* data, size_t size, std::chrono::milliseconds timeout) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        if (!write_cv_.wait_for(lock, timeout, [this, size]() { return size <= availableSpace(); })) {
+        size_t wpos = write_pos_.load(std::memory_order_relaxed);
+        if (!writable_.wait(timeout, [&]() {
+                return size <= capacity_ - (wpos - read_pos_.load(std::memory_order_acquire));
+            })) {
             std::cerr << "Write timeout.\n";
             return -1;
         }
 
-        size_t end_space = capacity_ - write_pos_;
-        if (size <= end_space) {
-            std::memcpy(&buffer_[write_pos_], data, size);
-        } else {
-            std::memcpy(&buffer_[write_pos_], data, end_space);
-            std::memcpy(&buffer_[0], data + end_space, size - end_space);
-        }
-
-        write_pos_ = (write_pos_ + size) % capacity_;
-        full_ = (write_pos_ == read_pos_);
-        read_cv_.notify_one();
+        copyIn(wpos % capacity_, data, size);
+        write_pos_.store(wpos + size, std::memory_order_release);
+        readable_.notify();
         return size;
     }
 
@@ -49,51 +52,105 @@ public:
         return accessData(data, size, timeout, true);
     }
 
+    // 读者等待至少 size 字节可读，之后同样大小的 peek/read 不会再等待
+    bool waitReadable(size_t size, std::chrono::milliseconds timeout) {
+        size_t rpos = read_pos_.load(std::memory_order_relaxed);
+        return readable_.wait(timeout, [&]() {
+            return size <= write_pos_.load(std::memory_order_acquire) - rpos;
+        });
+    }
+
     size_t readableSize() const {
-        std::unique_lock<std::mutex> lock(mutex_);
-        return calculateReadableSize();
+        return write_pos_.load(std::memory_order_acquire) - read_pos_.load(std::memory_order_acquire);
     }
 
 private:
+    // 等待条件成立: 先检查，不成立时登记为等待者再检查一次，然后在序号上 futex 等待
+    // 通知方先更新位置再递增序号，所以等待者读到的序号过期时 futex 会立即返回，不会丢失唤醒
+    class Waiter {
+    public:
+        template <typename Pred>
+        bool wait(std::chrono::milliseconds timeout, Pred pred) {
+            if (pred()) {
+                return true;
+            }
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (true) {
+                waiting_.store(true, std::memory_order_seq_cst);
+                uint32_t seq = seq_.load(std::memory_order_seq_cst);
+                if (pred()) {
+                    waiting_.store(false, std::memory_order_relaxed);
+                    return true;
+                }
+                auto remaining = deadline - std::chrono::steady_clock::now();
+                if (remaining <= std::chrono::nanoseconds::zero()) {
+                    waiting_.store(false, std::memory_order_relaxed);
+                    return false;
+                }
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+                struct timespec ts{static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAIT_PRIVATE, seq, &ts, nullptr, 0);
+            }
+        }
+
+        void notify() {
+            seq_.fetch_add(1, std::memory_order_seq_cst);
+            if (waiting_.load(std::memory_order_seq_cst)) {
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+            }
+        }
+
+    private:
+        std::atomic<uint32_t> seq_{0};
+        std::atomic<bool> waiting_{false};
+    };
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+
     int accessData(char* data, size_t size, std::chrono::milliseconds timeout, bool is_peek) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        if (!read_cv_.wait_for(lock, timeout, [this, size]() { return size <= calculateReadableSize(); })) {
+        size_t rpos = read_pos_.load(std::memory_order_relaxed);
+        if (!readable_.wait(timeout, [&]() {
+                return size <= write_pos_.load(std::memory_order_acquire) - rpos;
+            })) {
             //std::cerr << (is_peek ? "Peek" : "Read") << " timeout.\n";
             return -1;
         }
 
-        size_t end_space = capacity_ - read_pos_;
-        if (size <= end_space) {
-            std::memcpy(data, &buffer_[read_pos_], size);
-        } else {
-            std::memcpy(data, &buffer_[read_pos_], end_space);
-            std::memcpy(data + end_space, &buffer_[0], size - end_space);
-        }
-
+        copyOut(rpos % capacity_, data, size);
         if (!is_peek) {
-            read_pos_ = (read_pos_ + size) % capacity_;
-            full_ = false;
-            write_cv_.notify_one();
+            read_pos_.store(rpos + size, std::memory_order_release);
+            writable_.notify();
         }
         return size;
     }
 
-    size_t calculateReadableSize() const {
-        if (full_) return capacity_;
-        if (write_pos_ >= read_pos_) return write_pos_ - read_pos_;
-        return capacity_ - read_pos_ + write_pos_;
+    void copyIn(size_t pos, const char* data, size_t size) {
+        size_t end_space = capacity_ - pos;
+        if (size <= end_space) {
+            std::memcpy(&buffer_[pos], data, size);
+        } else {
+            std::memcpy(&buffer_[pos], data, end_space);
+            std::memcpy(&buffer_[0], data + end_space, size - end_space);
+        }
     }
 
-    size_t availableSpace() const {
-        return capacity_ - calculateReadableSize();
+    void copyOut(size_t pos, char* data, size_t size) const {
+        size_t end_space = capacity_ - pos;
+        if (size <= end_space) {
+            std::memcpy(data, &buffer_[pos], size);
+        } else {
+            std::memcpy(data, &buffer_[pos], end_space);
+            std::memcpy(data + end_space, &buffer_[0], size - end_space);
+        }
     }
 
     std::vector<char> buffer_;
-    size_t capacity_;
-    size_t read_pos_;
-    size_t write_pos_;
-    bool full_;
-    mutable std::mutex mutex_;
-    std::condition_variable read_cv_;
-    std::condition_variable write_cv_;
+    const size_t capacity_;
+    // 读写位置只增不减，取模得到下标，两者之差就是可读字节数
+    // 分别放在不同的缓存行，避免读者和写者互相使对方的缓存行失效
+    alignas(64) std::atomic<size_t> write_pos_{0};
+    Waiter readable_;       // 读者在这里等待数据
+    alignas(64) std::atomic<size_t> read_pos_{0};
+    Waiter writable_;       // 写者在这里等待空间
 };
+
+#endif
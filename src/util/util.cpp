@@ -3,6 +3,8 @@
 #include <random>
 #include <sstream>
 #include <thread>
+#include <atomic>
+#include <algorithm>
 #include <iomanip>
 #include <malloc.h>
 #include "util.hpp"
@@ -244,3 +246,20 @@ std::string generateUniqueId() {
     }
     return oss.str();
 }
+
+void parallelFor(size_t n, size_t threads, const std::function<void(size_t)>& fn) {
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i; (i = next.fetch_add(1)) < n;) {
+            fn(i);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min(threads, n); ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
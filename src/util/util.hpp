@@ -2,6 +2,7 @@
 #define UTIL_HPP
 
 #include <iostream>
+#include <functional>
 #include <nlohmann/json.hpp>
 #include <vector>
 
@@ -43,5 +44,7 @@ std::string get_timestamp();
 std::string get_timestamp_sec();
 std::time_t stringToTimeT(const std::string& dateTimeStr);
 std::string generateUniqueId();
+// 用 threads 个线程处理 [0, n)，调用线程也参与，每个线程依次领取下一个下标；fn 不能抛出异常
+void parallelFor(size_t n, size_t threads, const std::function<void(size_t)>& fn);
 
 #endif
\ No newline at end of file